@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Decodes an HTTP/1.1 chunked body on the fly, so a kept-alive response can be
+// parsed straight from the socket without the chunk headers reaching the parser
+class ChunkedStream : public Stream
+{
+public:
+    ChunkedStream(Stream &source, unsigned long timeout_ms = 5000);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+    // Consumes whatever is left of the body so the connection can be reused
+    void drain();
+    bool finished() const { return done; }
+
+private:
+    int readSource();
+    bool nextChunk();
+    void skipLine();
+
+    Stream &source;
+    unsigned long timeout_ms;
+    size_t remaining;
+    bool done;
+    int peeked;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+#include "DepartureTable.h"
+
+// What the panel showed when the snapshot was taken, so it can be redrawn
+// into the framebuffer without touching the panel
+struct ShownScreen
+{
+    uint8_t station;
+    uint8_t rows;
+    uint8_t departures[DepartureTable::MAX_DEPARTURES];
+    uint32_t drawn_at; // Wall clock the minutes on screen were computed for
+};
+
+// Wall clock times that carry the live mode schedule across deep sleep,
+// the fetch plan is kept by FetchScheduler
+struct LiveSchedule
+{
+    uint32_t live_until;
+};
+
+struct SnapshotStats
+{
+    uint32_t encoded_bytes;
+    uint32_t encode_us;
+    uint32_t decode_us;
+};
+
+// Departures and screen state of live mode, kept in RTC slow memory across
+// deep sleep so the first frame after a timer wake needs no network
+class DepartureSnapshot
+{
+public:
+    static const uint8_t NO_STATION = 0xFF;
+    // In place of a station: the dashboard was up, and is composed again from the departures and drawn_at
+    static const uint8_t DASHBOARD = 0xFE;
+
+    bool save(const DepartureTable &table, const ShownScreen &screen, const LiveSchedule &schedule);
+    bool restore(DepartureTable &table, ShownScreen &screen);
+    bool isValid() const;
+    void invalidate();
+
+    const LiveSchedule &getSchedule() const;
+    const SnapshotStats &getStats() const;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+// Preallocated departure storage, laid out as one array per field.
+// Line labels are interned and compacted to the ones still in use at the
+// start of every fetch cycle, station names and destinations
+// are copied into a small per-station arena that is reset whenever that
+// station is refetched, so a fetch cycle never touches the heap.
+class DepartureTable
+{
+public:
+    static const size_t MAX_STATIONS = 8;
+    static const size_t MAX_DEPARTURES = 10;
+    static const size_t MAX_LINES = 64;
+    static const size_t LINE_LABEL_SIZE = 8;
+    static const size_t ARENA_SIZE = 512;
+    static const size_t MAX_NAME_LENGTH = 63;
+    static const size_t MAX_DESTINATION_LENGTH = 0x7F;
+    static const uint8_t NO_LINE = 0xFF;
+
+    DepartureTable();
+
+    // Drops all stations and the line table
+    void clear();
+    // Drops the line labels no departure refers to anymore, renumbering the rest
+    void compactLines();
+    void resetStation(size_t station, const char *name);
+    bool addDeparture(size_t station, const char *line, const char *destination, uint32_t departure_time);
+
+    size_t stationCount() const { return station_count; }
+    const char *stationName(size_t station) const { return arenas[station]; }
+    size_t departureCount(size_t station) const { return departure_counts[station]; }
+    const char *line(size_t station, size_t index) const;
+    const char *destination(size_t station, size_t index) const { return arenas[station] + destination_offsets[station][index]; }
+    uint32_t departureTime(size_t station, size_t index) const { return departure_times[station][index]; }
+
+    static long minutesUntil(uint32_t departure_time, time_t now);
+
+    // Compact binary form for RTC memory: departure times as offsets from the
+    // earliest one, labels and repeated destinations stored once, destinations
+    // cut to destination_limit bytes at a character boundary.
+    // Returns the encoded length, or 0 when the buffer is too small.
+    size_t encode(uint8_t *buffer, size_t size, size_t destination_limit = MAX_DESTINATION_LENGTH) const;
+    bool decode(const uint8_t *buffer, size_t length);
+
+    // Longest encode() output of a full table
+    static constexpr size_t maxEncodedSize(size_t destination_limit)
+    {
+        return 1 + MAX_LINES * LINE_LABEL_SIZE + sizeof(uint32_t) + 1 +
+               MAX_STATIONS * (1 + MAX_NAME_LENGTH + 1 + MAX_DEPARTURES * (1 + sizeof(uint16_t) + 1 + destination_limit));
+    }
+
+private:
+    uint8_t internLine(const char *label);
+
+    uint8_t line_ids[MAX_STATIONS][MAX_DEPARTURES];
+    uint16_t destination_offsets[MAX_STATIONS][MAX_DEPARTURES];
+    uint32_t departure_times[MAX_STATIONS][MAX_DEPARTURES];
+    uint8_t departure_counts[MAX_STATIONS];
+
+    char arenas[MAX_STATIONS][ARENA_SIZE];
+    uint16_t arena_used[MAX_STATIONS];
+    size_t station_count;
+
+    char line_labels[MAX_LINES][LINE_LABEL_SIZE];
+    size_t line_count;
+};
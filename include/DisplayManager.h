@@ -1,39 +1,216 @@
 #pragma once
 
 #include <WString.h>
+#include <atomic>
 #include <epd_driver.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <firasans.h>
 #include <firasans_small.h>
+#include "GlyphCache.h"
+#include "TextLayout.h"
+
+struct CommitStats
+{
+    uint32_t pushed_pixels;
+    uint32_t refresh_ms;
+    uint32_t commit_count;
+    uint32_t tiles_changed;
+    uint32_t bytes_compared;
+    bool full_refresh;
+};
+
+// Timings of the frames handed from the drawing side to the panel task
+struct FrameStats
+{
+    uint32_t frames_handed;
+    uint32_t frames_pushed;
+    uint32_t frames_replaced; // Handed off, but superseded before the panel task took them
+    uint32_t last_compose_us; // Drawing time that went into the frame
+    uint32_t max_compose_us;
+    uint32_t last_handoff_us; // What commit() cost the caller
+    uint32_t max_handoff_us;
+    uint32_t last_push_ms;    // Diff plus waveform, on the panel task
+    uint32_t max_push_ms;
+    // Totals per frame format, for comparing the two
+    uint32_t gray_pushes;
+    uint32_t gray_push_ms;
+    uint32_t mono_pushes;
+    uint32_t mono_push_ms;
+    uint32_t refreshes; // Pushes that changed the panel
+};
+
+// How a screen is composed: 4bpp grayscale, or 1bpp black and white that is expanded
+// to 4bpp on the panel task while it is pushed
+enum class FrameFormat : uint8_t
+{
+    GRAY4,
+    MONO1
+};
 
 class DisplayManager
 {
 public:
     DisplayManager();
-    void init();
+    // keep_panel skips the initial clear, e.g. after deep sleep where the panel still shows the last frame
+    void init(bool keep_panel = false);
+    // Format for the screens drawn from the next clear() on; stays gray when the 1bpp buffers can't be had
+    void setFrameFormat(FrameFormat format);
+    // Bytes of compose buffer a screen of this format draws into
+    static size_t composeBytes(FrameFormat format);
     void clear();
     void startStationDisplay(const char *station_name);
-    bool displayDeparture(const String &line, const String &destination, const String &time_to_departure);
+    bool displayDeparture(const char *line, const char *destination, long minutes);
+    // Every station on one screen: a header row per station with its departure rows below, in a smaller font
+    void startDashboard();
+    // False when there is no room left for the header and a row under it
+    bool addSection(const char *station_name);
+    // Row the next header or departure goes into, and how many more fit; updateDepartureMinutes() takes the former
+    size_t currentRow() const { return (current_y - rows.top) / rows.height; }
+    size_t rowsLeft() const;
+    void updateDepartureMinutes(size_t row, long minutes);
+    // Font of the departure rows on station screens, the largest the departures are drawn in
+    const GFXfont *stationFont() const { return FONT_LARGE; }
+    // Hands the frame to the panel task and returns without waiting for the waveform
+    void commit();
+    // True while a handed-off frame has not fully reached the panel
+    bool isBusy() const;
+    // Waits until every handed-off frame is on the panel
+    void flush();
+    // Takes what was drawn since the last commit as already on the panel, without pushing it
+    void adoptFrame();
+    // Drawing between these goes to the back buffer, so the next screen can be composed while
+    // the current one still gets its updates; false when there is no memory for a back buffer
+    bool beginBackFrame();
+    void endBackFrame();
+    // Swaps the composed back frame in and commits it; false when none is waiting
+    bool presentBackFrame();
     void displaySleepMode();
     void displayConnecting();
     void displayBatteryStatus(const String &batteryStatus);
     void powerOn();
     void powerOff();
     bool isInitialized() const { return display_initialized; }
+    // Copies, as the panel task updates the stats while the caller reads them
+    CommitStats getCommitStats() const;
+    FrameStats getFrameStats() const;
+    const GlyphCacheStats &getGlyphCacheStats() const { return glyph_cache.getStats(); }
+    const TextLayoutStats &getLayoutStats() const { return text_layout.getStats(); }
 
 private:
     static const int STATION_Y = 100;
     static const int TOP_MARGIN = 200;
     static const int LINE_HEIGHT = 52;
+    // Columns: line label, destination and the minutes, which are right-aligned to TIME_RIGHT
     static const int LINE_X = 50;
     static const int DEST_X = 180;
-    static const int TIME_X = 800;
+    static const int TIME_X = 760;
+    static const int TIME_RIGHT = EPD_WIDTH - LINE_X;
+    static const int COLUMN_GAP = 20;
+    // Dashboard grid; a row clears the glyph box of the small font, so minute updates never touch a header rule
+    static const int DASHBOARD_TOP = 40;
+    static const int DASHBOARD_LINE_HEIGHT = 44;
 
+    // Extra pixels around measured text so glyph overhangs stay inside the dirty area
+    static const int DIRTY_MARGIN = 4;
+    // Diff granularity; a tile row is 16 aligned bytes
+    static const int TILE_WIDTH = 32;
+    static const int TILE_HEIGHT = 32;
+    // Partial refreshes slowly build up ghosting, so force a full clear every N of them
+    static const int FULL_REFRESH_INTERVAL = 20;
+    // One frame being drawn, one being pushed and one waiting in between
+    static const int FRAME_COUNT = 3;
+    // Set in the handoff slot until the panel task takes the frame
+    static const uint8_t FRAME_NEW = 0x80;
+    static const uint32_t PANEL_TASK_STACK = 4096;
+    static const UBaseType_t PANEL_TASK_PRIORITY = 1;
+    static const uint32_t FLUSH_POLL_MS = 10;
+
+    // Font and grid of the departure rows on the screen being drawn
+    struct RowLayout
+    {
+        const GFXfont *font;
+        int top;
+        int height;
+    };
+
+    int rowY(size_t row) const { return rows.top + row * rows.height; }
+    void drawMinutes(int y, long minutes);
+    // Laid out into the render list; it is drawn in one pass before the frame is handed off
+    void addText(const GFXfont *font, const char *text, int32_t x, int32_t y, int32_t width,
+                 TextLayout::Align align = TextLayout::Align::LEFT);
+    void addFill(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t color);
+    void render();
+    void drawText(const GFXfont *font, const char *text, int32_t x, int32_t y);
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t color);
+    void markDirty(int32_t x, int32_t y, int32_t w, int32_t h);
+    void swapBuffers();
+    void catchUp(int frame, int source);
+    void handMono(int frame);
+
+    static void panelTask(void *parameter);
+    void pushFrame(const uint8_t *frame, FrameFormat format, Rect_t area, uint32_t compose_us);
+    void refreshChangedTiles(const uint8_t *frame, FrameFormat format, Rect_t area);
+    bool tileChanged(const uint8_t *frame, FrameFormat format, int tile_x, int tile_y);
+    void pushArea(const uint8_t *frame, FrameFormat format, Rect_t area, bool clear_first);
+
+    // Drawing side: framebuffer is frames[draw_frame], or the back buffer while a back frame is drawn.
+    // A MONO1 screen is drawn into mono_buffer instead and copied into the frame when it is handed off.
     uint8_t *framebuffer;
+    FrameFormat format;
+    FrameFormat next_format;
+    uint8_t *mono_buffer;
+    uint8_t *frames[FRAME_COUNT];
+    FrameFormat frame_formats[FRAME_COUNT];
+    // Per frame, the area to diff once it is handed off, and what it missed while others were drawn
+    Rect_t frame_areas[FRAME_COUNT];
+    uint32_t frame_compose_us[FRAME_COUNT];
+    Rect_t stale_areas[FRAME_COUNT];
+    bool frame_stale[FRAME_COUNT];
+    int draw_frame;
+    Rect_t handed_area;
+    uint32_t compose_us;
+    // Index of the latest finished frame, swapped atomically by both sides
+    std::atomic<uint8_t> handoff;
+    // Panel side
+    int push_frame;
+    std::atomic<bool> panel_busy;
+    SemaphoreHandle_t panel_wake;
+    // Counted while a frame is pushed, and published to commit_stats once it is done
+    CommitStats push_stats;
+    // Next screen, with its own drawing state; swapped with the front while it is drawn into
+    uint8_t *back_buffer;
+    FrameFormat back_format;
+    uint8_t *back_mono;
+    Rect_t back_dirty_area;
+    bool back_has_dirty;
+    int back_y;
+    RowLayout back_rows;
+    bool back_ready;
+    // Copy of what is currently shown on the panel, used to diff the next frame
+    uint8_t *committed;
+    uint8_t *push_buffer;
     int current_y;
+    RowLayout rows;
     bool display_initialized;
 
+    // Union of everything drawn since the last commit
+    Rect_t dirty_area;
+    bool has_dirty;
+    int partial_updates;
+    // Written by the drawing side and the panel task, so only touched under stats_lock
+    SemaphoreHandle_t stats_lock;
+    CommitStats commit_stats;
+    FrameStats frame_stats;
+
+    GlyphCache glyph_cache;
+    TextLayout text_layout;
+    // Pending drawing of the front and back screens; swapped along with them
+    RenderList render_lists[2];
+    RenderList *render_list;
+    RenderList *back_render_list;
+
     const GFXfont *FONT_LARGE;
     const GFXfont *FONT_SMALL;
     FontProperties font_props;
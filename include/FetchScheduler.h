@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+#include "DepartureTable.h"
+
+// Fetch counts of live mode, to compare against refetching every station each minute
+struct FetchRates
+{
+    uint32_t cycles;
+    uint32_t requests;
+    uint32_t radio_ms;
+    uint32_t live_s;
+    uint32_t full_cycles; // Cycles that fetched every station
+    uint32_t full_radio_ms;
+    uint32_t refreshes; // Panel refreshes
+    // Over roughly the last hour of live mode, older cycles fade out exponentially
+    float requests_per_hour;
+    float radio_s_per_hour;
+    float refreshes_per_hour;
+};
+
+// Picks a fetch interval per station from its soonest departure and from how far
+// realtime departures have strayed from the timetable in recent responses. A station
+// with a train leaving soon or with volatile delays is refetched often, one with
+// nothing leaving soon backs off. The plan is kept in RTC memory so it carries
+// across deep sleep in live mode. A request budget per hour caps what the
+// plan can cost: once it is spent, fetches wait until it has refilled.
+class FetchScheduler
+{
+public:
+    static const time_t MIN_INTERVAL = 60;
+    static const time_t MAX_INTERVAL = 900;
+
+    FetchScheduler();
+
+    // Makes every station due, e.g. when live mode is entered
+    void startLive(time_t now);
+    // Most requests an hour of live mode may make, 0 for no limit; kept across deep sleep
+    void setRequestBudget(uint32_t requests_per_hour, time_t now);
+    // Stations due now, plus those due shortly after so they share the connection
+    uint32_t dueStations(size_t station_count, time_t now) const;
+    // When the next station is due, or later when the request budget is spent
+    time_t nextFetchTime(size_t station_count) const;
+    // Plans the next fetch of a station from the response it just got, or retries soon when there was none
+    void planStation(size_t station, const DepartureTable &table, bool updated, uint16_t mean_delay_s, time_t now);
+    void recordCycle(uint32_t requests, uint32_t radio_ms, bool all_stations, time_t now);
+    void recordRefreshes(uint32_t refreshes);
+
+    time_t interval(size_t station) const;
+    uint16_t volatility(size_t station) const;
+    FetchRates getRates() const;
+
+private:
+    // The soonest departure is fetched again about halfway to it
+    static const time_t SOONEST_DIVISOR = 2;
+    // A mean delay of this many seconds halves the interval
+    static const uint32_t VOLATILITY_SCALE = 120;
+    // Refetch before a station has fewer departures left to count down
+    static const size_t MIN_UPCOMING_DEPARTURES = 3;
+    // Stations due within this window are fetched on the same connection
+    static const time_t COALESCE_WINDOW = 30;
+    // Time constant of the rates; a cycle an hour old counts for 1/e of a new one
+    static const time_t RATE_DECAY_S = 3600;
+    // The budget can be saved up for this long, so a few fetches close together are not held back
+    static const time_t BUDGET_BURST_S = 300;
+
+    float budgetTokens(time_t now) const;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include <epd_driver.h>
+
+// Inner loops over the 4bpp framebuffer (two pixels per byte, the left one in
+// the low nibble): whole runs of bytes instead of the driver's pixel at a time,
+// with the two edge nibbles of a row handled on their own. Plain C on every
+// target; memset() and memcmp() of the C library do the wide loops.
+namespace FrameKernels
+{
+    // Framebuffers are allocated with this alignment, so every tile row starts on a word
+    // boundary and memset()/memcmp() take their word-wide loops
+    static const size_t FRAME_ALIGNMENT = 16;
+
+    void fill(uint8_t *dst, uint8_t value, size_t length);
+    // Same pixels as epd_fill_rect(), clipped to the panel the same way
+    void fillRect(uint8_t *framebuffer, int32_t x, int32_t y, int32_t width, int32_t height, uint8_t color);
+    // dst = (dst & ~mask) | pixels, for glyph rows that carry a mask of the nibbles they cover
+    void blitMasked(uint8_t *dst, const uint8_t *pixels, const uint8_t *mask, size_t length);
+    // Compares width bytes of rows rows, stride bytes apart
+    bool equalRect(const uint8_t *a, const uint8_t *b, size_t width, size_t rows, size_t stride);
+
+    // 1bpp frames: one bit per pixel, the leftmost in the high bit, set for black
+    static const size_t MONO_ROW_BYTES = EPD_WIDTH / 8;
+    void fillRectMono(uint8_t *frame, int32_t x, int32_t y, int32_t width, int32_t height, bool black);
+    // Writes 4 bytes of 4bpp black or white per source byte
+    void expandMono(uint8_t *dst, const uint8_t *src, size_t length);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <epd_driver.h>
+
+struct GlyphCacheStats
+{
+    uint32_t glyph_hits;
+    uint32_t glyph_misses;
+    uint32_t run_hits;
+    uint32_t run_misses;
+    uint32_t uncached;      // Glyphs or strings drawn by the driver, e.g. off screen or out of cache space
+    uint32_t glyph_flushes; // Times the glyph table filled up and started over
+    uint32_t arena_used;    // Bytes of cached glyph rows
+    uint32_t run_bytes;     // Bytes of cached string runs
+};
+
+// Text drawing that decodes each glyph only once. Glyphs are rasterized by the
+// EPD driver into a scratch strip, once against a black and once against a white
+// background; pixels that come out the same both times are the ones the driver
+// writes, so the cached rows plus that mask reproduce its output exactly,
+// compressed fonts included. Rows are kept per nibble phase of the start column,
+// so a blit is whole bytes. Short strings that come back every minute, like line
+// labels and "5 min", are also cached as whole runs.
+class GlyphCache
+{
+public:
+    static const size_t GLYPH_SLOTS = 512;
+    static const size_t GLYPH_ARENA_SIZE = 128 * 1024;
+    static const size_t RUN_SLOTS = 48;
+    static const size_t RUN_MAX_LENGTH = 15;
+    static const size_t RUN_BUDGET = 192 * 1024;
+
+    GlyphCache();
+    // Without the PSRAM for the cache every string goes straight to the driver
+    bool init();
+    bool isReady() const { return glyph_slots != nullptr; }
+    // Same result as write_string(); the cursor moves by the same advance
+    void drawText(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer);
+    // Into a 1bpp frame, anti-aliased edges thresholded at mid gray; needs init() to have succeeded
+    void drawTextMono(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *frame);
+    const GlyphCacheStats &getStats() const { return stats; }
+
+private:
+    // Scratch strip the driver draws into; the baseline sits at SCRATCH_BASELINE
+    static const int SCRATCH_ROWS = 128;
+    static const int SCRATCH_BASELINE = 80;
+    static const int SCRATCH_X = 64;
+    // Recent run misses, to tell strings that repeat from one-offs
+    static const size_t RUN_SEEN_SLOTS = 32;
+
+    // 4bpp rows, followed by a mask of the same size with 0xF for every nibble the driver writes
+    struct Bitmap
+    {
+        uint8_t *rows;
+        int16_t byte_offset; // First byte, relative to the byte of the cursor
+        int16_t top;         // First row, relative to the baseline
+        uint16_t stride;
+        uint16_t height;
+        int16_t advance;
+    };
+
+    struct GlyphSlot
+    {
+        const GFXfont *font;
+        uint32_t code_point;
+        uint8_t phase;
+        Bitmap bitmap;
+    };
+
+    struct RunSlot
+    {
+        const GFXfont *font;
+        uint8_t phase;
+        char text[RUN_MAX_LENGTH + 1];
+        uint32_t last_used;
+        Bitmap bitmap;
+    };
+
+    static bool measure(const GFXfont *font, const char *text, int phase, Bitmap &bitmap);
+    static bool fits(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y);
+    static void blit(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y, uint8_t *framebuffer);
+    static void blitMono(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y, uint8_t *frame);
+    void render(const GFXfont *font, const char *text, int phase, Bitmap &bitmap);
+
+    const Bitmap *findGlyph(const GFXfont *font, uint32_t code_point, int phase);
+    void resetGlyphs();
+    const Bitmap *findRun(const GFXfont *font, const char *text, int phase);
+    void drawGlyphs(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer);
+    void drawUncached(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer);
+
+    uint8_t *scratch[2];
+    GlyphSlot *glyph_slots;
+    uint8_t *arena;
+    size_t arena_used;
+    RunSlot *run_slots;
+    uint32_t run_clock;
+    uint32_t run_seen[RUN_SEEN_SLOTS];
+    size_t run_seen_next;
+    GlyphCacheStats stats;
+};
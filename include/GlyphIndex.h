@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+#include <epd_driver.h>
+
+// Glyph lookup without the driver's linear walk over a font's Unicode intervals.
+// ASCII and Latin-1, which cover the German station and destination names, index
+// a table per font directly; other code points are found by binary search.
+namespace GlyphIndex
+{
+    // Code points below this are looked up in the direct table
+    static const uint32_t DIRECT_LIMIT = 0x100;
+    static const size_t MAX_FONTS = 4;
+
+    // Builds the direct table of a font; done before the tasks start, so lookups only read.
+    // False when all tables are taken, lookups in the font then always search
+    bool add(const GFXfont *font);
+    // Same glyph as get_glyph(), or nullptr when the font has none
+    GFXglyph *find(const GFXfont *font, uint32_t code_point);
+    // True when the font has a glyph for every code point of text
+    bool covers(const GFXfont *font, const char *text);
+    // Copies text as UTF-8 the font can draw: malformed bytes are dropped, and a code point
+    // the font lacks is spelled with the nearest characters it has (ue for u-umlaut), or
+    // dropped too. Without a font only malformed bytes go. Stops at a code point when out is full
+    void normalize(const GFXfont *font, const char *text, char *out, size_t size);
+}
@@ -3,19 +3,27 @@
 #include <Arduino.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
-#include <list>
+#include <epd_driver.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "DepartureTable.h"
+#include "TLSSessionClient.h"
+#include "TimeKeeper.h"
 
-struct Departure
+struct FetchStats
 {
-    String line;
-    String destination;
-    String time_to_departure;
-};
-
-struct Station
-{
-    String station_name;
-    std::list<Departure> departure_list;
+    uint32_t requests;
+    uint32_t handshakes;
+    uint32_t resumed_handshakes;
+    uint32_t last_request_ms;
+    uint32_t total_request_ms;
+    // deserializeJson() of the filtered responses
+    uint32_t total_parse_us;
+    // Whole fetchDepartures() calls, percentiles over the last CYCLE_HISTORY of them
+    uint32_t last_cycle_ms;
+    uint32_t cycle_p50_ms;
+    uint32_t cycle_p95_ms;
 };
 
 struct Config
@@ -29,19 +37,94 @@ struct Config
 class MVGClient
 {
 public:
-    MVGClient();
-    void fetchDepartures();
-    const std::list<Station> &getStationList() const { return station_list; }
+    static const uint32_t ALL_STATIONS = UINT32_MAX;
+    // Each request in flight holds its own TLS connection, roughly 40 KB of heap during the handshake
+    static const size_t MAX_IN_FLIGHT = 3;
+    // How long the server keeps an idle connection open (the nginx default); a longer gap reconnects anyway
+    static const uint32_t KEEP_ALIVE_IDLE_MS = 75000;
+
+    // Up to max_in_flight requests of a fetch run at once, on worker tasks next to the caller
+    explicit MVGClient(TimeKeeper &time_keeper, size_t max_in_flight = 1);
+
+    // Refetches the stations in station_mask, the others keep their departures
+    void fetchDepartures(uint32_t station_mask = ALL_STATIONS);
+    // Names and destinations are reduced to what this font draws as each response is parsed, the
+    // richest font they are shown in; without one only malformed UTF-8 is dropped
+    void setTextFont(const GFXfont *font) { text_font = font; }
+    // Seeds the table, e.g. from the snapshot kept across deep sleep
+    void restoreStations(const DepartureTable &table) { station_table = table; }
+    // Drops the kept-alive connections, e.g. before WiFi goes down
+    void closeConnection();
+    size_t getRequestCount() const { return request_group_count; }
+    // Stations the last fetchDepartures() got a response for
+    uint32_t getUpdatedMask() const { return updated_mask; }
+    // Mean difference between realtime and planned departure of a station's last response, in seconds
+    uint16_t getMeanDelay(size_t station) const { return station_delays[station]; }
+    const FetchStats &getFetchStats() const { return fetch_stats; }
+    const DepartureTable &getStationList() const { return station_table; }
 
 private:
     static constexpr const char *MVG_BASE_URL = "https://www.mvg.de/api/bgw-pt/v3";
     static constexpr const char *MVG_DEPARTURE_ENDPOINT = "/departures";
-    static constexpr size_t MAX_JSON_DOCUMENT = 16384;
+    // Only the filtered fields of each departure are kept, so the document
+    // stays small even though the raw response is several kilobytes
+    static constexpr size_t MAX_JSON_DOCUMENT = 6144;
+    static constexpr size_t MAX_JSON_FILTER = 192;
+    static const char *RESPONSE_HEADERS[];
+    static const size_t DEPARTURES_PER_STATION = 5;
+    // A shared request asks for extra departures so every transport type still gets its share
+    static const size_t COALESCED_LIMIT_FACTOR = 2;
+    static const size_t MAX_REQUEST_LIMIT = 30;
+    static const size_t CYCLE_HISTORY = 32;
+    static const uint32_t WORKER_TASK_STACK = 12288;
+
+    // One HTTP request serving every config with the same station and time offset
+    struct RequestGroup
+    {
+        const Config *first;
+        String transport_types; // Union of the configs, empty when one of them wants all types
+        uint32_t config_mask;
+        size_t config_count;
+    };
+
+    // A connection to www.mvg.de kept alive across fetch cycles, with the document its responses are parsed into
+    struct Connection
+    {
+        MVGClient *owner;
+        TLSSessionClient secure_client;
+        HTTPClient http;
+        StaticJsonDocument<MAX_JSON_DOCUMENT> doc;
+    };
+
+    void planRequests();
+    void startWorkers();
+    static void workerTask(void *parameter);
+    void runRequestGroup(Connection &connection, size_t group_index);
+    String constructUrl(const RequestGroup &group);
+    bool makeRequest(Connection &connection, const String &url);
+    void appendToStationList(size_t station, const Config &config, JsonDocument &doc);
+    void recordCycle(uint32_t cycle_ms);
+
+    TimeKeeper &time_keeper;
+    const GFXfont *text_font;
 
-    String constructUrl(const Config &config);
-    String makeRequest(const String &url);
-    void appendToStationList(const char *station_name);
+    // connections[0] belongs to the task calling fetchDepartures(), the others to one worker task each
+    Connection connections[MAX_IN_FLIGHT];
+    size_t max_in_flight;
+    size_t worker_count;
+    QueueHandle_t job_queue;  // Request group indices waiting for a connection
+    QueueHandle_t done_queue; // Groups the workers finished
+    // Guards everything below that the workers write
+    SemaphoreHandle_t results_lock;
+    FetchStats fetch_stats;
+    uint32_t cycle_history[CYCLE_HISTORY];
+    size_t cycle_count;
 
-    StaticJsonDocument<MAX_JSON_DOCUMENT> doc;
-    std::list<Station> station_list;
+    StaticJsonDocument<MAX_JSON_FILTER> filter;
+    // Each station writes its own preallocated slot, so concurrent responses never reallocate
+    DepartureTable station_table;
+    RequestGroup request_groups[DepartureTable::MAX_STATIONS];
+    size_t request_group_count;
+    uint32_t updated_mask;
+    uint16_t station_delays[DepartureTable::MAX_STATIONS];
 };
\ No newline at end of file
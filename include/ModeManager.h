@@ -1,7 +1,10 @@
 #pragma once
 
-#include <Button2.h>
 #include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/timers.h>
+#include "utilities.h"
 
 enum class DisplayMode
 {
@@ -14,24 +17,56 @@ class ModeManager
 public:
     ModeManager();
     void init();
-    void update();
+    // Waits up to timeout for a button press and applies it, then checks the live mode timeout
+    void update(TickType_t timeout = 0);
+    // Makes a blocked update() return so it re-checks the live mode timeout
+    void wake();
+    // How long update() may block before the live mode timeout has to be checked
+    TickType_t ticksUntilTimeout() const;
+    // True between a button interrupt and the debounce timer reading the pin
+    bool isDebouncing() const;
+    // A held button would end a deep sleep right away
+    bool isButtonHeld() const;
     DisplayMode getCurrentMode() const { return currentMode; }
     bool shouldEnterSleep() const { return sleepRequested; }
     void enterSleepMode();
     void enterLiveMode();
+    // Continues a live mode from before deep sleep with the time it had left
+    void resumeLiveMode(unsigned long remaining_ms);
+    // Lets the buttons end a deep sleep
+    void armDeepSleepWakeup();
 
 private:
-    Button2 btn1;
 #if defined(CONFIG_IDF_TARGET_ESP32)
-    Button2 btn2;
-    Button2 btn3;
+    static const size_t BUTTON_COUNT = 3;
+#else
+    static const size_t BUTTON_COUNT = 1;
 #endif
+    static const uint32_t DEBOUNCE_MS = 25;
+    static const UBaseType_t EVENT_QUEUE_LENGTH = 8;
+    static const uint8_t NO_BUTTON = 0xFF;
+
+    struct ButtonEvent
+    {
+        uint8_t button;
+        int64_t interrupt_us; // When the first edge of the press came in
+    };
+
+    uint8_t buttonPins[BUTTON_COUNT];
+    // Debounced state, only touched by the timer callback
+    bool buttonPressed[BUTTON_COUNT];
+    volatile int64_t firstEdgeUs[BUTTON_COUNT];
+
+    QueueHandle_t eventQueue;
+    TimerHandle_t debounceTimer;
 
     DisplayMode currentMode;
     bool sleepRequested;
     unsigned long lastInteraction;
     static const unsigned long LIVE_MODE_TIMEOUT = 300000; // 5 minutes
 
-    static void onButtonPressed(Button2 &btn);
+    static void IRAM_ATTR onButtonInterrupt(void *arg);
+    static void onDebounceTimer(TimerHandle_t timer);
+    void armButton(size_t button);
     void handleButtonPress();
 };
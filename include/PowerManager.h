@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Time spent in each power state, used to estimate the energy drawn
+struct PowerStats
+{
+    uint32_t active_ms;      // Some task was doing work
+    uint32_t idle_radio_ms;  // CPU idle, WiFi associated in modem sleep
+    uint32_t idle_ms;        // CPU idle, WiFi off
+    uint32_t light_sleep_ms; // Explicit light sleep
+    uint32_t light_sleeps;
+};
+
+// Decides when the chip may light sleep. Tasks report their next deadline
+// and bracket their work, and the power task sleeps until the earliest
+// deadline whenever nothing is running, with the buttons as a second
+// wakeup source. Long enough idle windows can be handed to a deep sleep
+// handler instead.
+class PowerManager
+{
+public:
+    enum Deadline
+    {
+        FETCH,
+        RENDER,
+        MODE_TIMEOUT,
+        DEADLINE_COUNT
+    };
+    static const unsigned long NO_DEADLINE = 0;
+
+    PowerManager();
+    // Enables automatic light sleep where the sdkconfig supports it and starts the power task
+    void init();
+    // True when the idle task sleeps by itself and WiFi can stay associated in between
+    bool hasAutomaticLightSleep() const { return automatic_light_sleep; }
+
+    void setDeadline(Deadline deadline, unsigned long at_ms);
+    // Milliseconds until the deadline, or -1 when it is not set
+    long timeUntil(Deadline deadline) const;
+    void beginWork();
+    void endWork();
+    void setRadioOn(bool on);
+    // Called after an explicit light sleep, which FreeRTOS tick timeouts do not account for
+    void setWakeCallback(void (*callback)()) { wake_callback = callback; }
+    // Keeps the chip awake while it returns true, for work that no task has a deadline for
+    void setSleepBlocker(bool (*blocker)()) { sleep_blocker = blocker; }
+    // Offered idle windows of at least MIN_DEEP_SLEEP_MS; returns only if it declines
+    void setDeepSleepHandler(void (*handler)(unsigned long window_ms)) { deep_sleep_handler = handler; }
+
+    const PowerStats &getStats() const { return stats; }
+
+private:
+    // Shorter windows are not worth the sleep entry and exit overhead
+    static const unsigned long MIN_LIGHT_SLEEP_MS = 200;
+    // A wake from deep sleep costs a boot and a display init, roughly half a second awake
+    static const unsigned long MIN_DEEP_SLEEP_MS = 20000;
+    // Gives the owner of a deadline that just passed time to move it
+    static const unsigned long MIN_IDLE_WAIT_MS = 10;
+    static const unsigned long ENERGY_REPORT_INTERVAL = 60000;
+    static const uint32_t POWER_TASK_STACK = 3072;
+    // Rough ESP32-S3 supply currents in mA for the energy estimate
+    static constexpr float ACTIVE_MA = 100.0f;
+    static constexpr float IDLE_RADIO_MA = 25.0f;
+    static constexpr float IDLE_RADIO_AUTO_SLEEP_MA = 3.0f;
+    static constexpr float IDLE_MA = 15.0f;
+    static constexpr float LIGHT_SLEEP_MA = 0.3f;
+    static constexpr float SUPPLY_VOLTAGE = 3.3f;
+
+    static void powerTask(void *parameter);
+    void runIdle();
+    void account();
+    void reportEnergy();
+
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t changed;
+    void (*wake_callback)();
+    bool (*sleep_blocker)();
+    void (*deep_sleep_handler)(unsigned long window_ms);
+    bool automatic_light_sleep;
+
+    unsigned long deadlines[DEADLINE_COUNT];
+    int busy_count;
+    bool radio_on;
+
+    // Accounting of the state the system is in since last_account_ms
+    unsigned long last_account_ms;
+    PowerStats stats;
+    PowerStats reported;
+    unsigned long last_report_ms;
+};
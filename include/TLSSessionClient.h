@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#ifdef NATIVE_HAL
+
+#include <WiFiClientSecure.h>
+
+// Runs the session offer and resume detection against the TLS stand-in of
+// NativeHAL; the requests themselves are answered by the HTTPClient shim
+class TLSSessionClient : public WiFiClientSecure
+{
+public:
+    TLSSessionClient();
+
+    int connect(const char *host, uint16_t port) override;
+
+    bool sessionResumed() const { return resumed; }
+
+private:
+    bool resumed;
+};
+
+#else
+
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+
+// TLS client that offers the last saved session on connect, so a wake from
+// deep sleep can resume instead of running a full handshake. The session is
+// kept in RTC slow memory, or in NVS when it does not fit there.
+// Like HTTPClient::begin(url) without a CA, the server certificate is not verified.
+class TLSSessionClient : public WiFiClient
+{
+public:
+    TLSSessionClient();
+    ~TLSSessionClient();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(const char *host, uint16_t port, int32_t timeout) override;
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() { return connected(); }
+
+    bool sessionResumed() const { return resumed; }
+
+private:
+    static const int DEFAULT_TIMEOUT_MS = 10000;
+
+    bool seed();
+    void offerSavedSession(const char *host);
+    void saveSession(const char *host);
+    int readRecord(uint8_t *buf, size_t size);
+
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+
+    bool seeded;
+    bool active;
+    bool resumed;
+    bool first_byte_logged;
+    bool offered;
+    uint8_t offered_master[48];
+    int peeked;
+    unsigned long connect_start;
+};
+
+#endif
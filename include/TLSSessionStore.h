@@ -0,0 +1,24 @@
+#pragma once
+
+#include <Arduino.h>
+
+// The last TLS session, kept across deep sleep in RTC slow memory, and in NVS
+// when it does not fit there; NVS also outlives a power cycle. Clients on
+// parallel fetch tasks share it, so it is only used between lock() and unlock().
+namespace TLSSessionStore
+{
+    // Fits a session ticket plus the kept peer certificate of www.mvg.de
+    static const size_t SCRATCH_SIZE = 4000;
+
+    // Call before any task runs, e.g. from a client's constructor
+    void init();
+    void lock();
+    void unlock();
+
+    // Finds the session saved for host; data stays valid until unlock(). Returns its length, 0 when there is none
+    size_t find(const char *host, const uint8_t **data, const char **source);
+    // Space to serialize a session into before save()
+    uint8_t *scratch();
+    // Keeps the session of the last handshake; a resumed one is not written to NVS again
+    void save(const char *host, const uint8_t *data, size_t length, bool resumed);
+}
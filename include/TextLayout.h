@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+#include <epd_driver.h>
+
+struct TextLayoutStats
+{
+    uint32_t fit_hits;
+    uint32_t fit_misses;
+    uint32_t truncated; // Strings that needed an ellipsis, counted when first fitted
+};
+
+// What a screen draws, in order: text at a baseline origin, or filled rectangles.
+// Text is copied in, so the strings the list was built from can go away before it is drawn.
+class RenderList
+{
+public:
+    static const size_t MAX_ITEMS = 64;
+    static const size_t TEXT_SIZE = 2048;
+
+    enum class Kind : uint8_t
+    {
+        TEXT,
+        FILL
+    };
+
+    struct Item
+    {
+        Kind kind;
+        uint8_t color; // FILL
+        const GFXfont *font;
+        int32_t x;
+        int32_t y;
+        int32_t width;  // FILL
+        int32_t height; // FILL
+        uint16_t text;  // Offset of the text, TEXT
+    };
+
+    RenderList() : count(0), text_used(0) {}
+    // False when the list is full
+    bool addText(const GFXfont *font, const char *text, size_t length, const char *suffix, int32_t x, int32_t y);
+    bool addFill(int32_t x, int32_t y, int32_t width, int32_t height, uint8_t color);
+    void clear()
+    {
+        count = 0;
+        text_used = 0;
+    }
+
+    size_t size() const { return count; }
+    const Item &item(size_t index) const { return items[index]; }
+    const char *text(const Item &item) const { return texts + item.text; }
+
+private:
+    Item items[MAX_ITEMS];
+    size_t count;
+    char texts[TEXT_SIZE];
+    size_t text_used;
+};
+
+// Places strings in columns. Widths come from the fonts' advance tables, the same
+// advances the driver moves its cursor by, and strings that overrun their column
+// are cut at a code point and end in an ellipsis. A string with characters the
+// font lacks is spelled with ones it has (ue for u-umlaut) first. A fitted string
+// is cached with its width and spelling, so the rows redrawn every minute are
+// laid out without measuring.
+class TextLayout
+{
+public:
+    enum class Align : uint8_t
+    {
+        LEFT,
+        RIGHT
+    };
+
+    static const size_t FIT_SLOTS = 256;
+    static const size_t MAX_TEXT_LENGTH = 63;
+
+    TextLayout();
+    // Without the PSRAM for the cache every string is measured each time it is placed
+    bool init();
+    // Cursor advance of the whole string
+    static int32_t measure(const GFXfont *font, const char *text);
+    // Adds text inside the column [x, x + width) with y as its baseline; false when the list is full
+    bool place(RenderList &list, const GFXfont *font, const char *text, int32_t x, int32_t y, int32_t width, Align align);
+    const TextLayoutStats &getStats() const { return stats; }
+
+private:
+    // Slots tried for a string before the least recently used one is replaced
+    static const size_t FIT_PROBES = 4;
+
+    struct Fit
+    {
+        uint16_t length;   // Bytes of the string that are kept
+        int16_t width;     // Including the ellipsis
+        bool ellipsis;
+        bool spelled;      // The kept bytes are of the spelled copy, not of the string
+    };
+
+    struct FitSlot
+    {
+        const GFXfont *font;
+        int32_t max_width;
+        uint32_t last_used;
+        char text[MAX_TEXT_LENGTH + 1];
+        // A spelling is never longer than what it replaces
+        char spelled[MAX_TEXT_LENGTH + 1];
+        Fit fit;
+    };
+
+    // Spells text into spelled first when the font lacks one of its characters
+    static Fit fit(const GFXfont *font, const char *text, int32_t max_width, char *spelled, size_t spelled_size);
+    static const char *ellipsis(const GFXfont *font);
+    // Sets drawn to the string the fit's bytes are of
+    const Fit &findFit(const GFXfont *font, const char *text, int32_t max_width, const char **drawn);
+
+    FitSlot *slots;
+    uint32_t clock;
+    Fit uncached;
+    // Spelling of a string too long for the slots, cut at this size
+    char uncached_spelled[4 * (MAX_TEXT_LENGTH + 1)];
+    TextLayoutStats stats;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+struct TimeStats
+{
+    uint32_t ntp_syncs;
+    uint32_t header_syncs;  // Date headers that set or confirmed the clock
+    uint32_t skipped_syncs; // Connects where the clock was still good enough
+    int32_t last_correction_ms;
+    int32_t max_correction_ms;
+    uint32_t drift_ppm;
+};
+
+// Keeps the wall clock across deep sleep, where the RTC timer keeps it
+// running, and only asks NTP again once the accumulated drift could
+// exceed the allowed error. Date headers of HTTP responses are used as
+// a free second source.
+class TimeKeeper
+{
+public:
+    explicit TimeKeeper(uint32_t max_error_ms);
+
+    bool isValid() const;
+    // Call once WiFi is up; starts a background NTP sync when one is due
+    void maintain();
+    void applyHttpDate(const String &date);
+    uint32_t estimatedErrorMs() const;
+    const TimeStats &getStats() const;
+
+private:
+    static constexpr const char *NTP_SERVER = "pool.ntp.org";
+    static const time_t MIN_VALID_TIME = 1700000000;
+    // Uncalibrated RC slow clock; replaced by the measured drift after the second NTP sync
+    static const uint32_t DEFAULT_DRIFT_PPM = 1000;
+    static const uint32_t MIN_DRIFT_PPM = 50;
+    static const time_t MIN_DRIFT_INTERVAL = 600;
+    // A Date header has one second resolution and is stamped before the response travels
+    static const uint32_t HEADER_UNCERTAINTY_MS = 2000;
+    static const uint32_t NTP_UNCERTAINTY_MS = 100;
+
+    static void onNtpSync(struct timeval *tv);
+    void recordSync(const char *source, int64_t correction_ms, uint32_t uncertainty_ms);
+    static int64_t wallClockMs();
+
+    static TimeKeeper *instance;
+
+    uint32_t max_error_ms;
+    volatile bool ntp_running;
+    volatile bool ntp_done;
+    // Wall clock and millis() when NTP was started, to measure the correction it applies
+    int64_t ntp_start_wall_ms;
+    unsigned long ntp_start_millis;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Utf8
+{
+    // Length of the strict UTF-8 sequence at s with its code point, or 0 with code point 0 when it is malformed
+    inline size_t decode(const uint8_t *s, uint32_t *code_point)
+    {
+        uint8_t lead = s[0];
+        size_t length;
+        if (lead < 0x80)
+        {
+            *code_point = lead;
+            return 1;
+        }
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            *code_point = lead & 0x1F;
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            *code_point = lead & 0x0F;
+            length = 3;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            *code_point = lead & 0x07;
+            length = 4;
+        }
+        else
+        {
+            *code_point = 0;
+            return 0;
+        }
+
+        for (size_t i = 1; i < length; i++)
+        {
+            if ((s[i] & 0xC0) != 0x80)
+            {
+                *code_point = 0;
+                return 0;
+            }
+            *code_point = (*code_point << 6) | (s[i] & 0x3F);
+        }
+        return length;
+    }
+}
@@ -9,15 +9,38 @@ struct Secret
     const char *password;
 };
 
+// Connect-phase timings, kept in RTC memory so they add up across deep sleep
+struct ConnectStats
+{
+    uint32_t fast_connects;
+    uint32_t scan_connects;
+    uint32_t failed_fast_connects;
+    uint32_t total_fast_ms;
+    uint32_t total_scan_ms;
+    uint32_t last_connect_ms;
+};
+
 class WiFiManager
 {
 public:
     WiFiManager();
     bool connect();
     void ensureConnection();
+    // Turns the radio off until the next connect()
+    void disconnect();
     bool isConnected() const { return WiFi.status() == WL_CONNECTED; }
+    const ConnectStats &getConnectStats() const;
 
 private:
+    static const uint32_t FAST_CONNECT_TIMEOUT = 3000;
+    static const uint32_t SCAN_CONNECT_TIMEOUT = 10000;
+    static const uint32_t CONNECT_POLL_INTERVAL = 50;
+
     bool setupWiFi();
+    // Joins the remembered access point with the remembered address, no scan and no DHCP
+    bool connectCached();
+    bool connectWithScan();
+    bool waitForConnection(uint32_t timeout);
+    void rememberConnection();
     void reconnect();
 };
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "Esp.h"
+
+// The emulated board is the T5 ePaper S3; sdkconfig.h provides this on the device
+#define CONFIG_IDF_TARGET_ESP32S3 1
+
+#define IRAM_ATTR
+// Collected in one section so emulated deep sleep can carry it over to the next boot
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR
+#define F(str) (str)
+#define _BV(bit) (1UL << (bit))
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint16_t analogRead(uint8_t pin);
+
+void *ps_malloc(size_t size);
+void *ps_calloc(size_t count, size_t size);
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override;
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// Provided by the sketch
+void setup();
+void loop();
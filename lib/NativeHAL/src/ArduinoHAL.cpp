@@ -0,0 +1,412 @@
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include "esp_heap_caps.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "freertos/kernel.h"
+#include "freertos/task.h"
+#include <chrono>
+#include <cstdio>
+#include <malloc.h>
+#include <map>
+#include <sys/time.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// Size of the internal heap reported by ESP.getHeapSize(), roughly what an S3 sketch has available
+static const uint32_t EMULATED_HEAP_SIZE = 320 * 1024;
+static const uint32_t EMULATED_PSRAM_SIZE = 8 * 1024 * 1024;
+
+static const auto start_time = std::chrono::steady_clock::now();
+static uint64_t virtual_offset_us = 0;
+static unsigned long boot_ms = 0;
+#ifndef PIO_UNIT_TESTING
+static char **program_argv = nullptr;
+#endif
+static unsigned long run_limit_ms = 0;
+static bool run_limit_loaded = false;
+static int64_t epoch_offset_us = 0;
+static bool epoch_loaded = false;
+static sntp_sync_time_cb_t sntp_callback = nullptr;
+static std::map<uint8_t, uint16_t> analog_values;
+static size_t psram_in_use = 0;
+static uint32_t min_free_heap = UINT32_MAX;
+
+static unsigned long envNumber(const char *name, unsigned long fallback)
+{
+    const char *value = getenv(name);
+    return value ? strtoul(value, nullptr, 10) : fallback;
+}
+
+static uint64_t elapsedMicros()
+{
+    auto real = std::chrono::steady_clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::microseconds>(real).count() + virtual_offset_us;
+}
+
+static void checkRunLimit()
+{
+    if (!run_limit_loaded)
+    {
+        run_limit_ms = envNumber("NATIVE_RUN_MS", 600000);
+        run_limit_loaded = true;
+    }
+    if (run_limit_ms && boot_ms + elapsedMicros() / 1000 >= run_limit_ms)
+    {
+        Serial.printf("[native] run limit of %lu ms reached\n", run_limit_ms);
+        Serial.flush();
+        exit(0);
+    }
+}
+
+unsigned long millis()
+{
+    return elapsedMicros() / 1000;
+}
+
+unsigned long micros()
+{
+    return elapsedMicros();
+}
+
+int64_t esp_timer_get_time()
+{
+    return elapsedMicros();
+}
+
+void delay(unsigned long ms)
+{
+    // Inside a task the other tasks get to run meanwhile
+    if (NativeKernel::active())
+    {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+        return;
+    }
+
+    // Emulated time only, so a minute of sketch time passes instantly
+    virtual_offset_us += (uint64_t)ms * 1000;
+    checkRunLimit();
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    virtual_offset_us += us;
+}
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+int digitalRead(uint8_t pin)
+{
+    return gpio_get_level(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+uint16_t analogRead(uint8_t pin)
+{
+    auto it = analog_values.find(pin);
+    if (it != analog_values.end())
+        return it->second;
+    return envNumber("NATIVE_BATTERY_ADC", 2400);
+}
+
+void *ps_malloc(size_t size)
+{
+    psram_in_use += size;
+    return malloc(size);
+}
+
+void *ps_calloc(size_t count, size_t size)
+{
+    psram_in_use += count * size;
+    return calloc(count, size);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? ps_malloc(size) : malloc(size);
+}
+
+// The host build links with --wrap=time/gettimeofday so the wall clock follows emulated time
+extern "C" time_t __real_time(time_t *t);
+extern "C" int __real_gettimeofday(struct timeval *tv, void *tz);
+
+static int64_t realMicros()
+{
+    struct timeval now;
+    __real_gettimeofday(&now, nullptr);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static int64_t epochOffsetMicros()
+{
+    if (!epoch_loaded)
+    {
+        // Fractional seconds are accepted, so a wake from deep sleep keeps sub-second time
+        const char *value = getenv("NATIVE_EPOCH");
+        if (value)
+        {
+            epoch_offset_us = (int64_t)(strtod(value, nullptr) * 1000000.0) - realMicros();
+        }
+        epoch_loaded = true;
+    }
+    return epoch_offset_us;
+}
+
+static int64_t wallClockMicros()
+{
+    return realMicros() + epochOffsetMicros() + (int64_t)virtual_offset_us;
+}
+
+extern "C" int __wrap_gettimeofday(struct timeval *tv, void *tz)
+{
+    if (tv)
+    {
+        int64_t usec = wallClockMicros();
+        tv->tv_sec = usec / 1000000;
+        tv->tv_usec = usec % 1000000;
+    }
+    return 0;
+}
+
+extern "C" int __wrap_settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    // Shift the emulated clock rather than the host's
+    if (tv)
+    {
+        epoch_offset_us += (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - wallClockMicros();
+    }
+    return 0;
+}
+
+extern "C" time_t __wrap_time(time_t *t)
+{
+    struct timeval now;
+    __wrap_gettimeofday(&now, nullptr);
+    if (t)
+        *t = now.tv_sec;
+    return now.tv_sec;
+}
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+    sntp_callback = callback;
+}
+
+void sntp_stop()
+{
+}
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2, const char *server3)
+{
+    if (sntp_callback)
+    {
+        struct timeval now;
+        __wrap_gettimeofday(&now, nullptr);
+        sntp_callback(&now);
+    }
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms)
+{
+    time_t now = __wrap_time(nullptr);
+    localtime_r(&now, info);
+    return true;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return EMULATED_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    struct mallinfo2 info = mallinfo2();
+    size_t used = info.uordblks > psram_in_use ? info.uordblks - psram_in_use : 0;
+    uint32_t free_heap = used < EMULATED_HEAP_SIZE ? EMULATED_HEAP_SIZE - used : 0;
+    min_free_heap = min(min_free_heap, free_heap);
+    return free_heap;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    getFreeHeap();
+    return min_free_heap;
+}
+
+uint32_t EspClass::getPsramSize()
+{
+    return EMULATED_PSRAM_SIZE;
+}
+
+uint32_t EspClass::getFreePsram()
+{
+    return psram_in_use < EMULATED_PSRAM_SIZE ? EMULATED_PSRAM_SIZE - psram_in_use : 0;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    // 240 MHz core clock
+    return (uint32_t)(elapsedMicros() * 240);
+}
+
+void EspClass::restart()
+{
+    Serial.println("[native] restart requested");
+    Serial.flush();
+    exit(0);
+}
+
+// RTC_DATA_ATTR variables, bounded by the linker
+extern "C" char __start_rtc_data[] __attribute__((weak));
+extern "C" char __stop_rtc_data[] __attribute__((weak));
+
+#ifndef PIO_UNIT_TESTING
+static String rtcFile()
+{
+    const char *path = getenv("NATIVE_RTC_FILE");
+    return path ? String(path) : String("/tmp/native_rtc_") + String((unsigned long)getpid()) + ".bin";
+}
+
+static void restoreRtcMemory()
+{
+    const char *path = getenv("NATIVE_RTC_FILE");
+    if (!path || !getenv("NATIVE_BOOT_MS") || !__start_rtc_data)
+        return;
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return;
+    size_t size = __stop_rtc_data - __start_rtc_data;
+    if (fread(__start_rtc_data, 1, size, file) != size)
+    {
+        Serial.println("[native] RTC memory file does not match this build, starting cold");
+        memset(__start_rtc_data, 0, size);
+    }
+    fclose(file);
+}
+#endif
+
+namespace NativeHAL
+{
+    void setAnalogValue(uint8_t pin, uint16_t value)
+    {
+        analog_values[pin] = value;
+    }
+
+    void setEpoch(time_t epoch)
+    {
+        epoch_offset_us = (int64_t)epoch * 1000000 - realMicros() - (int64_t)virtual_offset_us;
+        epoch_loaded = true;
+    }
+
+    void advanceMillis(unsigned long ms)
+    {
+        virtual_offset_us += (uint64_t)ms * 1000;
+        checkRunLimit();
+    }
+
+    void setRunLimit(unsigned long ms)
+    {
+        run_limit_ms = ms;
+        run_limit_loaded = true;
+    }
+
+    unsigned long bootMillis()
+    {
+        return boot_ms;
+    }
+
+    void deepSleepRestart(unsigned long wake_ms, int wakeup_cause)
+    {
+        checkRunLimit();
+        if (run_limit_ms && boot_ms + wake_ms >= run_limit_ms)
+        {
+            Serial.printf("[native] run limit of %lu ms reached during deep sleep\n", run_limit_ms);
+            Serial.flush();
+            exit(0);
+        }
+#ifdef PIO_UNIT_TESTING
+        // A test binary has no setup() to resume into
+        Serial.printf("[native] deep sleep for %lu ms ends the test run\n", wake_ms - millis());
+        Serial.flush();
+        exit(1);
+#else
+
+        String path = rtcFile();
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file && __start_rtc_data)
+        {
+            fwrite(__start_rtc_data, 1, __stop_rtc_data - __start_rtc_data, file);
+        }
+        if (file)
+        {
+            fclose(file);
+        }
+
+        // The RTC timer keeps the wall clock running through the sleep
+        unsigned long now = millis();
+        int64_t wake_epoch_us = wallClockMicros() + (int64_t)(wake_ms - now) * 1000;
+        char wake_epoch[32];
+        snprintf(wake_epoch, sizeof(wake_epoch), "%lld.%06lld",
+                 (long long)(wake_epoch_us / 1000000), (long long)(wake_epoch_us % 1000000));
+        setenv("NATIVE_EPOCH", wake_epoch, 1);
+        setenv("NATIVE_BOOT_MS", String(boot_ms + wake_ms).c_str(), 1);
+        setenv("NATIVE_WAKEUP_CAUSE", String(wakeup_cause).c_str(), 1);
+        setenv("NATIVE_RTC_FILE", path.c_str(), 1);
+
+        Serial.printf("[native] deep sleep for %lu ms\n", wake_ms - now);
+        Serial.flush();
+        execv("/proc/self/exe", program_argv);
+        Serial.println("[native] could not restart after deep sleep, exiting");
+        Serial.flush();
+        exit(1);
+#endif
+    }
+
+    void resetMinFreeHeap()
+    {
+        min_free_heap = UINT32_MAX;
+    }
+
+    uint32_t psramInUse()
+    {
+        return psram_in_use;
+    }
+}
+
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv)
+{
+    program_argv = argv;
+    boot_ms = envNumber("NATIVE_BOOT_MS", 0);
+    restoreRtcMemory();
+
+    setup();
+    for (;;)
+    {
+        loop();
+    }
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap figures are emulated from the host allocator, with ps_malloc'd memory
+// counted as PSRAM so the internal heap numbers stay comparable to the device
+class EspClass
+{
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+    uint32_t getPsramSize();
+    uint32_t getFreePsram();
+    uint32_t getCycleCount();
+    void restart();
+};
+
+extern EspClass ESP;
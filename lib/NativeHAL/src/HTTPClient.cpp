@@ -0,0 +1,209 @@
+#include "HTTPClient.h"
+#include "NativeHAL.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static NativeHAL::HttpResponder responder;
+static unsigned long delay_ms = 0;
+static unsigned long jitter_ms = 0;
+static bool delay_loaded = false;
+static uint32_t jitter_state = 12345;
+static uint32_t server_closes = 0;
+
+static unsigned long envMillis(const char *name)
+{
+    const char *value = getenv(name);
+    return value ? strtoul(value, nullptr, 10) : 0;
+}
+
+// Emulated server and network latency of one request
+static unsigned long responseDelay()
+{
+    if (!delay_loaded)
+    {
+        delay_ms = envMillis("NATIVE_HTTP_DELAY_MS");
+        jitter_ms = envMillis("NATIVE_HTTP_JITTER_MS");
+        delay_loaded = true;
+    }
+    if (!jitter_ms)
+        return delay_ms;
+
+    // Same sequence every run, so timings can be compared between builds
+    jitter_state = jitter_state * 1103515245 + 12345;
+    return delay_ms + (jitter_state >> 8) % (jitter_ms + 1);
+}
+
+namespace NativeHAL
+{
+    // Serves MVG_REPLAY_DIR/<globalId>.json, with ':' in the id replaced by '_'
+    int replayResponse(const String &url, String &body)
+    {
+        const char *dir = getenv("MVG_REPLAY_DIR");
+        if (!dir)
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+
+        int start = url.indexOf("globalId=");
+        if (start < 0)
+            return HTTP_CODE_NOT_FOUND;
+        start += strlen("globalId=");
+        int end = url.indexOf('&', start);
+        std::string id = url.substring(start, end < 0 ? url.length() : end).c_str();
+        for (char &c : id)
+        {
+            if (c == ':')
+                c = '_';
+        }
+
+        std::ifstream file(std::string(dir) + "/" + id + ".json", std::ios::binary);
+        if (!file)
+            return HTTP_CODE_NOT_FOUND;
+
+        std::stringstream content;
+        content << file.rdbuf();
+        body = String(content.str());
+        return HTTP_CODE_OK;
+    }
+
+    void setHttpResponder(HttpResponder handler)
+    {
+        responder = handler;
+    }
+
+    int respond(const String &url, String &body)
+    {
+        return responder ? responder(url, body) : replayResponse(url, body);
+    }
+
+    void setHttpDelay(unsigned long delay, unsigned long jitter)
+    {
+        delay_ms = delay;
+        jitter_ms = jitter;
+        delay_loaded = true;
+    }
+
+    void closeServerConnections()
+    {
+        server_closes++;
+    }
+
+    uint32_t serverCloseCount()
+    {
+        return server_closes;
+    }
+}
+
+bool HTTPClient::begin(const String &url)
+{
+    if (!own_client)
+        own_client.reset(new WiFiClient());
+    return begin(*own_client, url);
+}
+
+bool HTTPClient::begin(WiFiClient &client, const String &url)
+{
+    this->client = &client;
+    this->url = url;
+    size = -1;
+
+    int scheme_end = url.indexOf("://");
+    int host_start = scheme_end < 0 ? 0 : scheme_end + 3;
+    int host_end = url.indexOf('/', host_start);
+    host = url.substring(host_start, host_end < 0 ? url.length() : host_end);
+    port = url.startsWith("https") ? 443 : 80;
+    int colon = host.indexOf(':');
+    if (colon >= 0)
+    {
+        port = host.substring(colon + 1).toInt();
+        host = host.substring(0, colon);
+    }
+    return true;
+}
+
+void HTTPClient::end()
+{
+    if (client && !reuse)
+        client->stop();
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+    headers.clear();
+    for (size_t i = 0; i < headerKeysCount; i++)
+    {
+        headers[headerKeys[i]] = String();
+    }
+}
+
+String HTTPClient::header(const char *name)
+{
+    auto it = headers.find(name);
+    return it == headers.end() ? String() : it->second;
+}
+
+bool HTTPClient::hasHeader(const char *name)
+{
+    auto it = headers.find(name);
+    return it != headers.end() && !it->second.isEmpty();
+}
+
+int HTTPClient::GET()
+{
+    if (!client)
+        return HTTPC_ERROR_NOT_CONNECTED;
+
+    // Like the real client, a closed connection is opened again, so a TLS client runs its handshake
+    if (!client->connected() && !client->connect(host.c_str(), port))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    // Writing to a kept-alive connection the server has dropped fails
+    if (client->closedByServer())
+        return HTTPC_ERROR_CONNECTION_LOST;
+
+    // delay() blocks only this task, so requests of other tasks overlap with it
+    delay(responseDelay());
+
+    String body;
+    int code = NativeHAL::respond(url, body);
+    if (code > 0)
+    {
+        client->load(body);
+        size = body.length();
+
+        auto date = headers.find("Date");
+        if (date != headers.end())
+        {
+            char buffer[40];
+            time_t now = time(nullptr);
+            struct tm utc;
+            gmtime_r(&now, &utc);
+            strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+            date->second = buffer;
+        }
+    }
+    return code;
+}
+
+int HTTPClient::getSize()
+{
+    return size;
+}
+
+String HTTPClient::getString()
+{
+    String body;
+    while (client && client->available())
+    {
+        body += (char)client->read();
+    }
+    return body;
+}
+
+WiFiClient &HTTPClient::getStream()
+{
+    return *client;
+}
+
+bool HTTPClient::connected()
+{
+    return client && client->connected();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+#include <map>
+#include <memory>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+typedef enum
+{
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_NOT_FOUND = 404,
+    HTTP_CODE_INTERNAL_SERVER_ERROR = 500
+} t_http_codes;
+
+// Answers requests through NativeHAL::respond instead of the network
+class HTTPClient
+{
+public:
+    bool begin(const String &url);
+    bool begin(WiFiClient &client, const String &url);
+    void end();
+
+    void useHTTP10(bool usehttp10) {}
+    void setReuse(bool reuse) { this->reuse = reuse; }
+    void setTimeout(uint16_t timeout) {}
+    void setConnectTimeout(int32_t timeout) {}
+    void addHeader(const String &name, const String &value) {}
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+    String header(const char *name);
+    bool hasHeader(const char *name);
+
+    int GET();
+    int getSize();
+    String getString();
+    WiFiClient &getStream();
+    bool connected();
+
+private:
+    String url;
+    String host;
+    uint16_t port = 80;
+    WiFiClient *client = nullptr;
+    std::unique_ptr<WiFiClient> own_client;
+    std::map<std::string, String> headers;
+    bool reuse = false;
+    int size = -1;
+};
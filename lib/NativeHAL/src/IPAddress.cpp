@@ -0,0 +1,9 @@
+#include "IPAddress.h"
+#include <cstdio>
+
+String IPAddress::toString() const
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buffer);
+}
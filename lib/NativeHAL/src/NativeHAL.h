@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include "WString.h"
+
+// Controls for the host build, used by benchmarks and tests to script the hardware.
+// The defaults can also be set from the environment:
+//   NATIVE_EPOCH         wall clock at start, e.g. the time a response was recorded
+//   NATIVE_RUN_MS        stop the sketch after this much emulated time (default 600000),
+//                        counted across deep sleep wakes
+//   NATIVE_BATTERY_ADC   raw ADC value returned for the battery pin (default 2400)
+//   NATIVE_BUTTON_MS     comma separated press times for BUTTON_1 (default "1000")
+//   NATIVE_EPD_OUTPUT    PGM file the panel is written to (default "epd.pgm")
+//   NATIVE_EPD_WAVEFORM_MS time every clear or draw on the panel takes (default 0); other tasks run meanwhile
+//   MVG_REPLAY_DIR       directory of recorded /departures responses, one <globalId>.json each
+//   NATIVE_HTTP_DELAY_MS  round trip of every emulated request (default 0); other tasks run meanwhile
+//   NATIVE_HTTP_JITTER_MS uniformly distributed extra delay per request, from a fixed seed (default 0)
+//   NATIVE_TLS_SESSION_SIZE serialized size of a TLS session (default 1200)
+//   NATIVE_RTC_FILE      where RTC memory is kept across an emulated deep sleep (default in /tmp)
+// Deep sleep with a timer or button wakeup armed re-executes the program, with
+// RTC_DATA_ATTR variables restored and the clocks moved on to the wake time.
+namespace NativeHAL
+{
+    // Returns an HTTP status code and fills body, or a negative HTTPClient error
+    typedef std::function<int(const String &url, String &body)> HttpResponder;
+
+    void setHttpResponder(HttpResponder responder);
+    int respond(const String &url, String &body);
+    // What respond() serves without a responder: the recording in MVG_REPLAY_DIR
+    int replayResponse(const String &url, String &body);
+    // Overrides NATIVE_HTTP_DELAY_MS and NATIVE_HTTP_JITTER_MS
+    void setHttpDelay(unsigned long delay_ms, unsigned long jitter_ms);
+    // The server drops every open connection, as after its keep-alive timeout. Like on a
+    // socket, a client only notices when its next request fails
+    void closeServerConnections();
+    // How often the server dropped its connections; one opened before the last drop is dead
+    uint32_t serverCloseCount();
+
+    // TLS stand-in: every host shares one emulated server, which issues a session
+    // ticket on a full handshake and resumes it until the ticket key rotates
+    struct TlsSession
+    {
+        uint8_t master[48];
+        uint32_t ticket_key;
+    };
+
+    // Returns true when the offered session was resumed, otherwise session is a new one
+    bool tlsHandshake(const char *host, const TlsSession *offered, TlsSession &session);
+    // Serializes like mbedtls_ssl_session_save(); returns the length, 0 when it does not fit
+    size_t tlsSessionSave(const TlsSession &session, uint8_t *buffer, size_t size);
+    bool tlsSessionLoad(const uint8_t *buffer, size_t length, TlsSession &session);
+    // Tickets issued before are rejected from now on, as after a server restart
+    void rotateTlsTicketKey();
+    // Overrides NATIVE_TLS_SESSION_SIZE
+    void setTlsSessionSize(size_t size);
+
+    void setAnalogValue(uint8_t pin, uint16_t value);
+    void setEpoch(time_t epoch);
+    void advanceMillis(unsigned long ms);
+    void setRunLimit(unsigned long ms);
+    // Millis at which BUTTON_1 next changes level, or 0 when the script has no more presses
+    unsigned long nextButtonEdge(unsigned long now);
+    // Emulated time of the first boot at which the current boot started
+    unsigned long bootMillis();
+    // Boots again at wake_ms after the current boot started, keeping RTC memory
+    void deepSleepRestart(unsigned long wake_ms, int wakeup_cause) __attribute__((noreturn));
+
+    // Emulated internal heap accounting
+    void resetMinFreeHeap();
+    uint32_t psramInUse();
+}
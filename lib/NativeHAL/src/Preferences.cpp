@@ -0,0 +1,86 @@
+#include "Preferences.h"
+#include <map>
+
+static std::map<std::string, std::map<std::string, std::string>> namespaces;
+
+// NVS limits namespace and key names to 15 characters
+static const size_t MAX_KEY_LENGTH = 15;
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partition_label)
+{
+    if (started || strlen(name) > MAX_KEY_LENGTH)
+        return false;
+    // Like NVS, a read-only open of a namespace that was never written fails
+    if (readOnly && namespaces.find(name) == namespaces.end())
+        return false;
+
+    this->name = name;
+    read_only = readOnly;
+    started = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    started = false;
+}
+
+bool Preferences::clear()
+{
+    if (!started || read_only)
+        return false;
+    namespaces[name].clear();
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!started || read_only)
+        return false;
+    return namespaces[name].erase(key) > 0;
+}
+
+size_t Preferences::putString(const char *key, const char *value)
+{
+    return putBytes(key, value, strlen(value));
+}
+
+size_t Preferences::putString(const char *key, const String &value)
+{
+    return putString(key, value.c_str());
+}
+
+String Preferences::getString(const char *key, const String &defaultValue)
+{
+    if (!started)
+        return defaultValue;
+    auto &entries = namespaces[name];
+    auto it = entries.find(key);
+    return it == entries.end() ? defaultValue : String(it->second.c_str());
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+    if (!started || read_only || strlen(key) > MAX_KEY_LENGTH)
+        return 0;
+    namespaces[name][key].assign((const char *)value, len);
+    return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+    size_t length = getBytesLength(key);
+    if (!length || length > maxLen)
+        return 0;
+    memcpy(buf, namespaces[name][key].data(), length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    if (!started)
+        return 0;
+    auto &entries = namespaces[name];
+    auto it = entries.find(key);
+    return it == entries.end() ? 0 : it->second.size();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Arduino.h"
+#include <string>
+
+// NVS namespaces held in host memory for the life of the process, so unlike
+// on the device they do not outlive an emulated deep sleep
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false, const char *partition_label = nullptr);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+
+    size_t putString(const char *key, const char *value);
+    size_t putString(const char *key, const String &value);
+    String getString(const char *key, const String &defaultValue = String());
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+    size_t getBytesLength(const char *key);
+
+private:
+    std::string name;
+    bool read_only = false;
+    bool started = false;
+};
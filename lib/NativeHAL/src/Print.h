@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include "WString.h"
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+// Minimal Arduino Print, everything funnels through write()
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str);
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str) { return write(str.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(unsigned int number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(long number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(unsigned long number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(long long number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(unsigned long long number, int base = 10) { return print(String(number, (unsigned char)base)); }
+    size_t print(double number, int digits = 2) { return print(String(number, (unsigned int)digits)); }
+    size_t print(const Printable &printable) { return printable.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format)
+    {
+        size_t n = print(value, format);
+        return n + println();
+    }
+};
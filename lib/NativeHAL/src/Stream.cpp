@@ -0,0 +1,16 @@
+#include "Stream.h"
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    // Host streams are fully buffered, so there is nothing to wait for
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = read();
+        if (c < 0)
+            break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+protected:
+    unsigned long timeout = 1000;
+};
@@ -0,0 +1,134 @@
+#include "WString.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <cctype>
+
+static std::string formatInteger(unsigned long long number, bool negative, unsigned char base)
+{
+    if (base < 2 || base > 36)
+        base = 10;
+
+    char buffer[72];
+    char *end = buffer + sizeof(buffer) - 1;
+    char *ptr = end;
+    *ptr = '\0';
+    do
+    {
+        unsigned digit = number % base;
+        *--ptr = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        number /= base;
+    } while (number);
+
+    if (negative)
+        *--ptr = '-';
+    return std::string(ptr, end);
+}
+
+String::String(int number, unsigned char base) : String((long long)number, base) {}
+String::String(unsigned int number, unsigned char base) : String((unsigned long long)number, base) {}
+String::String(long number, unsigned char base) : String((long long)number, base) {}
+String::String(unsigned long number, unsigned char base) : String((unsigned long long)number, base) {}
+
+String::String(long long number, unsigned char base)
+{
+    // Like Arduino, only base 10 is printed with a sign
+    if (base == 10 && number < 0)
+        value = formatInteger(0ULL - (unsigned long long)number, true, base);
+    else
+        value = formatInteger((unsigned long long)number, false, base);
+}
+
+String::String(unsigned long long number, unsigned char base)
+    : value(formatInteger(number, false, base)) {}
+
+String::String(float number, unsigned int decimals) : String((double)number, decimals) {}
+
+String::String(double number, unsigned int decimals)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    value = buffer;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t pos = value.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char *str, unsigned int from) const
+{
+    size_t pos = value.find(str, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int begin, unsigned int end) const
+{
+    if (begin > end)
+    {
+        unsigned int tmp = begin;
+        begin = end;
+        end = tmp;
+    }
+    if (begin >= value.size())
+        return String();
+    if (end > value.size())
+        end = value.size();
+    return String(value.substr(begin, end - begin));
+}
+
+bool String::equalsIgnoreCase(const String &str) const
+{
+    return strcasecmp(value.c_str(), str.value.c_str()) == 0;
+}
+
+long String::toInt() const
+{
+    return strtol(value.c_str(), nullptr, 10);
+}
+
+void String::trim()
+{
+    size_t first = 0;
+    while (first < value.size() && isspace((unsigned char)value[first]))
+        first++;
+    size_t last = value.size();
+    while (last > first && isspace((unsigned char)value[last - 1]))
+        last--;
+    value = value.substr(first, last - first);
+}
+
+size_t String::strlen_(const char *str)
+{
+    return str ? strlen(str) : 0;
+}
+
+StringSumHelper operator+(const String &lhs, const String &rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const String &lhs, const char *rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const char *lhs, const String &rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+StringSumHelper operator+(const String &lhs, char rhs)
+{
+    StringSumHelper result(lhs);
+    result.concat(rhs);
+    return result;
+}
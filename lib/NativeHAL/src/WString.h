@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Subset of the Arduino String API used by the firmware, backed by std::string
+class String
+{
+public:
+    String() {}
+    String(const char *str) : value(str ? str : "") {}
+    String(const char *str, size_t length) : value(str, length) {}
+    String(const std::string &str) : value(str) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int number, unsigned char base = 10);
+    explicit String(unsigned int number, unsigned char base = 10);
+    explicit String(long number, unsigned char base = 10);
+    explicit String(unsigned long number, unsigned char base = 10);
+    explicit String(long long number, unsigned char base = 10);
+    explicit String(unsigned long long number, unsigned char base = 10);
+    explicit String(float number, unsigned int decimals = 2);
+    explicit String(double number, unsigned int decimals = 2);
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size)
+    {
+        value.reserve(size);
+        return true;
+    }
+
+    bool concat(const String &str)
+    {
+        value += str.value;
+        return true;
+    }
+    bool concat(const char *str)
+    {
+        value += str ? str : "";
+        return true;
+    }
+    bool concat(const char *str, unsigned int length)
+    {
+        value.append(str, length);
+        return true;
+    }
+    bool concat(char c)
+    {
+        value += c;
+        return true;
+    }
+
+    String &operator+=(const String &str)
+    {
+        concat(str);
+        return *this;
+    }
+    String &operator+=(const char *str)
+    {
+        concat(str);
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        concat(c);
+        return *this;
+    }
+
+    bool equals(const String &str) const { return value == str.value; }
+    bool equals(const char *str) const { return value == (str ? str : ""); }
+    bool equalsIgnoreCase(const String &str) const;
+    bool operator==(const String &str) const { return equals(str); }
+    bool operator==(const char *str) const { return equals(str); }
+    bool operator!=(const String &str) const { return !equals(str); }
+    bool operator!=(const char *str) const { return !equals(str); }
+    bool operator<(const String &str) const { return value < str.value; }
+
+    char charAt(unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const char *str, unsigned int from = 0) const;
+    bool startsWith(const char *prefix) const { return value.compare(0, strlen_(prefix), prefix) == 0; }
+    String substring(unsigned int begin) const { return substring(begin, value.size()); }
+    String substring(unsigned int begin, unsigned int end) const;
+    long toInt() const;
+    void trim();
+
+private:
+    static size_t strlen_(const char *str);
+
+    std::string value;
+};
+
+// ArduinoJson recognises this type alongside String
+class StringSumHelper : public String
+{
+public:
+    using String::String;
+    StringSumHelper(const String &str) : String(str) {}
+};
+
+StringSumHelper operator+(const String &lhs, const String &rhs);
+StringSumHelper operator+(const String &lhs, const char *rhs);
+StringSumHelper operator+(const char *lhs, const String &rhs);
+StringSumHelper operator+(const String &lhs, char rhs);
@@ -0,0 +1,41 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t mode)
+{
+    if (mode == WIFI_OFF)
+        current_status = WL_DISCONNECTED;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *passphrase,
+                             int32_t channel, const uint8_t *bssid, bool connect)
+{
+    if (channel > 0)
+        current_channel = channel;
+    if (bssid)
+        memcpy(this->bssid, bssid, sizeof(this->bssid));
+    current_status = WL_CONNECTED;
+    return current_status;
+}
+
+bool WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1, IPAddress dns2)
+{
+    // An all-zero address switches back to DHCP
+    if ((uint32_t)local_ip != 0)
+    {
+        this->local_ip = local_ip;
+        gateway_ip = gateway;
+        subnet_mask = subnet;
+        dns_ip = dns1;
+    }
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap)
+{
+    current_status = WL_DISCONNECTED;
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_PS_NONE = 0,
+    WIFI_PS_MIN_MODEM = 1,
+    WIFI_PS_MAX_MODEM = 2
+} wifi_ps_type_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+} wifi_mode_t;
+
+// Associates instantly; the host network is used as is
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr,
+                      int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+    bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifioff = false, bool eraseap = false);
+    bool setSleep(bool enabled) { return true; }
+    bool setSleep(wifi_ps_type_t type) { return true; }
+    wl_status_t status() { return current_status; }
+
+    IPAddress localIP() { return local_ip; }
+    IPAddress gatewayIP() { return gateway_ip; }
+    IPAddress subnetMask() { return subnet_mask; }
+    IPAddress dnsIP(uint8_t index = 0) { return dns_ip; }
+    uint8_t *BSSID() { return bssid; }
+    int32_t channel() { return current_channel; }
+    int8_t RSSI() { return -55; }
+
+private:
+    wl_status_t current_status = WL_DISCONNECTED;
+    IPAddress local_ip = IPAddress(192, 168, 1, 50);
+    IPAddress gateway_ip = IPAddress(192, 168, 1, 1);
+    IPAddress subnet_mask = IPAddress(255, 255, 255, 0);
+    IPAddress dns_ip = IPAddress(192, 168, 1, 1);
+    uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    int32_t current_channel = 6;
+};
+
+extern WiFiClass WiFi;
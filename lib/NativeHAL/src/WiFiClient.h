@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include <string>
+
+// Stands in for the socket; holds the body of the last emulated response and stays
+// connected for the next request, as a kept-alive connection does
+class WiFiClient : public Stream
+{
+public:
+    virtual ~WiFiClient() {}
+
+    virtual int connect(const char *host, uint16_t port)
+    {
+        open = true;
+        opened_after = NativeHAL::serverCloseCount();
+        return 1;
+    }
+    virtual void stop()
+    {
+        open = false;
+        load("");
+    }
+    // Open from connect() to stop(), whatever the server did meanwhile
+    virtual uint8_t connected() { return open; }
+    bool closedByServer() const { return open && opened_after != NativeHAL::serverCloseCount(); }
+
+    int available() override { return (int)(data.size() - position); }
+    int read() override { return position < data.size() ? (uint8_t)data[position++] : -1; }
+    int peek() override { return position < data.size() ? (uint8_t)data[position] : -1; }
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override { return size; }
+    using Print::write;
+
+    void load(const String &body)
+    {
+        data.assign(body.c_str(), body.length());
+        position = 0;
+    }
+
+    operator bool() { return true; }
+
+private:
+    std::string data;
+    size_t position = 0;
+    bool open = false;
+    uint32_t opened_after = 0;
+};
@@ -0,0 +1,81 @@
+#include "WiFiClientSecure.h"
+#include "NativeHAL.h"
+
+static const uint32_t SESSION_MAGIC = 0x53534C54; // "TLSS"
+static const size_t SESSION_HEADER_SIZE = 8 + sizeof(NativeHAL::TlsSession::master);
+// Roughly what mbedtls_ssl_session_save() gives for www.mvg.de with the peer certificate kept
+static const size_t DEFAULT_SESSION_SIZE = 1200;
+
+static uint32_t ticket_key = 1;
+static size_t session_size = 0;
+static bool session_size_loaded = false;
+static uint32_t master_state = 2463534242u;
+
+namespace NativeHAL
+{
+    bool tlsHandshake(const char *host, const TlsSession *offered, TlsSession &session)
+    {
+        // The server accepts a ticket for as long as the key that sealed it is current
+        if (offered && offered->ticket_key == ticket_key)
+        {
+            session = *offered;
+            return true;
+        }
+
+        // A full handshake derives a fresh master secret, from a fixed seed so runs repeat
+        for (uint8_t &byte : session.master)
+        {
+            master_state ^= master_state << 13;
+            master_state ^= master_state >> 17;
+            master_state ^= master_state << 5;
+            byte = master_state;
+        }
+        session.ticket_key = ticket_key;
+        return false;
+    }
+
+    size_t tlsSessionSave(const TlsSession &session, uint8_t *buffer, size_t size)
+    {
+        if (!session_size_loaded)
+        {
+            const char *value = getenv("NATIVE_TLS_SESSION_SIZE");
+            session_size = value ? strtoul(value, nullptr, 10) : DEFAULT_SESSION_SIZE;
+            session_size_loaded = true;
+        }
+
+        size_t length = max(session_size, SESSION_HEADER_SIZE);
+        if (length > size)
+            return 0;
+
+        memset(buffer, 0, length);
+        memcpy(buffer, &SESSION_MAGIC, 4);
+        memcpy(buffer + 4, &session.ticket_key, 4);
+        memcpy(buffer + 8, session.master, sizeof(session.master));
+        return length;
+    }
+
+    bool tlsSessionLoad(const uint8_t *buffer, size_t length, TlsSession &session)
+    {
+        uint32_t magic;
+        if (length < SESSION_HEADER_SIZE)
+            return false;
+        memcpy(&magic, buffer, 4);
+        if (magic != SESSION_MAGIC)
+            return false;
+
+        memcpy(&session.ticket_key, buffer + 4, 4);
+        memcpy(session.master, buffer + 8, sizeof(session.master));
+        return true;
+    }
+
+    void rotateTlsTicketKey()
+    {
+        ticket_key++;
+    }
+
+    void setTlsSessionSize(size_t size)
+    {
+        session_size = size;
+        session_size_loaded = true;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "WiFiClient.h"
+
+// Encryption is not emulated; certificates are accepted and ignored. The
+// session handshake is, by the stand-in server in NativeHAL.h
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setInsecure() {}
+    void setCACert(const char *rootCA) {}
+    void setHandshakeTimeout(unsigned long timeout) {}
+};
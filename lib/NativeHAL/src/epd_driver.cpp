@@ -0,0 +1,313 @@
+#include "epd_driver.h"
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include <cstdio>
+
+static uint8_t panel_buffer[EPD_WIDTH * EPD_HEIGHT / 2];
+static uint32_t panel_updates = 0;
+
+// Emulated duration of one waveform pass
+static void runWaveform()
+{
+    static const char *value = getenv("NATIVE_EPD_WAVEFORM_MS");
+    if (value)
+    {
+        delay(strtoul(value, nullptr, 10));
+    }
+}
+
+static void writePanel()
+{
+    panel_updates++;
+
+    const char *path = getenv("NATIVE_EPD_OUTPUT");
+    FILE *file = fopen(path ? path : "epd.pgm", "wb");
+    if (!file)
+        return;
+
+    fprintf(file, "P5\n%d %d\n255\n", EPD_WIDTH, EPD_HEIGHT);
+    static uint8_t row[EPD_WIDTH];
+    for (int y = 0; y < EPD_HEIGHT; y++)
+    {
+        for (int x = 0; x < EPD_WIDTH; x++)
+        {
+            uint8_t byte = panel_buffer[y * EPD_WIDTH / 2 + x / 2];
+            uint8_t value = (x & 1) ? byte >> 4 : byte & 0x0F;
+            row[x] = value * 17;
+        }
+        fwrite(row, 1, EPD_WIDTH, file);
+    }
+    fclose(file);
+}
+
+static void clearPanelArea(Rect_t area)
+{
+    for (int y = max(area.y, 0); y < min(area.y + area.height, EPD_HEIGHT); y++)
+    {
+        for (int x = max(area.x, 0); x < min(area.x + area.width, EPD_WIDTH); x++)
+        {
+            epd_draw_pixel(x, y, 0xFF, panel_buffer);
+        }
+    }
+}
+
+void epd_init()
+{
+    memset(panel_buffer, 0xFF, sizeof(panel_buffer));
+}
+
+void epd_deinit() {}
+void epd_poweron() {}
+void epd_poweroff() {}
+void epd_poweroff_all() {}
+
+void epd_clear()
+{
+    clearPanelArea(epd_full_screen());
+    runWaveform();
+    writePanel();
+}
+
+void epd_clear_area(Rect_t area)
+{
+    clearPanelArea(area);
+    runWaveform();
+    writePanel();
+}
+
+void epd_clear_area_cycles(Rect_t area, int cycles, int cycle_time)
+{
+    epd_clear_area(area);
+}
+
+Rect_t epd_full_screen()
+{
+    return {0, 0, EPD_WIDTH, EPD_HEIGHT};
+}
+
+void epd_draw_grayscale_image(Rect_t area, uint8_t *data)
+{
+    epd_draw_image(area, data, BLACK_ON_WHITE);
+}
+
+void epd_draw_image(Rect_t area, uint8_t *data, DrawMode_t mode)
+{
+    // Like the real waveform, black-on-white drawing can only darken pixels
+    int byte_width = area.width / 2 + area.width % 2;
+    for (int y = 0; y < area.height; y++)
+    {
+        int yy = area.y + y;
+        if (yy < 0 || yy >= EPD_HEIGHT)
+            continue;
+        for (int x = 0; x < area.width; x++)
+        {
+            int xx = area.x + x;
+            if (xx < 0 || xx >= EPD_WIDTH)
+                continue;
+            uint8_t byte = data[y * byte_width + x / 2];
+            uint8_t value = (x & 1) ? byte >> 4 : byte & 0x0F;
+            uint8_t shown = panel_buffer[yy * EPD_WIDTH / 2 + xx / 2];
+            shown = (xx & 1) ? shown >> 4 : shown & 0x0F;
+            epd_draw_pixel(xx, yy, min(value, shown) << 4, panel_buffer);
+        }
+    }
+    runWaveform();
+    writePanel();
+}
+
+void epd_draw_pixel(int x, int y, uint8_t color, uint8_t *framebuffer)
+{
+    if (x < 0 || x >= EPD_WIDTH || y < 0 || y >= EPD_HEIGHT)
+        return;
+    uint8_t *buf_ptr = &framebuffer[y * EPD_WIDTH / 2 + x / 2];
+    if (x % 2)
+        *buf_ptr = (*buf_ptr & 0x0F) | (color & 0xF0);
+    else
+        *buf_ptr = (*buf_ptr & 0xF0) | (color >> 4);
+}
+
+void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t *framebuffer)
+{
+    for (int i = 0; i < length; i++)
+        epd_draw_pixel(x + i, y, color, framebuffer);
+}
+
+void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t *framebuffer)
+{
+    for (int i = 0; i < length; i++)
+        epd_draw_pixel(x, y + i, color, framebuffer);
+}
+
+void epd_draw_rect(int x, int y, int width, int height, uint8_t color, uint8_t *framebuffer)
+{
+    epd_draw_hline(x, y, width, color, framebuffer);
+    epd_draw_hline(x, y + height - 1, width, color, framebuffer);
+    epd_draw_vline(x, y, height, color, framebuffer);
+    epd_draw_vline(x + width - 1, y, height, color, framebuffer);
+}
+
+void epd_fill_rect(int x, int y, int width, int height, uint8_t color, uint8_t *framebuffer)
+{
+    for (int i = y; i < y + height; i++)
+        epd_draw_hline(x, i, width, color, framebuffer);
+}
+
+static uint32_t nextCodePoint(const uint8_t **string)
+{
+    const uint8_t *s = *string;
+    uint32_t cp = *s++;
+    int extra = 0;
+    if (cp >= 0xF0)
+    {
+        cp &= 0x07;
+        extra = 3;
+    }
+    else if (cp >= 0xE0)
+    {
+        cp &= 0x0F;
+        extra = 2;
+    }
+    else if (cp >= 0xC0)
+    {
+        cp &= 0x1F;
+        extra = 1;
+    }
+    while (extra-- && (*s & 0xC0) == 0x80)
+        cp = (cp << 6) | (*s++ & 0x3F);
+    *string = s;
+    return cp;
+}
+
+void get_glyph(const GFXfont *font, uint32_t code_point, GFXglyph **glyph)
+{
+    *glyph = nullptr;
+    for (uint32_t i = 0; i < font->interval_count; i++)
+    {
+        const UnicodeInterval *interval = &font->intervals[i];
+        if (code_point >= interval->first && code_point <= interval->last)
+        {
+            *glyph = &font->glyph[interval->offset + (code_point - interval->first)];
+            return;
+        }
+        if (code_point < interval->first)
+            return;
+    }
+}
+
+static void drawChar(const GFXfont *font, uint8_t *framebuffer, int32_t *cursor_x, int32_t cursor_y,
+                     uint32_t cp, const FontProperties *props)
+{
+    GFXglyph *glyph;
+    get_glyph(font, cp, &glyph);
+    if (!glyph)
+        get_glyph(font, props->fallback_glyph, &glyph);
+    if (!glyph)
+        return;
+
+    if (font->compressed)
+    {
+        // Compressed glyphs need the device's ROM inflate; only advance the cursor
+        *cursor_x += glyph->advance_x;
+        return;
+    }
+
+    const uint8_t *bitmap = &font->bitmap[glyph->data_offset];
+    int byte_width = glyph->width / 2 + glyph->width % 2;
+
+    uint8_t color_lut[16];
+    for (int c = 0; c < 16; c++)
+    {
+        int color_difference = (int)props->fg_color - (int)props->bg_color;
+        color_lut[c] = max(0, min(15, props->bg_color + c * color_difference / 15));
+    }
+
+    for (int y = 0; y < glyph->height; y++)
+    {
+        int yy = cursor_y - glyph->top + y;
+        for (int x = 0; x < glyph->width; x++)
+        {
+            uint8_t bm = bitmap[y * byte_width + x / 2];
+            bm = (x & 1) ? bm >> 4 : bm & 0x0F;
+            epd_draw_pixel(*cursor_x + glyph->left + x, yy, color_lut[bm] << 4, framebuffer);
+        }
+    }
+
+    *cursor_x += glyph->advance_x;
+}
+
+void get_text_bounds(const GFXfont *font, const char *string, int32_t *x, int32_t *y,
+                     int32_t *x1, int32_t *y1, int32_t *w, int32_t *h, const FontProperties *props)
+{
+    int minx = 100000, miny = 100000, maxx = -1, maxy = -1;
+    int32_t cursor = *x;
+    const uint8_t *s = (const uint8_t *)string;
+    while (*s)
+    {
+        uint32_t cp = nextCodePoint(&s);
+        GFXglyph *glyph;
+        get_glyph(font, cp, &glyph);
+        if (!glyph && props)
+            get_glyph(font, props->fallback_glyph, &glyph);
+        if (!glyph)
+            continue;
+        minx = min(minx, (int)(cursor + glyph->left));
+        maxx = max(maxx, (int)(cursor + glyph->left + glyph->width));
+        miny = min(miny, (int)(*y - glyph->top));
+        maxy = max(maxy, (int)(*y - glyph->top + glyph->height));
+        cursor += glyph->advance_x;
+    }
+    *x1 = minx;
+    *y1 = miny;
+    *w = maxx > minx ? maxx - minx : 0;
+    *h = maxy > miny ? maxy - miny : 0;
+}
+
+void write_mode(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+                uint8_t *framebuffer, DrawMode_t mode, const FontProperties *properties)
+{
+    if (!string || !framebuffer)
+        return;
+
+    FontProperties props = {0, 15, 0, 0};
+    if (properties)
+        props = *properties;
+
+    int32_t line_start = *cursor_x;
+    const uint8_t *s = (const uint8_t *)string;
+    while (*s)
+    {
+        uint32_t cp = nextCodePoint(&s);
+        if (cp == '\n')
+        {
+            *cursor_x = line_start;
+            *cursor_y += font->advance_y;
+            continue;
+        }
+        drawChar(font, framebuffer, cursor_x, *cursor_y, cp, &props);
+    }
+}
+
+void write_string(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+                  uint8_t *framebuffer)
+{
+    write_mode(font, string, cursor_x, cursor_y, framebuffer, BLACK_ON_WHITE, nullptr);
+}
+
+void writeln(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+             uint8_t *framebuffer)
+{
+    write_string(font, string, cursor_x, cursor_y, framebuffer);
+}
+
+namespace NativeHAL
+{
+    const uint8_t *panel()
+    {
+        return panel_buffer;
+    }
+
+    uint32_t panelUpdates()
+    {
+        return panel_updates;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+
+// Host version of the LilyGo EPD47 driver API. The panel is kept in memory
+// and written to a PGM file after every update.
+#define EPD_WIDTH 960
+#define EPD_HEIGHT 540
+
+typedef struct
+{
+    uint8_t width;
+    uint8_t height;
+    uint8_t advance_x;
+    int16_t left;
+    int16_t top;
+    uint32_t compressed_size;
+    uint32_t data_offset;
+} GFXglyph;
+
+typedef struct
+{
+    uint32_t first;
+    uint32_t last;
+    uint32_t offset;
+} UnicodeInterval;
+
+typedef struct
+{
+    uint8_t *bitmap;
+    GFXglyph *glyph;
+    UnicodeInterval *intervals;
+    uint32_t interval_count;
+    bool compressed;
+    uint8_t advance_y;
+    int ascender;
+    int descender;
+} GFXfont;
+
+typedef struct
+{
+    uint8_t fg_color : 4;
+    uint8_t bg_color : 4;
+    uint32_t fallback_glyph;
+    uint32_t flags;
+} FontProperties;
+
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+    int height;
+} Rect_t;
+
+typedef enum
+{
+    BLACK_ON_WHITE = 1 << 0,
+    WHITE_ON_WHITE = 1 << 1,
+    WHITE_ON_BLACK = 1 << 2
+} DrawMode_t;
+
+enum DrawFlags
+{
+    DRAW_BACKGROUND = 1 << 0
+};
+
+void epd_init();
+void epd_deinit();
+void epd_poweron();
+void epd_poweroff();
+void epd_poweroff_all();
+void epd_clear();
+void epd_clear_area(Rect_t area);
+void epd_clear_area_cycles(Rect_t area, int cycles, int cycle_time);
+Rect_t epd_full_screen();
+void epd_draw_grayscale_image(Rect_t area, uint8_t *data);
+void epd_draw_image(Rect_t area, uint8_t *data, DrawMode_t mode);
+
+void epd_draw_pixel(int x, int y, uint8_t color, uint8_t *framebuffer);
+void epd_draw_hline(int x, int y, int length, uint8_t color, uint8_t *framebuffer);
+void epd_draw_vline(int x, int y, int length, uint8_t color, uint8_t *framebuffer);
+void epd_draw_rect(int x, int y, int width, int height, uint8_t color, uint8_t *framebuffer);
+void epd_fill_rect(int x, int y, int width, int height, uint8_t color, uint8_t *framebuffer);
+
+void get_glyph(const GFXfont *font, uint32_t code_point, GFXglyph **glyph);
+void get_text_bounds(const GFXfont *font, const char *string, int32_t *x, int32_t *y,
+                     int32_t *x1, int32_t *y1, int32_t *w, int32_t *h, const FontProperties *props);
+void write_mode(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+                uint8_t *framebuffer, DrawMode_t mode, const FontProperties *properties);
+void write_string(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+                  uint8_t *framebuffer);
+void writeln(const GFXfont *font, const char *string, int32_t *cursor_x, int32_t *cursor_y,
+             uint8_t *framebuffer);
+
+namespace NativeHAL
+{
+    // Panel contents as 4bpp, same layout as a framebuffer
+    const uint8_t *panel();
+    uint32_t panelUpdates();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+typedef enum
+{
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2
+} adc_unit_t;
+
+typedef enum
+{
+    ADC_ATTEN_DB_0 = 0,
+    ADC_ATTEN_DB_2_5 = 1,
+    ADC_ATTEN_DB_6 = 2,
+    ADC_ATTEN_DB_11 = 3
+} adc_atten_t;
+
+typedef enum
+{
+    ADC_WIDTH_BIT_12 = 3
+} adc_bits_width_t;
+
+typedef enum
+{
+    ESP_ADC_CAL_VAL_EFUSE_VREF = 0,
+    ESP_ADC_CAL_VAL_EFUSE_TP = 1,
+    ESP_ADC_CAL_VAL_DEFAULT_VREF = 2
+} esp_adc_cal_value_t;
+
+typedef struct
+{
+    adc_unit_t adc_num;
+    adc_atten_t atten;
+    adc_bits_width_t bit_width;
+    uint32_t coeff_a;
+    uint32_t coeff_b;
+    uint32_t vref;
+    const uint32_t *low_curve;
+    const uint32_t *high_curve;
+} esp_adc_cal_characteristics_t;
+
+// Reports the default Vref so the battery maths runs the same code path as an uncalibrated chip
+inline esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width,
+                                                    uint32_t default_vref, esp_adc_cal_characteristics_t *chars)
+{
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+// Host memory; MALLOC_CAP_SPIRAM allocations count as PSRAM like ps_malloc
+void *heap_caps_malloc(size_t size, uint32_t caps);
@@ -0,0 +1,95 @@
+#include "esp_sleep.h"
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include "driver/gpio.h"
+#include "utilities.h"
+
+static uint64_t timer_wakeup_us = 0;
+static bool gpio_wakeup = false;
+static uint64_t ext1_wakeup_mask = 0;
+static bool wakeup_cause_loaded = false;
+static esp_sleep_source_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode)
+{
+    ext1_wakeup_mask = mask;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    timer_wakeup_us = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup()
+{
+    gpio_wakeup = true;
+    return ESP_OK;
+}
+
+esp_sleep_source_t esp_sleep_get_wakeup_cause()
+{
+    // Set by the previous boot when it went into deep sleep
+    if (!wakeup_cause_loaded)
+    {
+        const char *cause = getenv("NATIVE_WAKEUP_CAUSE");
+        if (cause)
+            wakeup_cause = (esp_sleep_source_t)atoi(cause);
+        wakeup_cause_loaded = true;
+    }
+    return wakeup_cause;
+}
+
+esp_err_t esp_light_sleep_start()
+{
+    // Sleeping is just emulated time passing until the timer fires or a button is pressed
+    unsigned long now = millis();
+    unsigned long sleep_ms = timer_wakeup_us / 1000;
+    unsigned long edge = gpio_wakeup ? NativeHAL::nextButtonEdge(now) : 0;
+    if (edge && edge - now < sleep_ms)
+    {
+        NativeHAL::advanceMillis(edge - now);
+        wakeup_cause = ESP_SLEEP_WAKEUP_GPIO;
+        wakeup_cause_loaded = true;
+        return ESP_OK;
+    }
+
+    NativeHAL::advanceMillis(sleep_ms);
+    wakeup_cause = ESP_SLEEP_WAKEUP_TIMER;
+    wakeup_cause_loaded = true;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+    unsigned long now = millis();
+    unsigned long wake_ms = 0;
+    esp_sleep_source_t cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+
+    if (timer_wakeup_us)
+    {
+        wake_ms = now + timer_wakeup_us / 1000;
+        cause = ESP_SLEEP_WAKEUP_TIMER;
+    }
+
+    // The buttons are active low, so a held button wakes right away
+    if (ext1_wakeup_mask & _BV(BUTTON_1))
+    {
+        unsigned long press = gpio_get_level(BUTTON_1) == 0 ? now : NativeHAL::nextButtonEdge(now);
+        if (press && (cause == ESP_SLEEP_WAKEUP_UNDEFINED || press < wake_ms))
+        {
+            wake_ms = press;
+            cause = ESP_SLEEP_WAKEUP_EXT1;
+        }
+    }
+
+    if (cause != ESP_SLEEP_WAKEUP_UNDEFINED)
+    {
+        NativeHAL::deepSleepRestart(wake_ms, cause);
+    }
+
+    Serial.println("[native] deep sleep without a wakeup source, exiting");
+    Serial.flush();
+    exit(0);
+}
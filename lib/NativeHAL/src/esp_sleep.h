@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_EXT1_WAKEUP_ALL_LOW = 0,
+    ESP_EXT1_WAKEUP_ANY_HIGH = 1,
+    ESP_EXT1_WAKEUP_ANY_LOW = 2
+} esp_sleep_ext1_wakeup_mode_t;
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+    ESP_SLEEP_WAKEUP_GPIO
+} esp_sleep_source_t;
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode);
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_gpio_wakeup();
+esp_sleep_source_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_light_sleep_start();
+// Ends the host process, the way deep sleep ends the sketch
+void esp_deep_sleep_start() __attribute__((noreturn));
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+// configTime() reports the host clock as an immediate sync
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+void sntp_stop();
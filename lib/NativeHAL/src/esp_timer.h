@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Microseconds of emulated time since start
+int64_t esp_timer_get_time();
@@ -0,0 +1,4 @@
+#include "firasans.h"
+#include <firasans_small.h>
+
+const GFXfont FiraSans = FiraSansSmall;
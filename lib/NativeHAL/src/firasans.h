@@ -0,0 +1,7 @@
+#pragma once
+
+#include "epd_driver.h"
+
+// The large font ships with the LilyGo driver; the host build maps it onto
+// FiraSansSmall so text still renders with the right metrics class
+extern const GFXfont FiraSans;
@@ -0,0 +1,49 @@
+#include "event_groups.h"
+#include "kernel.h"
+
+struct EventGroupDef_t
+{
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate()
+{
+    return new EventGroupDef_t{0};
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, const EventBits_t bits, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return xEventGroupSetBits(group, bits);
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits)
+{
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear_on_exit,
+                                const BaseType_t wait_for_all, TickType_t ticks_to_wait)
+{
+    bool satisfied = NativeKernel::blockUntil([group, bits, wait_for_all]
+                                              { return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; },
+                                              ticks_to_wait);
+    EventBits_t result = group->bits;
+    if (satisfied && clear_on_exit)
+        group->bits &= ~bits;
+    return result;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits);
+EventBits_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, const EventBits_t bits, BaseType_t *higher_priority_task_woken);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear_on_exit,
+                                const BaseType_t wait_for_all, TickType_t ticks_to_wait);
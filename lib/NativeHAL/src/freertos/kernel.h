@@ -0,0 +1,13 @@
+#pragma once
+
+#include "FreeRTOS.h"
+#include <functional>
+
+// Internal to the FreeRTOS shims
+namespace NativeKernel
+{
+    // True once a task has been created; until then delay() just advances the clock
+    bool active();
+    // Blocks the calling task until ready() holds or the timeout passes, returns ready()
+    bool blockUntil(const std::function<bool()> &ready, TickType_t timeout);
+}
@@ -0,0 +1,120 @@
+#include "queue.h"
+#include "semphr.h"
+#include "kernel.h"
+#include <cstring>
+#include <deque>
+#include <vector>
+
+struct QueueDefinition
+{
+    UBaseType_t length;
+    UBaseType_t item_size;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+static bool push(QueueHandle_t queue, const void *item, bool front)
+{
+    if (queue->items.size() >= queue->length)
+        return false;
+
+    std::vector<uint8_t> data(queue->item_size);
+    if (item && queue->item_size)
+        memcpy(data.data(), item, queue->item_size);
+
+    if (front)
+        queue->items.push_front(std::move(data));
+    else
+        queue->items.push_back(std::move(data));
+    return true;
+}
+
+static BaseType_t send(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait, bool front)
+{
+    bool has_space = NativeKernel::blockUntil([queue]
+                                              { return queue->items.size() < queue->length; },
+                                              ticks_to_wait);
+    return has_space && push(queue, item, front) ? pdPASS : errQUEUE_FULL;
+}
+
+static BaseType_t take(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait, bool remove)
+{
+    bool has_item = NativeKernel::blockUntil([queue]
+                                             { return !queue->items.empty(); },
+                                             ticks_to_wait);
+    if (!has_item)
+        return pdFALSE;
+
+    if (buffer && queue->item_size)
+        memcpy(buffer, queue->items.front().data(), queue->item_size);
+    if (remove)
+        queue->items.pop_front();
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return new QueueDefinition{length, item_size, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    return send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    return send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return push(queue, item, false) ? pdPASS : errQUEUE_FULL;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    queue->items.clear();
+    push(queue, item, false);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+    return take(queue, buffer, ticks_to_wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+    return take(queue, buffer, ticks_to_wait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->items.clear();
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    // A mutex starts out available
+    SemaphoreHandle_t semaphore = xQueueCreate(1, 0);
+    push(semaphore, nullptr, false);
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return xQueueCreate(1, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
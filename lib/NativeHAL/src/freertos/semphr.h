@@ -0,0 +1,14 @@
+#pragma once
+
+#include "queue.h"
+
+// As in FreeRTOS, a semaphore is a queue of empty items
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#define xSemaphoreTake(semaphore, ticks) xQueueReceive((semaphore), nullptr, (ticks))
+#define xSemaphoreGive(semaphore) xQueueSend((semaphore), nullptr, 0)
+#define xSemaphoreGiveFromISR(semaphore, woken) xQueueSendFromISR((semaphore), nullptr, (woken))
@@ -0,0 +1,209 @@
+#include "task.h"
+#include "kernel.h"
+#include "Arduino.h"
+#include "NativeHAL.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct tskTaskControlBlock
+{
+    TaskFunction_t function;
+    void *parameter;
+    const char *name;
+    UBaseType_t priority;
+    std::function<bool()> ready;
+    uint64_t deadline_ms;
+    bool deleted;
+};
+
+struct Kernel
+{
+    std::mutex mutex;
+    std::condition_variable switched;
+    std::vector<tskTaskControlBlock *> tasks;
+    tskTaskControlBlock *current = nullptr;
+    size_t next = 0;
+};
+
+// Never destroyed: blocked task threads still wait on it when the process exits
+static Kernel &kernel()
+{
+    static Kernel *instance = new Kernel();
+    return *instance;
+}
+
+// The Arduino loop task is adopted the first time it calls into the kernel
+static tskTaskControlBlock *currentTask(Kernel &k)
+{
+    if (!k.current)
+    {
+        k.current = new tskTaskControlBlock{nullptr, nullptr, "loopTask", 1, nullptr, 0, false};
+        k.tasks.push_back(k.current);
+    }
+    return k.current;
+}
+
+// Highest priority runnable task, round robin among equals; with none runnable the clock jumps to the next timeout
+static tskTaskControlBlock *pickNext(Kernel &k)
+{
+    for (;;)
+    {
+        uint64_t now = millis();
+        uint64_t earliest = UINT64_MAX;
+        size_t count = k.tasks.size();
+        tskTaskControlBlock *picked = nullptr;
+        size_t picked_index = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t index = (k.next + i) % count;
+            tskTaskControlBlock *task = k.tasks[index];
+            if (task->deleted)
+                continue;
+            if (task->deadline_ms <= now || (task->ready && task->ready()))
+            {
+                if (!picked || task->priority > picked->priority)
+                {
+                    picked = task;
+                    picked_index = index;
+                }
+                continue;
+            }
+            earliest = std::min(earliest, task->deadline_ms);
+        }
+
+        if (picked)
+        {
+            k.next = (picked_index + 1) % count;
+            return picked;
+        }
+
+        if (earliest == UINT64_MAX)
+        {
+            Serial.println("[native] every task is blocked forever, exiting");
+            Serial.flush();
+            exit(0);
+        }
+        NativeHAL::advanceMillis(earliest - now);
+    }
+}
+
+// Hands the CPU to the next task and returns once this one is picked again
+static void switchAway(Kernel &k, std::unique_lock<std::mutex> &lock, tskTaskControlBlock *task)
+{
+    k.current = pickNext(k);
+    k.switched.notify_all();
+    k.switched.wait(lock, [&]
+                    { return k.current == task; });
+}
+
+namespace NativeKernel
+{
+    bool active()
+    {
+        return kernel().tasks.size() > 1;
+    }
+
+    bool blockUntil(const std::function<bool()> &ready, TickType_t timeout)
+    {
+        Kernel &k = kernel();
+        std::unique_lock<std::mutex> lock(k.mutex);
+        tskTaskControlBlock *task = currentTask(k);
+
+        if (ready())
+            return true;
+        if (timeout == 0)
+            return false;
+
+        task->ready = ready;
+        task->deadline_ms = timeout == portMAX_DELAY ? UINT64_MAX : millis() + timeout;
+        switchAway(k, lock, task);
+        task->ready = nullptr;
+        task->deadline_ms = 0;
+        return ready();
+    }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *parameter, UBaseType_t priority, TaskHandle_t *created_task)
+{
+    Kernel &k = kernel();
+    std::unique_lock<std::mutex> lock(k.mutex);
+    currentTask(k);
+
+    tskTaskControlBlock *task = new tskTaskControlBlock{function, parameter, name, priority, nullptr, 0, false};
+    k.tasks.push_back(task);
+
+    std::thread([task]
+                {
+                    Kernel &k = kernel();
+                    {
+                        std::unique_lock<std::mutex> lock(k.mutex);
+                        k.switched.wait(lock, [&]
+                                        { return k.current == task; });
+                    }
+                    task->function(task->parameter);
+                    // FreeRTOS tasks must not return
+                    vTaskDelete(nullptr); })
+        .detach();
+
+    if (created_task)
+        *created_task = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    return xTaskCreate(function, name, stack_depth, parameter, priority, created_task);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    Kernel &k = kernel();
+    std::unique_lock<std::mutex> lock(k.mutex);
+    tskTaskControlBlock *self = currentTask(k);
+
+    if (task && task != self)
+    {
+        task->deleted = true;
+        return;
+    }
+
+    // The thread stays parked for good
+    self->deleted = true;
+    switchAway(k, lock, self);
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+    NativeKernel::blockUntil([]
+                             { return false; },
+                             ticks);
+}
+
+void taskYIELD()
+{
+    Kernel &k = kernel();
+    std::unique_lock<std::mutex> lock(k.mutex);
+    tskTaskControlBlock *task = currentTask(k);
+
+    // Stays runnable, so it is picked again after the other ready tasks had their turn
+    task->deadline_ms = 0;
+    switchAway(k, lock, task);
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    Kernel &k = kernel();
+    std::unique_lock<std::mutex> lock(k.mutex);
+    return task ? task->priority : currentTask(k)->priority;
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return millis() / portTICK_PERIOD_MS;
+}
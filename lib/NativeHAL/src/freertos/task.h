@@ -0,0 +1,23 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// Tasks run one at a time on their own threads and switch only when they block,
+// so emulated time stands still while a task runs and jumps ahead when all of
+// them wait. The highest priority runnable task goes next, but a running task
+// is never preempted; cores are accepted but not modelled.
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskIDLE_PRIORITY 0
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                       void *parameter, UBaseType_t priority, TaskHandle_t *created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth,
+                                   void *parameter, UBaseType_t priority, TaskHandle_t *created_task,
+                                   BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(const TickType_t ticks);
+void taskYIELD();
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+TickType_t xTaskGetTickCount();
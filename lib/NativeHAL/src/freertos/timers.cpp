@@ -0,0 +1,127 @@
+#include "timers.h"
+#include "task.h"
+#include "kernel.h"
+#include "Arduino.h"
+#include <vector>
+
+struct tmrTimerControl
+{
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *timer_id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    uint64_t expiry_ms;
+};
+
+static std::vector<TimerHandle_t> timers;
+static bool service_started = false;
+// Bumped on every change so the service task re-plans its wait
+static uint32_t timers_version = 0;
+
+static void timerServiceTask(void *parameter)
+{
+    for (;;)
+    {
+        uint64_t now = millis();
+        uint64_t next = UINT64_MAX;
+
+        for (TimerHandle_t timer : timers)
+        {
+            if (!timer->active)
+                continue;
+            if (timer->expiry_ms <= now)
+            {
+                if (timer->auto_reload)
+                    timer->expiry_ms = now + timer->period;
+                else
+                    timer->active = false;
+                timer->callback(timer);
+                now = millis();
+            }
+            if (timer->active)
+                next = std::min(next, timer->expiry_ms);
+        }
+
+        uint32_t version = timers_version;
+        TickType_t wait = next == UINT64_MAX ? portMAX_DELAY : (TickType_t)(next > now ? next - now : 0);
+        NativeKernel::blockUntil([version]
+                                 { return timers_version != version; },
+                                 wait);
+    }
+}
+
+static BaseType_t arm(TimerHandle_t timer)
+{
+    timer->active = true;
+    timer->expiry_ms = millis() + timer->period;
+    timers_version++;
+    return pdPASS;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *timer_id, TimerCallbackFunction_t callback)
+{
+    if (!service_started)
+    {
+        service_started = true;
+        xTaskCreate(timerServiceTask, "Tmr Svc", 2048, nullptr, 1, nullptr);
+    }
+
+    TimerHandle_t timer = new tmrTimerControl{name, period, auto_reload != pdFALSE, timer_id, callback, false, 0};
+    timers.push_back(timer);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return arm(timer);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    timer->active = false;
+    timers_version++;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return arm(timer);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+    timer->period = period;
+    return arm(timer);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->timer_id;
+}
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return arm(timer);
+}
+
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken)
+{
+    return xTimerStartFromISR(timer, higher_priority_task_woken);
+}
+
+BaseType_t xTimerStopFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken)
+        *higher_priority_task_woken = pdFALSE;
+    return xTimerStop(timer, 0);
+}
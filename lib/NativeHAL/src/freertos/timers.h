@@ -0,0 +1,20 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// Callbacks run on a timer service task, as in FreeRTOS
+typedef struct tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *timer_id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken);
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken);
+BaseType_t xTimerStopFromISR(TimerHandle_t timer, BaseType_t *higher_priority_task_woken);
@@ -0,0 +1,180 @@
+#include "driver/gpio.h"
+#include "Arduino.h"
+#include "utilities.h"
+#include "freertos/task.h"
+#include "freertos/kernel.h"
+#include "NativeHAL.h"
+#include <map>
+#include <vector>
+
+// How long each scripted press holds the button down
+static const unsigned long PRESS_DURATION_MS = 100;
+
+struct PinState
+{
+    gpio_int_type_t type = GPIO_INTR_DISABLE;
+    bool enabled = false;
+    gpio_isr_t handler = nullptr;
+    void *arg = nullptr;
+};
+
+static std::map<gpio_num_t, PinState> pins;
+static bool interrupt_task_started = false;
+// Bumped on every change so the interrupt task re-checks the pins
+static uint32_t pins_version = 0;
+
+static const std::vector<unsigned long> &buttonPresses()
+{
+    static std::vector<unsigned long> presses;
+    static bool loaded = false;
+    if (!loaded)
+    {
+        const char *script = getenv("NATIVE_BUTTON_MS");
+        String times = script ? script : "1000";
+        int start = 0;
+        while (start < (int)times.length())
+        {
+            int end = times.indexOf(',', start);
+            if (end < 0)
+                end = times.length();
+            presses.push_back(strtoul(times.substring(start, end).c_str(), nullptr, 10));
+            start = end + 1;
+        }
+        loaded = true;
+    }
+    return presses;
+}
+
+// The next time after now at which BUTTON_1 changes level
+static uint64_t nextEdge(uint64_t now)
+{
+    for (unsigned long press : buttonPresses())
+    {
+        if (press > now)
+            return press;
+        if (press + PRESS_DURATION_MS > now)
+            return press + PRESS_DURATION_MS;
+    }
+    return UINT64_MAX;
+}
+
+namespace NativeHAL
+{
+    unsigned long nextButtonEdge(unsigned long now)
+    {
+        uint64_t edge = nextEdge(bootMillis() + now);
+        return edge == UINT64_MAX ? 0 : (unsigned long)(edge - bootMillis());
+    }
+}
+
+static bool levelMatches(gpio_num_t pin, gpio_int_type_t type)
+{
+    int level = gpio_get_level(pin);
+    return (type == GPIO_INTR_LOW_LEVEL && level == 0) || (type == GPIO_INTR_HIGH_LEVEL && level == 1);
+}
+
+// Stands in for the interrupt controller, calling the handler of every enabled level interrupt whose level holds
+static void interruptTask(void *parameter)
+{
+    for (;;)
+    {
+        bool fired = false;
+        for (auto &entry : pins)
+        {
+            PinState &state = entry.second;
+            if (state.enabled && state.handler && levelMatches(entry.first, state.type))
+            {
+                state.handler(state.arg);
+                fired = true;
+            }
+        }
+
+        uint32_t version = pins_version;
+        uint64_t now = NativeHAL::bootMillis() + millis();
+        uint64_t edge = nextEdge(now);
+        // A handler that leaves its level interrupt enabled fires again every tick, like on hardware
+        TickType_t wait = fired ? 1 : edge == UINT64_MAX ? portMAX_DELAY
+                                                           : (TickType_t)(edge - now);
+        NativeKernel::blockUntil([version]
+                                 { return pins_version != version; },
+                                 wait);
+    }
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    // Buttons are active low and released by default
+    if (pin != BUTTON_1)
+        return 1;
+
+    // The script counts from the first boot, so presses also land during deep sleep
+    unsigned long now = NativeHAL::bootMillis() + millis();
+    for (unsigned long press : buttonPresses())
+    {
+        if (press <= now && now < press + PRESS_DURATION_MS)
+            return 0;
+    }
+    return 1;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    for (gpio_num_t pin = 0; pin < 64; pin++)
+    {
+        if (config->pin_bit_mask & (1ULL << pin))
+            gpio_set_intr_type(pin, config->intr_type);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    if (interrupt_task_started)
+        return ESP_ERR_INVALID_STATE;
+
+    interrupt_task_started = true;
+    xTaskCreate(interruptTask, "gpio_isr", 2048, nullptr, configMAX_PRIORITIES - 1, nullptr);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void *arg)
+{
+    pins[pin].handler = handler;
+    pins[pin].arg = arg;
+    pins_version++;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    pins[pin].handler = nullptr;
+    pins_version++;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type)
+{
+    pins[pin].type = type;
+    pins[pin].enabled = type != GPIO_INTR_DISABLE;
+    pins_version++;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t pin)
+{
+    pins[pin].enabled = true;
+    pins_version++;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t pin)
+{
+    pins[pin].enabled = false;
+    pins_version++;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Pin map of the LilyGo T5 4.7" S3 board
+#define BUTTON_1 (21)
+#define BATT_PIN (14)
+#define SD_MISO (16)
+#define SD_MOSI (15)
+#define SD_SCLK (11)
+#define SD_CS (42)
+#define BOARD_SCL (17)
+#define BOARD_SDA (18)
+#define TOUCH_INT (47)
@@ -67,10 +67,9 @@ int BatteryMonitor::getBatteryPercentage()
 
 String BatteryMonitor::getBatteryStatus()
 {
-    float voltage = getBatteryVoltage();
     int percentage = getBatteryPercentage();
 
-    String status = /*String(voltage, 2) +  "V ("*/ "battery:" + String(percentage) + "%";
+    String status = "battery:" + String(percentage) + "%";
 
     if (isLowBattery())
     {
@@ -0,0 +1,128 @@
+#include "ChunkedStream.h"
+
+ChunkedStream::ChunkedStream(Stream &source, unsigned long timeout_ms)
+    : source(source), timeout_ms(timeout_ms), remaining(0), done(false), peeked(-1)
+{
+}
+
+int ChunkedStream::available()
+{
+    if (peeked >= 0)
+        return 1;
+    if (done)
+        return 0;
+    return min((int)remaining, source.available());
+}
+
+int ChunkedStream::read()
+{
+    if (peeked >= 0)
+    {
+        int c = peeked;
+        peeked = -1;
+        return c;
+    }
+
+    if (remaining == 0 && !nextChunk())
+        return -1;
+
+    int c = readSource();
+    if (c < 0)
+    {
+        done = true;
+        return -1;
+    }
+
+    if (--remaining == 0)
+    {
+        // Every chunk ends with CRLF
+        skipLine();
+    }
+    return c;
+}
+
+int ChunkedStream::peek()
+{
+    if (peeked < 0)
+        peeked = read();
+    return peeked;
+}
+
+void ChunkedStream::drain()
+{
+    while (read() >= 0)
+    {
+    }
+}
+
+int ChunkedStream::readSource()
+{
+    unsigned long start = millis();
+    do
+    {
+        int c = source.read();
+        if (c >= 0)
+            return c;
+        delay(1);
+    } while (millis() - start < timeout_ms);
+    return -1;
+}
+
+bool ChunkedStream::nextChunk()
+{
+    if (done)
+        return false;
+
+    // Chunk size is hex, optionally followed by ";extension"
+    size_t size = 0;
+    bool in_extension = false;
+    for (;;)
+    {
+        int c = readSource();
+        if (c < 0)
+        {
+            done = true;
+            return false;
+        }
+        if (c == '\n')
+            break;
+        if (c == ';')
+            in_extension = true;
+        if (in_extension || c == '\r')
+            continue;
+
+        if (c >= '0' && c <= '9')
+            size = size * 16 + (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            size = size * 16 + (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            size = size * 16 + (c - 'A' + 10);
+    }
+
+    if (size == 0)
+    {
+        // Last chunk: skip optional trailers up to the empty line
+        for (;;)
+        {
+            int c = readSource();
+            if (c < 0 || c == '\n')
+                break;
+            if (c != '\r')
+                skipLine();
+        }
+        done = true;
+        return false;
+    }
+
+    remaining = size;
+    return true;
+}
+
+void ChunkedStream::skipLine()
+{
+    int c;
+    do
+    {
+        c = readSource();
+    } while (c >= 0 && c != '\n');
+}
@@ -0,0 +1,115 @@
+#include "DepartureSnapshot.h"
+
+static const uint32_t SNAPSHOT_MAGIC = 0x44455032; // "DEP2"
+// Three stations of five departures encode to roughly 400 to 900 bytes, depending on the destinations
+static const size_t SNAPSHOT_DATA_SIZE = 1536;
+// Tried in turn until the departures fit; without destinations even a full table does
+static const size_t DESTINATION_LIMITS[] = {DepartureTable::MAX_DESTINATION_LENGTH, 24, 12, 0};
+static_assert(DepartureTable::maxEncodedSize(0) <= SNAPSHOT_DATA_SIZE, "A full departure table does not fit the snapshot");
+
+struct SnapshotState
+{
+    uint32_t magic;
+    uint16_t length;
+    LiveSchedule schedule;
+    ShownScreen screen;
+    SnapshotStats stats;
+    uint8_t data[SNAPSHOT_DATA_SIZE];
+};
+
+RTC_DATA_ATTR static SnapshotState snapshot;
+
+bool DepartureSnapshot::save(const DepartureTable &table, const ShownScreen &screen, const LiveSchedule &schedule)
+{
+    unsigned long start = micros();
+    size_t length = 0;
+    size_t destination_limit = 0;
+    for (size_t limit : DESTINATION_LIMITS)
+    {
+        destination_limit = limit;
+        length = table.encode(snapshot.data, sizeof(snapshot.data), limit);
+        if (length)
+            break;
+    }
+    snapshot.stats.encode_us = micros() - start;
+
+    if (length == 0)
+    {
+        Serial.println("Snapshot: departures do not fit RTC memory");
+        snapshot.magic = 0;
+        return false;
+    }
+    if (destination_limit < DepartureTable::MAX_DESTINATION_LENGTH)
+    {
+        Serial.printf("Snapshot: destinations cut to %u bytes to fit RTC memory\n", (unsigned)destination_limit);
+    }
+
+    snapshot.magic = SNAPSHOT_MAGIC;
+    snapshot.length = length;
+    snapshot.schedule = schedule;
+    snapshot.screen = screen;
+    snapshot.stats.encoded_bytes = length;
+
+    Serial.printf("Snapshot: %u stations in %u bytes, encoded in %u us\n",
+                  (unsigned)table.stationCount(),
+                  (unsigned)length,
+                  snapshot.stats.encode_us);
+    return true;
+}
+
+bool DepartureSnapshot::restore(DepartureTable &table, ShownScreen &screen)
+{
+    if (!isValid())
+        return false;
+
+    unsigned long start = micros();
+    bool decoded = table.decode(snapshot.data, snapshot.length);
+    snapshot.stats.decode_us = micros() - start;
+
+    if (!decoded)
+    {
+        Serial.println("Snapshot: corrupt, discarding it");
+        invalidate();
+        return false;
+    }
+
+    screen = snapshot.screen;
+    if (screen.station == DASHBOARD)
+    {
+        screen.rows = 0;
+    }
+    bool shown_valid = (screen.station < table.stationCount() || screen.station == DASHBOARD) &&
+                       screen.rows <= DepartureTable::MAX_DEPARTURES;
+    for (size_t row = 0; shown_valid && row < screen.rows; row++)
+    {
+        shown_valid = screen.departures[row] < table.departureCount(screen.station);
+    }
+    if (!shown_valid)
+    {
+        screen.station = NO_STATION;
+        screen.rows = 0;
+    }
+
+    Serial.printf("Snapshot: %u bytes decoded in %u us\n", snapshot.length, snapshot.stats.decode_us);
+    return true;
+}
+
+bool DepartureSnapshot::isValid() const
+{
+    return snapshot.magic == SNAPSHOT_MAGIC && snapshot.length <= sizeof(snapshot.data);
+}
+
+void DepartureSnapshot::invalidate()
+{
+    snapshot.magic = 0;
+}
+
+const LiveSchedule &DepartureSnapshot::getSchedule() const
+{
+    return snapshot.schedule;
+}
+
+const SnapshotStats &DepartureSnapshot::getStats() const
+{
+    return snapshot.stats;
+}
@@ -0,0 +1,313 @@
+#include "DepartureTable.h"
+#include <cstring>
+
+DepartureTable::DepartureTable() : station_count(0), line_count(0)
+{
+    clear();
+}
+
+void DepartureTable::clear()
+{
+    for (size_t station = 0; station < MAX_STATIONS; station++)
+    {
+        arenas[station][0] = '\0';
+        departure_counts[station] = 0;
+        arena_used[station] = 0;
+    }
+    station_count = 0;
+    line_count = 0;
+}
+
+void DepartureTable::compactLines()
+{
+    uint8_t line_map[MAX_LINES];
+    memset(line_map, NO_LINE, sizeof(line_map));
+    for (size_t station = 0; station < station_count; station++)
+    {
+        for (size_t i = 0; i < departure_counts[station]; i++)
+        {
+            if (line_ids[station][i] != NO_LINE)
+                line_map[line_ids[station][i]] = 0;
+        }
+    }
+
+    // Labels in use move down in id order, so none is overwritten before it has moved
+    size_t used_lines = 0;
+    for (size_t id = 0; id < line_count; id++)
+    {
+        if (line_map[id] == NO_LINE)
+            continue;
+        if (used_lines != id)
+            memcpy(line_labels[used_lines], line_labels[id], LINE_LABEL_SIZE);
+        line_map[id] = used_lines++;
+    }
+    line_count = used_lines;
+
+    for (size_t station = 0; station < station_count; station++)
+    {
+        for (size_t i = 0; i < departure_counts[station]; i++)
+        {
+            if (line_ids[station][i] != NO_LINE)
+                line_ids[station][i] = line_map[line_ids[station][i]];
+        }
+    }
+}
+
+void DepartureTable::resetStation(size_t station, const char *name)
+{
+    if (station >= MAX_STATIONS)
+        return;
+
+    // The name goes first in the arena, so it is still there when the table is copied or restored
+    size_t length = min(strlen(name), (size_t)MAX_NAME_LENGTH);
+    memcpy(arenas[station], name, length);
+    arenas[station][length] = '\0';
+    arena_used[station] = length + 1;
+    departure_counts[station] = 0;
+    station_count = max(station_count, station + 1);
+}
+
+bool DepartureTable::addDeparture(size_t station, const char *line, const char *destination, uint32_t departure_time)
+{
+    if (station >= MAX_STATIONS)
+        return false;
+
+    size_t index = departure_counts[station];
+    size_t length = strlen(destination) + 1;
+    if (index >= MAX_DEPARTURES || arena_used[station] + length > ARENA_SIZE)
+        return false;
+
+    memcpy(arenas[station] + arena_used[station], destination, length);
+    destination_offsets[station][index] = arena_used[station];
+    arena_used[station] += length;
+
+    line_ids[station][index] = internLine(line);
+    departure_times[station][index] = departure_time;
+    departure_counts[station]++;
+    return true;
+}
+
+const char *DepartureTable::line(size_t station, size_t index) const
+{
+    uint8_t id = line_ids[station][index];
+    return id == NO_LINE ? "?" : line_labels[id];
+}
+
+long DepartureTable::minutesUntil(uint32_t departure_time, time_t now)
+{
+    if ((time_t)departure_time <= now)
+        return 0;
+    return ((time_t)departure_time - now) / 60;
+}
+
+uint8_t DepartureTable::internLine(const char *label)
+{
+    for (size_t id = 0; id < line_count; id++)
+    {
+        if (strncmp(line_labels[id], label, LINE_LABEL_SIZE - 1) == 0)
+            return id;
+    }
+
+    // A refetched station may have been the last to use some labels
+    if (line_count == MAX_LINES)
+        compactLines();
+    if (line_count == MAX_LINES)
+        return NO_LINE;
+
+    strncpy(line_labels[line_count], label, LINE_LABEL_SIZE - 1);
+    line_labels[line_count][LINE_LABEL_SIZE - 1] = '\0';
+    return line_count++;
+}
+
+// Layout: u8 line count, labels as u8 length + bytes, u32 base time, u8 station
+// count, then per station its name, u8 departure count and per departure
+// u8 line, u16 seconds after the base time and the destination, which is
+// either u8 length + bytes or 0x80 | index of an earlier departure going there
+size_t DepartureTable::encode(uint8_t *buffer, size_t size, size_t destination_limit) const
+{
+    destination_limit = min(destination_limit, (size_t)MAX_DESTINATION_LENGTH);
+
+    uint8_t line_map[MAX_LINES];
+    memset(line_map, NO_LINE, sizeof(line_map));
+    uint8_t used_lines = 0;
+    uint32_t base_time = UINT32_MAX;
+
+    for (size_t station = 0; station < station_count; station++)
+    {
+        for (size_t i = 0; i < departure_counts[station]; i++)
+        {
+            uint8_t id = line_ids[station][i];
+            if (id != NO_LINE)
+                line_map[id] = 0;
+            base_time = min(base_time, departure_times[station][i]);
+        }
+    }
+
+    // Labels in use are numbered in id order, which is also the order they are written in
+    for (size_t id = 0; id < line_count; id++)
+    {
+        if (line_map[id] != NO_LINE)
+            line_map[id] = used_lines++;
+    }
+
+    size_t pos = 0;
+    auto put = [&](const void *data, size_t length)
+    {
+        if (pos + length <= size)
+            memcpy(buffer + pos, data, length);
+        pos += length;
+    };
+    auto putByte = [&](uint8_t value)
+    { put(&value, 1); };
+
+    putByte(used_lines);
+    for (size_t id = 0; id < line_count; id++)
+    {
+        if (line_map[id] == NO_LINE)
+            continue;
+        uint8_t length = strlen(line_labels[id]);
+        putByte(length);
+        put(line_labels[id], length);
+    }
+
+    put(&base_time, sizeof(base_time));
+    putByte(station_count);
+
+    for (size_t station = 0; station < station_count; station++)
+    {
+        uint8_t name_length = strlen(arenas[station]);
+        putByte(name_length);
+        put(arenas[station], name_length);
+
+        // Departures are sorted, so everything from the first one out of u16 range on is dropped
+        size_t count = 0;
+        while (count < departure_counts[station] && departure_times[station][count] - base_time <= UINT16_MAX)
+        {
+            count++;
+        }
+        putByte(count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t id = line_ids[station][i];
+            putByte(id == NO_LINE ? NO_LINE : line_map[id]);
+            uint16_t offset = departure_times[station][i] - base_time;
+            put(&offset, sizeof(offset));
+
+            size_t earlier = 0;
+            while (earlier < i && destination_offsets[station][earlier] != destination_offsets[station][i] &&
+                   strcmp(destination(station, earlier), destination(station, i)) != 0)
+            {
+                earlier++;
+            }
+
+            if (earlier < i)
+            {
+                putByte(0x80 | earlier);
+            }
+            else
+            {
+                const char *text = destination(station, i);
+                size_t length = strlen(text);
+                if (length > destination_limit)
+                {
+                    // Back off to the lead byte, so a cut never splits a character
+                    length = destination_limit;
+                    while (length > 0 && ((uint8_t)text[length] & 0xC0) == 0x80)
+                    {
+                        length--;
+                    }
+                }
+                putByte(length);
+                put(text, length);
+            }
+        }
+    }
+
+    return pos <= size ? pos : 0;
+}
+
+bool DepartureTable::decode(const uint8_t *buffer, size_t length)
+{
+    size_t pos = 0;
+    bool ok = true;
+    auto get = [&](void *data, size_t size)
+    {
+        ok = ok && pos + size <= length;
+        if (ok)
+            memcpy(data, buffer + pos, size);
+        pos += size;
+    };
+    auto getString = [&](char *text, size_t max_length)
+    {
+        uint8_t size = 0;
+        get(&size, 1);
+        ok = ok && size <= max_length;
+        if (ok)
+            get(text, size);
+        text[ok ? size : 0] = '\0';
+    };
+
+    // The line table starts over, so ids of the snapshot are the ids of the table
+    clear();
+
+    uint8_t used_lines = 0;
+    get(&used_lines, 1);
+    ok = ok && used_lines <= MAX_LINES;
+    for (size_t id = 0; ok && id < used_lines; id++)
+    {
+        getString(line_labels[id], LINE_LABEL_SIZE - 1);
+        line_count++;
+    }
+
+    uint32_t base_time = 0;
+    uint8_t stations = 0;
+    get(&base_time, sizeof(base_time));
+    get(&stations, 1);
+    ok = ok && stations <= MAX_STATIONS;
+
+    char name[MAX_NAME_LENGTH + 1];
+    char destination_text[0x80];
+    for (size_t station = 0; ok && station < stations; station++)
+    {
+        getString(name, MAX_NAME_LENGTH);
+        resetStation(station, name);
+
+        uint8_t count = 0;
+        get(&count, 1);
+        for (size_t i = 0; ok && i < count; i++)
+        {
+            uint8_t id = NO_LINE;
+            uint16_t offset = 0;
+            uint8_t tag = 0;
+            get(&id, 1);
+            get(&offset, sizeof(offset));
+            get(&tag, 1);
+
+            const char *text = destination_text;
+            if (tag & 0x80)
+            {
+                ok = ok && (size_t)(tag & 0x7F) < departure_counts[station];
+                text = ok ? destination(station, tag & 0x7F) : "";
+            }
+            else
+            {
+                ok = ok && pos + tag <= length;
+                if (ok)
+                {
+                    memcpy(destination_text, buffer + pos, tag);
+                    destination_text[tag] = '\0';
+                }
+                pos += tag;
+            }
+
+            ok = ok && (id == NO_LINE || id < line_count) && addDeparture(station, id == NO_LINE ? "?" : line_labels[id], text, base_time + offset);
+        }
+    }
+
+    if (!ok)
+    {
+        clear();
+    }
+    return ok && pos == length;
+}
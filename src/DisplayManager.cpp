@@ -1,50 +1,167 @@
 #include "DisplayManager.h"
+#include "FrameKernels.h"
+#include "GlyphIndex.h"
 #include <cstdlib>
 #include <cstring>
+#include <utility>
 #include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static const size_t FRAME_BYTES = EPD_WIDTH * EPD_HEIGHT / 2;
+static const size_t MONO_BYTES = EPD_WIDTH * EPD_HEIGHT / 8;
+
+// Aligned, so tile rows compare word by word; frames live as long as the display, so the offset is never undone
+static uint8_t *allocFrame()
+{
+    uintptr_t raw = (uintptr_t)ps_malloc(FRAME_BYTES + FrameKernels::FRAME_ALIGNMENT - 1);
+    if (!raw)
+        return nullptr;
+    return (uint8_t *)((raw + FrameKernels::FRAME_ALIGNMENT - 1) & ~(uintptr_t)(FrameKernels::FRAME_ALIGNMENT - 1));
+}
+
+static Rect_t unionRect(Rect_t a, Rect_t b)
+{
+    int32_t x0 = min(a.x, b.x);
+    int32_t y0 = min(a.y, b.y);
+    int32_t x1 = max(a.x + a.width, b.x + b.width);
+    int32_t y1 = max(a.y + a.height, b.y + b.height);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
 
 DisplayManager::DisplayManager()
-    : framebuffer(nullptr), current_y(TOP_MARGIN), display_initialized(false), FONT_LARGE(&FiraSans), FONT_SMALL(&FiraSansSmall)
+    : framebuffer(nullptr), format(FrameFormat::GRAY4), next_format(FrameFormat::GRAY4), mono_buffer(nullptr),
+      frames{}, frame_formats{}, frame_areas{}, frame_compose_us{}, stale_areas{}, frame_stale{}, draw_frame(0),
+      handed_area({0, 0, 0, 0}), compose_us(0), handoff(1), push_frame(2), panel_busy(false), panel_wake(nullptr),
+      push_stats{}, back_buffer(nullptr), back_format(FrameFormat::GRAY4), back_mono(nullptr), back_dirty_area({0, 0, 0, 0}),
+      back_has_dirty(false), back_y(TOP_MARGIN),
+      back_ready(false), committed(nullptr), push_buffer(nullptr), current_y(TOP_MARGIN), display_initialized(false),
+      dirty_area({0, 0, 0, 0}), has_dirty(false), partial_updates(0), stats_lock(nullptr),
+      commit_stats({0, 0, 0, 0, 0, false}), frame_stats{}, render_list(&render_lists[0]), back_render_list(&render_lists[1]),
+      FONT_LARGE(&FiraSans), FONT_SMALL(&FiraSansSmall)
 {
+    rows = {FONT_LARGE, TOP_MARGIN, LINE_HEIGHT};
+    back_rows = rows;
     font_props = {
         .fg_color = 0,
-        .bg_color = 255,
+        .bg_color = 15,
         .fallback_glyph = 0,
         .flags = 0x0F // Using proper flag value for 4-bit field
     };
 }
 
-void DisplayManager::init()
+void DisplayManager::init(bool keep_panel)
 {
     Serial.println("Initializing display...");
 
     epd_init();
 
-    framebuffer = (uint8_t *)ps_calloc(EPD_WIDTH * EPD_HEIGHT / 2, 1);
-    if (!framebuffer)
+    bool allocated = true;
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        frames[i] = allocFrame();
+        allocated = allocated && frames[i];
+    }
+    committed = allocFrame();
+    push_buffer = (uint8_t *)ps_malloc(FRAME_BYTES);
+    if (!allocated || !committed || !push_buffer)
     {
         Serial.println("Error: Could not allocate display buffer!");
         display_initialized = false;
         return;
     }
+    framebuffer = frames[draw_frame];
+
+    // Optional, screens are drawn straight into the framebuffer without it
+    back_buffer = allocFrame();
+    if (!back_buffer)
+    {
+        Serial.println("No memory for a back buffer, screens are composed in place");
+    }
+
+    // Optional as well, text is decoded glyph by glyph by the driver without it
+    glyph_cache.init();
+    text_layout.init();
+    GlyphIndex::add(FONT_LARGE);
+    GlyphIndex::add(FONT_SMALL);
 
     Serial.println("Framebuffer allocated successfully");
-    memset(framebuffer, 0xFF, EPD_WIDTH * EPD_HEIGHT / 2);
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        FrameKernels::fill(frames[i], 0xFF, FRAME_BYTES);
+    }
+    FrameKernels::fill(committed, 0xFF, FRAME_BYTES);
 
     epd_poweron();
-    epd_clear();
+    if (!keep_panel)
+    {
+        epd_clear();
+    }
     display_initialized = true;
 
+    // Pushes handed-off frames, so commit() does not wait for the waveform
+    panel_wake = xSemaphoreCreateBinary();
+    stats_lock = xSemaphoreCreateMutex();
+    xTaskCreate(panelTask, "panel", PANEL_TASK_STACK, this, PANEL_TASK_PRIORITY, nullptr);
+
     Serial.println("Display initialized successfully");
 }
 
+void DisplayManager::setFrameFormat(FrameFormat requested)
+{
+    if (!display_initialized)
+        return;
+
+    if (requested == FrameFormat::MONO1 && !mono_buffer)
+    {
+        // Mono text is drawn from the glyph cache's bitmaps, so it needs the cache as well
+        if (glyph_cache.isReady())
+        {
+            mono_buffer = (uint8_t *)heap_caps_malloc(MONO_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            if (mono_buffer && back_buffer)
+            {
+                back_mono = (uint8_t *)heap_caps_malloc(MONO_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            }
+        }
+        if (!mono_buffer || (back_buffer && !back_mono))
+        {
+            free(mono_buffer);
+            mono_buffer = nullptr;
+            back_mono = nullptr;
+            Serial.println("No memory for 1bpp screens, they are composed in grayscale");
+            return;
+        }
+        Serial.printf("Compose buffers: %u bytes per 1bpp screen in internal RAM, %u bytes per 4bpp screen in PSRAM\n",
+                      (unsigned)composeBytes(FrameFormat::MONO1), (unsigned)composeBytes(FrameFormat::GRAY4));
+    }
+    next_format = requested;
+}
+
+size_t DisplayManager::composeBytes(FrameFormat format)
+{
+    return format == FrameFormat::MONO1 ? MONO_BYTES : FRAME_BYTES;
+}
+
 void DisplayManager::clear()
 {
     if (!display_initialized)
         return;
-    memset(framebuffer, 0xFF, EPD_WIDTH * EPD_HEIGHT / 2);
-    epd_clear();
-    current_y = TOP_MARGIN;
+    // Only the framebuffer is wiped; the next commit refreshes whatever actually changed
+    unsigned long start = micros();
+    // Whatever was still waiting to be drawn would be wiped anyway
+    render_list->clear();
+    format = next_format;
+    if (format == FrameFormat::MONO1)
+    {
+        memset(mono_buffer, 0, MONO_BYTES);
+    }
+    else
+    {
+        FrameKernels::fill(framebuffer, 0xFF, FRAME_BYTES);
+    }
+    compose_us += micros() - start;
+    markDirty(0, 0, EPD_WIDTH, EPD_HEIGHT);
+    rows = {FONT_LARGE, TOP_MARGIN, LINE_HEIGHT};
+    current_y = rows.top;
 }
 
 void DisplayManager::startStationDisplay(const char *station_name)
@@ -52,69 +169,593 @@ void DisplayManager::startStationDisplay(const char *station_name)
     clear();
 
     // Draw station name at the top
-    int32_t cursor_x = 50;
-    int32_t cursor_y = STATION_Y;
-    write_string(FONT_LARGE, station_name, &cursor_x, &cursor_y, framebuffer);
+    addText(FONT_LARGE, station_name, LINE_X, STATION_Y, EPD_WIDTH - 2 * LINE_X);
 
     // Draw a line under the station name
-    epd_draw_hline(40, STATION_Y + 40, EPD_WIDTH - 80, 0, framebuffer);
+    addFill(40, STATION_Y + 40, EPD_WIDTH - 80, 1, 0);
     current_y = TOP_MARGIN;
-
-    // Update display
-    epd_draw_grayscale_image(epd_full_screen(), framebuffer);
 }
 
-bool DisplayManager::displayDeparture(const String &line, const String &destination, const String &time_to_departure)
+bool DisplayManager::displayDeparture(const char *line, const char *destination, long minutes)
 {
     if (!display_initialized)
         return false;
 
-    int32_t cursor_x, cursor_y;
+    if (current_y > EPD_HEIGHT - rows.height)
+    {
+        return false;
+    }
 
     // Draw line number (left)
-    cursor_x = LINE_X;
-    cursor_y = current_y;
-    write_string(FONT_LARGE, line.c_str(), &cursor_x, &cursor_y, framebuffer);
+    addText(rows.font, line, LINE_X, current_y, DEST_X - COLUMN_GAP - LINE_X);
 
-    // Draw destination (center)
-    cursor_x = DEST_X;
-    cursor_y = current_y;
-    write_string(FONT_LARGE, destination.c_str(), &cursor_x, &cursor_y, framebuffer);
+    // Draw destination (center), cut short before the minutes column
+    addText(rows.font, destination, DEST_X, current_y, TIME_X - COLUMN_GAP - DEST_X);
 
     // Draw time (right)
-    String mins = time_to_departure + " min";
-    cursor_x = TIME_X;
-    cursor_y = current_y;
-    write_string(FONT_LARGE, mins.c_str(), &cursor_x, &cursor_y, framebuffer);
+    drawMinutes(current_y, minutes);
 
-    current_y += LINE_HEIGHT;
+    current_y += rows.height;
+    return true;
+}
 
-    if (current_y > EPD_HEIGHT - LINE_HEIGHT)
-    {
+void DisplayManager::startDashboard()
+{
+    clear();
+    rows = {FONT_SMALL, DASHBOARD_TOP, DASHBOARD_LINE_HEIGHT};
+    current_y = rows.top;
+}
+
+bool DisplayManager::addSection(const char *station_name)
+{
+    if (!display_initialized || rowsLeft() < 2)
         return false;
+
+    addText(rows.font, station_name, LINE_X, current_y, EPD_WIDTH - 2 * LINE_X);
+    // Just under the descenders, and above where the next row's minutes are blanked
+    addFill(40, current_y - rows.font->descender + 1, EPD_WIDTH - 80, 1, 0);
+    current_y += rows.height;
+    return true;
+}
+
+size_t DisplayManager::rowsLeft() const
+{
+    int last = EPD_HEIGHT - rows.height;
+    return current_y > last ? 0 : (last - current_y) / rows.height + 1;
+}
+
+void DisplayManager::updateDepartureMinutes(size_t row, long minutes)
+{
+    if (!display_initialized)
+        return;
+
+    int y = rowY(row);
+    if (y > EPD_HEIGHT - rows.height)
+        return;
+
+    // Blank only the minutes column of this row, the diff on commit does the rest
+    addFill(TIME_X, y - rows.font->ascender, EPD_WIDTH - TIME_X, rows.height, 255);
+    drawMinutes(y, minutes);
+}
+
+void DisplayManager::drawMinutes(int y, long minutes)
+{
+    char mins[16];
+    snprintf(mins, sizeof(mins), "%ld min", minutes);
+    addText(rows.font, mins, TIME_X, y, TIME_RIGHT - TIME_X, TextLayout::Align::RIGHT);
+}
+
+void DisplayManager::commit()
+{
+    if (!display_initialized)
+        return;
+    render();
+    if (!has_dirty)
+        return;
+
+    unsigned long start = micros();
+
+    // A frame the panel task has not taken yet gets replaced, so its changes ride along with this one
+    Rect_t area = dirty_area;
+    if (handoff.load() & FRAME_NEW)
+    {
+        area = unionRect(area, handed_area);
+    }
+
+    int handed = draw_frame;
+    frames[handed] = framebuffer;
+    if (format == FrameFormat::MONO1)
+    {
+        handMono(handed);
+    }
+    frame_formats[handed] = format;
+    frame_areas[handed] = area;
+    frame_compose_us[handed] = compose_us;
+    uint8_t previous = handoff.exchange(handed | FRAME_NEW);
+    xSemaphoreGive(panel_wake);
+
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    if (previous & FRAME_NEW)
+    {
+        frame_stats.frames_replaced++;
+    }
+    frame_stats.frames_handed++;
+    frame_stats.last_compose_us = compose_us;
+    frame_stats.max_compose_us = max(frame_stats.max_compose_us, compose_us);
+    xSemaphoreGive(stats_lock);
+    handed_area = area;
+
+    // Every other frame misses what was just drawn; the one drawn into next catches up right away
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        if (i != handed)
+        {
+            stale_areas[i] = frame_stale[i] ? unionRect(stale_areas[i], dirty_area) : dirty_area;
+            frame_stale[i] = true;
+        }
+    }
+    draw_frame = previous & ~FRAME_NEW;
+    framebuffer = frames[draw_frame];
+    // A mono screen keeps drawing into mono_buffer, and frames get its rows when they are handed off
+    if (format == FrameFormat::GRAY4)
+    {
+        catchUp(draw_frame, handed);
+    }
+
+    has_dirty = false;
+    compose_us = 0;
+
+    uint32_t handoff_us = micros() - start;
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    frame_stats.last_handoff_us = handoff_us;
+    frame_stats.max_handoff_us = max(frame_stats.max_handoff_us, handoff_us);
+    xSemaphoreGive(stats_lock);
+}
+
+CommitStats DisplayManager::getCommitStats() const
+{
+    // Before init() there is no panel task to race with
+    if (!stats_lock)
+        return commit_stats;
+
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    CommitStats stats = commit_stats;
+    xSemaphoreGive(stats_lock);
+    return stats;
+}
+
+FrameStats DisplayManager::getFrameStats() const
+{
+    if (!stats_lock)
+        return frame_stats;
+
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    FrameStats stats = frame_stats;
+    xSemaphoreGive(stats_lock);
+    return stats;
+}
+
+bool DisplayManager::isBusy() const
+{
+    return panel_busy.load() || (handoff.load() & FRAME_NEW);
+}
+
+void DisplayManager::flush()
+{
+    while (display_initialized && isBusy())
+    {
+        vTaskDelay(pdMS_TO_TICKS(FLUSH_POLL_MS));
+    }
+}
+
+void DisplayManager::catchUp(int frame, int source)
+{
+    if (!frame_stale[frame])
+        return;
+
+    Rect_t area = stale_areas[frame];
+    for (int32_t row = 0; row < area.height; row++)
+    {
+        size_t offset = (area.y + row) * EPD_WIDTH / 2 + area.x / 2;
+        memcpy(frames[frame] + offset, frames[source] + offset, area.width / 2);
+    }
+    frame_stale[frame] = false;
+}
+
+void DisplayManager::handMono(int frame)
+{
+    // Every switch to mono starts with clear(), which dirties the whole screen, so the
+    // rows a frame missed since it was last handed off plus the new ones cover everything
+    Rect_t area = frame_stale[frame] ? unionRect(stale_areas[frame], dirty_area) : dirty_area;
+    size_t offset = area.y * FrameKernels::MONO_ROW_BYTES;
+    memcpy(frames[frame] + offset, mono_buffer + offset, area.height * FrameKernels::MONO_ROW_BYTES);
+    frame_stale[frame] = false;
+}
+
+void DisplayManager::adoptFrame()
+{
+    if (!display_initialized)
+        return;
+
+    render();
+    flush();
+    if (format == FrameFormat::MONO1)
+    {
+        FrameKernels::expandMono(committed, mono_buffer, MONO_BYTES);
+    }
+    else
+    {
+        memcpy(committed, framebuffer, FRAME_BYTES);
+    }
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        // In mono, none of the frames has the adopted rows yet
+        if (frames[i] != framebuffer || format == FrameFormat::MONO1)
+        {
+            stale_areas[i] = epd_full_screen();
+            frame_stale[i] = true;
+        }
     }
+    has_dirty = false;
+    compose_us = 0;
+}
 
-    epd_draw_grayscale_image(epd_full_screen(), framebuffer);
+bool DisplayManager::beginBackFrame()
+{
+    if (!display_initialized || !back_buffer)
+        return false;
+
+    swapBuffers();
     return true;
 }
 
+void DisplayManager::endBackFrame()
+{
+    render();
+    swapBuffers();
+    back_ready = true;
+}
+
+bool DisplayManager::presentBackFrame()
+{
+    if (!back_ready)
+        return false;
+
+    // The old front becomes the next back buffer; commit diffs the new one against the panel
+    swapBuffers();
+    back_ready = false;
+    commit();
+    return true;
+}
+
+void DisplayManager::swapBuffers()
+{
+    std::swap(framebuffer, back_buffer);
+    std::swap(format, back_format);
+    std::swap(mono_buffer, back_mono);
+    std::swap(render_list, back_render_list);
+    std::swap(dirty_area, back_dirty_area);
+    std::swap(has_dirty, back_has_dirty);
+    std::swap(current_y, back_y);
+    std::swap(rows, back_rows);
+}
+
+void DisplayManager::panelTask(void *parameter)
+{
+    DisplayManager *display = (DisplayManager *)parameter;
+    for (;;)
+    {
+        xSemaphoreTake(display->panel_wake, portMAX_DELAY);
+
+        // Busy is raised before the frame leaves the handoff slot, so isBusy() never sees a gap
+        display->panel_busy = true;
+        while (display->handoff.load() & FRAME_NEW)
+        {
+            display->push_frame = display->handoff.exchange(display->push_frame) & ~FRAME_NEW;
+            int frame = display->push_frame;
+            display->pushFrame(display->frames[frame], display->frame_formats[frame],
+                               display->frame_areas[frame], display->frame_compose_us[frame]);
+        }
+        display->panel_busy = false;
+    }
+}
+
+void DisplayManager::pushFrame(const uint8_t *frame, FrameFormat format, Rect_t area, uint32_t compose_us)
+{
+    unsigned long start = millis();
+    push_stats.pushed_pixels = 0;
+    push_stats.tiles_changed = 0;
+    push_stats.bytes_compared = 0;
+    push_stats.full_refresh = partial_updates >= FULL_REFRESH_INTERVAL;
+
+    if (push_stats.full_refresh)
+    {
+        epd_clear();
+        pushArea(frame, format, epd_full_screen(), false);
+        partial_updates = 0;
+    }
+    else
+    {
+        refreshChangedTiles(frame, format, area);
+        if (push_stats.tiles_changed > 0)
+        {
+            partial_updates++;
+        }
+    }
+
+    push_stats.refresh_ms = millis() - start;
+    push_stats.commit_count++;
+
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    commit_stats = push_stats;
+    frame_stats.frames_pushed++;
+    frame_stats.last_push_ms = push_stats.refresh_ms;
+    frame_stats.max_push_ms = max(frame_stats.max_push_ms, push_stats.refresh_ms);
+    if (format == FrameFormat::MONO1)
+    {
+        frame_stats.mono_pushes++;
+        frame_stats.mono_push_ms += push_stats.refresh_ms;
+    }
+    else
+    {
+        frame_stats.gray_pushes++;
+        frame_stats.gray_push_ms += push_stats.refresh_ms;
+    }
+    if (push_stats.full_refresh || push_stats.tiles_changed > 0)
+    {
+        frame_stats.refreshes++;
+    }
+    xSemaphoreGive(stats_lock);
+
+    Serial.printf("Display commit #%u: %s %s, %u tiles changed, %u bytes compared, %u pixels pushed in %u ms, composed in %u us\n",
+                  push_stats.commit_count,
+                  push_stats.full_refresh ? "full" : "partial",
+                  format == FrameFormat::MONO1 ? "mono" : "gray",
+                  push_stats.tiles_changed,
+                  push_stats.bytes_compared,
+                  push_stats.pushed_pixels,
+                  push_stats.refresh_ms,
+                  compose_us);
+}
+
+void DisplayManager::refreshChangedTiles(const uint8_t *frame, FrameFormat format, Rect_t area)
+{
+    int first_col = area.x / TILE_WIDTH;
+    int last_col = (area.x + area.width - 1) / TILE_WIDTH;
+    int first_row = area.y / TILE_HEIGHT;
+    int last_row = (area.y + area.height - 1) / TILE_HEIGHT;
+
+    // Consecutive tile rows with changes are merged into one area, since every
+    // push runs the whole waveform regardless of how many rows it covers
+    int band_y = -1;
+    int band_x0 = 0;
+    int band_x1 = 0;
+
+    for (int tile_y = first_row; tile_y <= last_row + 1; tile_y++)
+    {
+        int span_x0 = EPD_WIDTH;
+        int span_x1 = 0;
+
+        for (int tile_x = first_col; tile_y <= last_row && tile_x <= last_col; tile_x++)
+        {
+            if (tileChanged(frame, format, tile_x, tile_y))
+            {
+                push_stats.tiles_changed++;
+                span_x0 = min(span_x0, tile_x * TILE_WIDTH);
+                span_x1 = max(span_x1, min((tile_x + 1) * TILE_WIDTH, (int)EPD_WIDTH));
+            }
+        }
+
+        if (span_x1 > span_x0)
+        {
+            if (band_y < 0)
+            {
+                band_y = tile_y * TILE_HEIGHT;
+                band_x0 = span_x0;
+                band_x1 = span_x1;
+            }
+            else
+            {
+                band_x0 = min(band_x0, span_x0);
+                band_x1 = max(band_x1, span_x1);
+            }
+        }
+        else if (band_y >= 0)
+        {
+            int band_end = min(tile_y * TILE_HEIGHT, (int)EPD_HEIGHT);
+            pushArea(frame, format, {band_x0, band_y, band_x1 - band_x0, band_end - band_y}, true);
+            band_y = -1;
+        }
+    }
+}
+
+bool DisplayManager::tileChanged(const uint8_t *frame, FrameFormat format, int tile_x, int tile_y)
+{
+    const size_t row_bytes = EPD_WIDTH / 2;
+    size_t first_byte = tile_x * TILE_WIDTH / 2;
+    size_t width = min((tile_x + 1) * TILE_WIDTH, (int)EPD_WIDTH) / 2 - first_byte;
+    int first_y = tile_y * TILE_HEIGHT;
+    int rows = min(first_y + TILE_HEIGHT, (int)EPD_HEIGHT) - first_y;
+
+    size_t offset = first_y * row_bytes + first_byte;
+    push_stats.bytes_compared += width * rows;
+    if (format == FrameFormat::GRAY4)
+    {
+        return !FrameKernels::equalRect(frame + offset, committed + offset, width, rows, row_bytes);
+    }
+
+    // Expanded a row at a time, the bits compare against the panel copy like gray pixels
+    uint8_t expanded[TILE_WIDTH / 2];
+    const uint8_t *bits = frame + first_y * FrameKernels::MONO_ROW_BYTES + first_byte / 4;
+    for (int row = 0; row < rows; row++, offset += row_bytes, bits += FrameKernels::MONO_ROW_BYTES)
+    {
+        FrameKernels::expandMono(expanded, bits, width / 4);
+        if (memcmp(expanded, committed + offset, width) != 0)
+            return true;
+    }
+    return false;
+}
+
+void DisplayManager::pushArea(const uint8_t *frame, FrameFormat format, Rect_t area, bool clear_first)
+{
+    // The driver expects a packed image of exactly the area, so copy the rows out
+    uint8_t *data = push_buffer;
+    if (format == FrameFormat::MONO1)
+    {
+        // Areas start and end on tile or screen edges, so on whole bytes of bits
+        for (int32_t row = 0; row < area.height; row++)
+        {
+            FrameKernels::expandMono(push_buffer + row * area.width / 2,
+                                     frame + (area.y + row) * FrameKernels::MONO_ROW_BYTES + area.x / 8,
+                                     area.width / 8);
+        }
+    }
+    else if (area.x == 0 && area.width == EPD_WIDTH)
+    {
+        // The driver takes a non-const pointer but only reads the image
+        data = (uint8_t *)frame + area.y * EPD_WIDTH / 2;
+    }
+    else
+    {
+        for (int32_t row = 0; row < area.height; row++)
+        {
+            memcpy(push_buffer + row * area.width / 2,
+                   frame + (area.y + row) * EPD_WIDTH / 2 + area.x / 2,
+                   area.width / 2);
+        }
+    }
+
+    // Drawing only darkens pixels, so the old content has to be cleared first
+    if (clear_first)
+    {
+        epd_clear_area(area);
+    }
+    epd_draw_grayscale_image(area, data);
+
+    for (int32_t row = 0; row < area.height; row++)
+    {
+        size_t offset = (area.y + row) * EPD_WIDTH / 2 + area.x / 2;
+        memcpy(committed + offset, data + row * area.width / 2, area.width / 2);
+    }
+
+    push_stats.pushed_pixels += area.width * area.height;
+}
+
+void DisplayManager::addText(const GFXfont *font, const char *text, int32_t x, int32_t y, int32_t width,
+                             TextLayout::Align align)
+{
+    unsigned long start = micros();
+    // A full list is drawn early; it only costs the single pass
+    if (!text_layout.place(*render_list, font, text, x, y, width, align))
+    {
+        render();
+        text_layout.place(*render_list, font, text, x, y, width, align);
+    }
+    compose_us += micros() - start;
+}
+
+void DisplayManager::addFill(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t color)
+{
+    if (!render_list->addFill(x, y, w, h, color))
+    {
+        render();
+        render_list->addFill(x, y, w, h, color);
+    }
+}
+
+void DisplayManager::render()
+{
+    for (size_t i = 0; i < render_list->size(); i++)
+    {
+        const RenderList::Item &item = render_list->item(i);
+        if (item.kind == RenderList::Kind::TEXT)
+        {
+            drawText(item.font, render_list->text(item), item.x, item.y);
+        }
+        else
+        {
+            fillRect(item.x, item.y, item.width, item.height, item.color);
+        }
+    }
+    render_list->clear();
+}
+
+void DisplayManager::drawText(const GFXfont *font, const char *text, int32_t x, int32_t y)
+{
+    unsigned long start = micros();
+    int32_t cursor_x = x;
+    if (format == FrameFormat::MONO1)
+    {
+        glyph_cache.drawTextMono(font, text, &cursor_x, y, mono_buffer);
+    }
+    else
+    {
+        glyph_cache.drawText(font, text, &cursor_x, y, framebuffer);
+    }
+    compose_us += micros() - start;
+
+    markDirty(x - DIRTY_MARGIN,
+              y - font->ascender - DIRTY_MARGIN,
+              cursor_x - x + 2 * DIRTY_MARGIN,
+              font->ascender - font->descender + 2 * DIRTY_MARGIN);
+}
+
+void DisplayManager::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint8_t color)
+{
+    unsigned long start = micros();
+    if (format == FrameFormat::MONO1)
+    {
+        FrameKernels::fillRectMono(mono_buffer, x, y, w, h, color < 0x80);
+    }
+    else
+    {
+        FrameKernels::fillRect(framebuffer, x, y, w, h, color);
+    }
+    compose_us += micros() - start;
+    markDirty(x, y, w, h);
+}
+
+void DisplayManager::markDirty(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    int32_t x0 = max(x, (int32_t)0);
+    int32_t y0 = max(y, (int32_t)0);
+    int32_t x1 = min(x + w, (int32_t)EPD_WIDTH);
+    int32_t y1 = min(y + h, (int32_t)EPD_HEIGHT);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    if (has_dirty)
+    {
+        x0 = min(x0, (int32_t)dirty_area.x);
+        y0 = min(y0, (int32_t)dirty_area.y);
+        x1 = max(x1, (int32_t)(dirty_area.x + dirty_area.width));
+        y1 = max(y1, (int32_t)(dirty_area.y + dirty_area.height));
+    }
+
+    // Two pixels share a byte, so keep the area on byte boundaries
+    x0 &= ~1;
+    x1 = min((int32_t)((x1 + 1) & ~1), (int32_t)EPD_WIDTH);
+
+    dirty_area = {x0, y0, x1 - x0, y1 - y0};
+    has_dirty = true;
+}
+
 void DisplayManager::displaySleepMode()
 {
     if (!display_initialized)
         return;
 
+    setFrameFormat(FrameFormat::GRAY4);
     clear();
 
     // Display title
-    int32_t cursor_x = 50;
-    int32_t cursor_y = STATION_Y;
-    write_string(FONT_LARGE, "Press left button to search for connections", &cursor_x, &cursor_y, framebuffer);
+    addText(FONT_LARGE, "Press left button to search for connections", LINE_X, STATION_Y, EPD_WIDTH - 2 * LINE_X);
 
     // Draw a line under the title
-    epd_draw_hline(40, STATION_Y + 40, EPD_WIDTH - 80, 0, framebuffer);
+    addFill(40, STATION_Y + 40, EPD_WIDTH - 80, 1, 0);
 
     // Clear battery area to ensure no stale battery info in sleep mode
-    epd_fill_rect(EPD_WIDTH - 250, 20, 230, 50, 255, framebuffer);
+    addFill(EPD_WIDTH - 250, 20, 230, 50, 255);
 
     // Display static departure information
     current_y = TOP_MARGIN;
@@ -135,21 +776,17 @@ void DisplayManager::displaySleepMode()
             String frequency = departure.substring(firstPipe + 1);
 
             // Draw line number
-            cursor_x = LINE_X;
-            cursor_y = current_y;
-            write_string(FONT_LARGE, line.c_str(), &cursor_x, &cursor_y, framebuffer);
+            addText(FONT_LARGE, line.c_str(), LINE_X, current_y, DEST_X - COLUMN_GAP - LINE_X);
 
             // Draw frequency
-            cursor_x = DEST_X;
-            cursor_y = current_y;
-            write_string(FONT_LARGE, frequency.c_str(), &cursor_x, &cursor_y, framebuffer);
+            addText(FONT_LARGE, frequency.c_str(), DEST_X, current_y, TIME_RIGHT - DEST_X);
 
             current_y += LINE_HEIGHT;
         }
     }
 
     // Update display
-    epd_draw_grayscale_image(epd_full_screen(), framebuffer);
+    commit();
 }
 
 void DisplayManager::displayBatteryStatus(const String &batteryStatus)
@@ -157,17 +794,14 @@ void DisplayManager::displayBatteryStatus(const String &batteryStatus)
     if (!display_initialized)
         return;
 
-    // Display battery status in top right corner
-    int32_t cursor_x = EPD_WIDTH - 200;
-    int32_t cursor_y = 50;
-
     // Clear battery area first
-    epd_fill_rect(EPD_WIDTH - 250, 20, 230, 50, 255, framebuffer);
+    addFill(EPD_WIDTH - 250, 20, 230, 50, 255);
 
-    write_string(FONT_SMALL, ("" + batteryStatus).c_str(), &cursor_x, &cursor_y, framebuffer);
+    // Display battery status in top right corner
+    addText(FONT_SMALL, batteryStatus.c_str(), EPD_WIDTH - 200, 50, 180);
 
     // Update just the battery area
-    epd_draw_grayscale_image(epd_full_screen(), framebuffer);
+    commit();
 }
 
 void DisplayManager::displayConnecting()
@@ -175,18 +809,17 @@ void DisplayManager::displayConnecting()
     if (!display_initialized)
         return;
 
+    setFrameFormat(FrameFormat::GRAY4);
     clear();
 
     // Display connecting message
-    int32_t cursor_x = 50;
-    int32_t cursor_y = STATION_Y;
-    write_string(FONT_LARGE, "Live Mode - Connecting to WiFi...", &cursor_x, &cursor_y, framebuffer);
+    addText(FONT_LARGE, "Live Mode - Connecting to WiFi...", LINE_X, STATION_Y, EPD_WIDTH - 2 * LINE_X);
 
     // Draw a line under the title
-    epd_draw_hline(40, STATION_Y + 40, EPD_WIDTH - 80, 0, framebuffer);
+    addFill(40, STATION_Y + 40, EPD_WIDTH - 80, 1, 0);
 
     // Update display
-    epd_draw_grayscale_image(epd_full_screen(), framebuffer);
+    commit();
 }
 
 void DisplayManager::powerOn()
@@ -201,6 +834,8 @@ void DisplayManager::powerOff()
 {
     if (display_initialized)
     {
+        // The panel task may still be running a waveform
+        flush();
         epd_poweroff_all();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,208 @@
+#include "FetchScheduler.h"
+#include <math.h>
+
+static const uint32_t SCHEDULE_MAGIC = 0x46534333; // "FSC3"
+
+struct StationPlan
+{
+    uint32_t next_fetch;
+    uint16_t interval_s;
+    uint16_t volatility_s; // Moving average of the mean realtime delay
+};
+
+// Exponentially decayed sums behind the hourly rates
+struct DecayedRates
+{
+    float live_s;
+    float requests;
+    float radio_ms;
+    float refreshes;
+};
+
+struct ScheduleState
+{
+    uint32_t magic;
+    StationPlan stations[DepartureTable::MAX_STATIONS];
+    uint32_t last_cycle;
+    FetchRates rates;
+    DecayedRates decayed;
+    // Token bucket of the request budget, filled as of budget_at
+    uint32_t budget_per_hour;
+    float budget_tokens;
+    uint32_t budget_at;
+};
+
+RTC_DATA_ATTR static ScheduleState schedule_state;
+
+FetchScheduler::FetchScheduler()
+{
+    // RTC memory starts out random after a power cycle
+    if (schedule_state.magic != SCHEDULE_MAGIC)
+    {
+        memset(&schedule_state, 0, sizeof(schedule_state));
+        schedule_state.magic = SCHEDULE_MAGIC;
+    }
+}
+
+void FetchScheduler::startLive(time_t now)
+{
+    for (size_t station = 0; station < DepartureTable::MAX_STATIONS; station++)
+    {
+        schedule_state.stations[station].next_fetch = now;
+    }
+    // Time outside live mode does not count towards the rates
+    schedule_state.last_cycle = 0;
+}
+
+void FetchScheduler::setRequestBudget(uint32_t requests_per_hour, time_t now)
+{
+    if (schedule_state.budget_per_hour == requests_per_hour)
+        return;
+
+    // A new budget starts with a full burst
+    schedule_state.budget_per_hour = requests_per_hour;
+    schedule_state.budget_tokens = (float)requests_per_hour * BUDGET_BURST_S / 3600;
+    schedule_state.budget_at = now;
+}
+
+float FetchScheduler::budgetTokens(time_t now) const
+{
+    float capacity = (float)schedule_state.budget_per_hour * BUDGET_BURST_S / 3600;
+    float refill = now > (time_t)schedule_state.budget_at
+                       ? (float)schedule_state.budget_per_hour * (now - (time_t)schedule_state.budget_at) / 3600
+                       : 0;
+    return min(schedule_state.budget_tokens + refill, capacity);
+}
+
+uint32_t FetchScheduler::dueStations(size_t station_count, time_t now) const
+{
+    uint32_t mask = 0;
+    for (size_t station = 0; station < station_count && station < DepartureTable::MAX_STATIONS; station++)
+    {
+        if ((time_t)schedule_state.stations[station].next_fetch <= now + COALESCE_WINDOW)
+        {
+            mask |= 1UL << station;
+        }
+    }
+    return mask;
+}
+
+time_t FetchScheduler::nextFetchTime(size_t station_count) const
+{
+    time_t next = 0;
+    for (size_t station = 0; station < station_count && station < DepartureTable::MAX_STATIONS; station++)
+    {
+        time_t fetch_at = schedule_state.stations[station].next_fetch;
+        if (station == 0 || fetch_at < next)
+            next = fetch_at;
+    }
+
+    // A spent budget holds the fetch back until a whole request has refilled
+    uint32_t per_hour = schedule_state.budget_per_hour;
+    next = max(next, (time_t)schedule_state.budget_at);
+    float tokens = budgetTokens(next);
+    if (per_hour && tokens < 1)
+    {
+        next += (time_t)ceilf((1 - tokens) * 3600 / per_hour);
+    }
+    return next;
+}
+
+void FetchScheduler::planStation(size_t station, const DepartureTable &table, bool updated, uint16_t mean_delay_s, time_t now)
+{
+    if (station >= DepartureTable::MAX_STATIONS)
+        return;
+
+    StationPlan &plan = schedule_state.stations[station];
+    if (!updated)
+    {
+        plan.interval_s = MIN_INTERVAL;
+        plan.next_fetch = now + MIN_INTERVAL;
+        return;
+    }
+
+    plan.volatility_s = (3 * (uint32_t)plan.volatility_s + mean_delay_s) / 4;
+
+    size_t count = station < table.stationCount() ? table.departureCount(station) : 0;
+    time_t soonest = 0;
+    for (size_t i = 0; i < count && !soonest; i++)
+    {
+        if ((time_t)table.departureTime(station, i) > now)
+            soonest = table.departureTime(station, i) - now;
+    }
+
+    time_t interval = MAX_INTERVAL;
+    if (soonest)
+    {
+        interval = soonest / SOONEST_DIVISOR * VOLATILITY_SCALE / (VOLATILITY_SCALE + plan.volatility_s);
+    }
+    // A short response is all the station has coming, so it cannot run low
+    if (count > MIN_UPCOMING_DEPARTURES)
+    {
+        time_t runout = (time_t)table.departureTime(station, count - MIN_UPCOMING_DEPARTURES) - now;
+        interval = min(interval, runout);
+    }
+
+    interval = max(min(interval, (time_t)MAX_INTERVAL), (time_t)MIN_INTERVAL);
+    plan.interval_s = interval;
+    plan.next_fetch = now + interval;
+}
+
+void FetchScheduler::recordCycle(uint32_t requests, uint32_t radio_ms, bool all_stations, time_t now)
+{
+    FetchRates &rates = schedule_state.rates;
+    DecayedRates &decayed = schedule_state.decayed;
+    time_t live_s = 0;
+    if (schedule_state.last_cycle && now > (time_t)schedule_state.last_cycle)
+    {
+        live_s = min(now - (time_t)schedule_state.last_cycle, (time_t)MAX_INTERVAL);
+    }
+    schedule_state.last_cycle = now;
+
+    float decay = expf(-(float)live_s / RATE_DECAY_S);
+    decayed.live_s = decayed.live_s * decay + live_s;
+    decayed.requests = decayed.requests * decay + requests;
+    decayed.radio_ms = decayed.radio_ms * decay + radio_ms;
+    decayed.refreshes *= decay;
+
+    // Spent even when the fetch was asked for by a button, later fetches then wait longer
+    schedule_state.budget_tokens = budgetTokens(now) - requests;
+    schedule_state.budget_at = now;
+
+    rates.live_s += live_s;
+    rates.cycles++;
+    rates.requests += requests;
+    rates.radio_ms += radio_ms;
+    if (all_stations)
+    {
+        rates.full_cycles++;
+        rates.full_radio_ms += radio_ms;
+    }
+}
+
+void FetchScheduler::recordRefreshes(uint32_t refreshes)
+{
+    schedule_state.rates.refreshes += refreshes;
+    schedule_state.decayed.refreshes += refreshes;
+}
+
+time_t FetchScheduler::interval(size_t station) const
+{
+    return station < DepartureTable::MAX_STATIONS ? schedule_state.stations[station].interval_s : 0;
+}
+
+uint16_t FetchScheduler::volatility(size_t station) const
+{
+    return station < DepartureTable::MAX_STATIONS ? schedule_state.stations[station].volatility_s : 0;
+}
+
+FetchRates FetchScheduler::getRates() const
+{
+    FetchRates rates = schedule_state.rates;
+    const DecayedRates &decayed = schedule_state.decayed;
+    float hours = decayed.live_s / 3600.0f;
+    rates.requests_per_hour = hours > 0 ? decayed.requests / hours : 0;
+    rates.radio_s_per_hour = hours > 0 ? decayed.radio_ms / 1000.0f / hours : 0;
+    rates.refreshes_per_hour = hours > 0 ? decayed.refreshes / hours : 0;
+    return rates;
+}
@@ -0,0 +1,118 @@
+#include "FrameKernels.h"
+#include <cstring>
+
+// 4bpp bytes for every 1bpp byte, built before any task runs
+struct MonoExpansion
+{
+    uint32_t bytes[256];
+
+    MonoExpansion()
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            uint8_t row[4];
+            for (int pixel = 0; pixel < 8; pixel += 2)
+            {
+                uint8_t left = (value & (0x80 >> pixel)) ? 0x0 : 0xF;
+                uint8_t right = (value & (0x40 >> pixel)) ? 0x0 : 0xF;
+                row[pixel / 2] = left | right << 4;
+            }
+            memcpy(&bytes[value], row, 4);
+        }
+    }
+};
+
+static const MonoExpansion mono_expansion;
+
+namespace FrameKernels
+{
+    void fill(uint8_t *dst, uint8_t value, size_t length)
+    {
+        memset(dst, value, length);
+    }
+
+    void fillRect(uint8_t *framebuffer, int32_t x, int32_t y, int32_t width, int32_t height, uint8_t color)
+    {
+        int32_t x0 = max(x, (int32_t)0);
+        int32_t y0 = max(y, (int32_t)0);
+        int32_t x1 = min(x + width, (int32_t)EPD_WIDTH);
+        int32_t y1 = min(y + height, (int32_t)EPD_HEIGHT);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        // Like epd_draw_pixel(): an even column takes the high nibble of color into the low nibble of its byte
+        uint8_t low = color >> 4;
+        uint8_t high = color & 0xF0;
+        uint8_t both = high | low;
+        int32_t first_full = (x0 + 1) / 2;
+        int32_t end_full = x1 / 2;
+
+        uint8_t *row = framebuffer + y0 * EPD_WIDTH / 2;
+        for (int32_t yy = y0; yy < y1; yy++, row += EPD_WIDTH / 2)
+        {
+            if (x0 & 1)
+                row[x0 / 2] = (row[x0 / 2] & 0x0F) | high;
+            if (end_full > first_full)
+                fill(row + first_full, both, end_full - first_full);
+            if (x1 & 1)
+                row[x1 / 2] = (row[x1 / 2] & 0xF0) | low;
+        }
+    }
+
+    void blitMasked(uint8_t *dst, const uint8_t *pixels, const uint8_t *mask, size_t length)
+    {
+        // Glyph rows are a few bytes at any offset, too short for anything but a byte loop
+        for (size_t i = 0; i < length; i++)
+        {
+            dst[i] = (dst[i] & ~mask[i]) | pixels[i];
+        }
+    }
+
+    bool equalRect(const uint8_t *a, const uint8_t *b, size_t width, size_t rows, size_t stride)
+    {
+        for (size_t row = 0; row < rows; row++, a += stride, b += stride)
+        {
+            if (memcmp(a, b, width) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    void fillRectMono(uint8_t *frame, int32_t x, int32_t y, int32_t width, int32_t height, bool black)
+    {
+        int32_t x0 = max(x, (int32_t)0);
+        int32_t y0 = max(y, (int32_t)0);
+        int32_t x1 = min(x + width, (int32_t)EPD_WIDTH);
+        int32_t y1 = min(y + height, (int32_t)EPD_HEIGHT);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        int32_t first = x0 / 8;
+        int32_t last = (x1 - 1) / 8;
+        uint8_t head = 0xFF >> (x0 % 8);
+        uint8_t tail = 0xFF << (7 - (x1 - 1) % 8);
+        if (first == last)
+        {
+            head &= tail;
+        }
+
+        uint8_t *row = frame + y0 * MONO_ROW_BYTES;
+        for (int32_t yy = y0; yy < y1; yy++, row += MONO_ROW_BYTES)
+        {
+            row[first] = black ? row[first] | head : row[first] & ~head;
+            if (last > first)
+            {
+                memset(row + first + 1, black ? 0xFF : 0x00, last - first - 1);
+                row[last] = black ? row[last] | tail : row[last] & ~tail;
+            }
+        }
+    }
+
+    void expandMono(uint8_t *dst, const uint8_t *src, size_t length)
+    {
+        for (size_t i = 0; i < length; i++, dst += 4)
+        {
+            memcpy(dst, &mono_expansion.bytes[src[i]], 4);
+        }
+    }
+}
@@ -0,0 +1,480 @@
+#include "GlyphCache.h"
+#include "FrameKernels.h"
+#include "GlyphIndex.h"
+#include "Utf8.h"
+#include <climits>
+#include <cstring>
+
+static const size_t SCRATCH_STRIDE = EPD_WIDTH / 2;
+
+// Valid UTF-8 without line breaks, which the cache lays out the same way as the driver
+static bool singleLine(const char *text, size_t *length)
+{
+    *length = 0;
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+        if (!bytes || code_point == '\n')
+            return false;
+        s += bytes;
+        *length += bytes;
+    }
+    return true;
+}
+
+// For each byte of glyph rows, its two pixels as bits with the left one high: the ones
+// darker than mid gray, and the ones the mask covers
+struct MonoPairs
+{
+    uint8_t black[256];
+    uint8_t covered[256];
+
+    MonoPairs()
+    {
+        for (int value = 0; value < 256; value++)
+        {
+            black[value] = ((value & 0x0F) < 8) << 1 | ((value >> 4) < 8);
+            covered[value] = ((value & 0x0F) != 0) << 1 | ((value >> 4) != 0);
+        }
+    }
+};
+
+static const MonoPairs mono_pairs;
+
+static uint32_t hashText(const GFXfont *font, const char *text, int phase)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)font ^ phase;
+    for (const char *c = text; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+GlyphCache::GlyphCache()
+    : scratch{nullptr, nullptr}, glyph_slots(nullptr), arena(nullptr), arena_used(0), run_slots(nullptr),
+      run_clock(0), run_seen{}, run_seen_next(0), stats{}
+{
+}
+
+bool GlyphCache::init()
+{
+    scratch[0] = (uint8_t *)ps_malloc(SCRATCH_ROWS * SCRATCH_STRIDE);
+    scratch[1] = (uint8_t *)ps_malloc(SCRATCH_ROWS * SCRATCH_STRIDE);
+    glyph_slots = (GlyphSlot *)ps_calloc(GLYPH_SLOTS, sizeof(GlyphSlot));
+    arena = (uint8_t *)ps_malloc(GLYPH_ARENA_SIZE);
+    run_slots = (RunSlot *)ps_calloc(RUN_SLOTS, sizeof(RunSlot));
+    if (!scratch[0] || !scratch[1] || !glyph_slots || !arena || !run_slots)
+    {
+        Serial.println("No memory for the glyph cache, text is drawn by the driver");
+        free(scratch[0]);
+        free(scratch[1]);
+        free(glyph_slots);
+        free(arena);
+        free(run_slots);
+        glyph_slots = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void GlyphCache::drawText(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer)
+{
+    if (!text || !framebuffer)
+        return;
+
+    size_t length;
+    if (!glyph_slots || !singleLine(text, &length))
+    {
+        drawUncached(font, text, cursor_x, cursor_y, framebuffer);
+        return;
+    }
+
+    if (length <= RUN_MAX_LENGTH)
+    {
+        const Bitmap *run = findRun(font, text, *cursor_x & 1);
+        if (run && fits(*run, *cursor_x, cursor_y))
+        {
+            blit(*run, *cursor_x, cursor_y, framebuffer);
+            *cursor_x += run->advance;
+            return;
+        }
+    }
+    drawGlyphs(font, text, cursor_x, cursor_y, framebuffer);
+}
+
+void GlyphCache::drawTextMono(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *frame)
+{
+    if (!text || !frame || !glyph_slots)
+        return;
+
+    // Bits have no nibble phase, so one rasterization serves every position
+    size_t length;
+    if (singleLine(text, &length) && length <= RUN_MAX_LENGTH)
+    {
+        const Bitmap *run = findRun(font, text, 0);
+        if (run)
+        {
+            blitMono(*run, *cursor_x, cursor_y, frame);
+            *cursor_x += run->advance;
+            return;
+        }
+    }
+
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+        if (!bytes)
+        {
+            // Not UTF-8; the byte is dropped
+            s++;
+            continue;
+        }
+        s += bytes;
+
+        const Bitmap *glyph = findGlyph(font, code_point, 0);
+        if (glyph)
+        {
+            blitMono(*glyph, *cursor_x, cursor_y, frame);
+            *cursor_x += glyph->advance;
+            continue;
+        }
+
+        // Missing from the font or too large for the scratch strip
+        stats.uncached++;
+        const GFXglyph *missing = GlyphIndex::find(font, code_point);
+        if (missing)
+            *cursor_x += missing->advance_x;
+    }
+}
+
+void GlyphCache::drawGlyphs(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer)
+{
+    const uint8_t *s = (const uint8_t *)text;
+    while (*s)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+
+        const Bitmap *glyph = findGlyph(font, code_point, *cursor_x & 1);
+        if (glyph && fits(*glyph, *cursor_x, cursor_y))
+        {
+            blit(*glyph, *cursor_x, cursor_y, framebuffer);
+            *cursor_x += glyph->advance;
+        }
+        else
+        {
+            char single[5] = {};
+            memcpy(single, s, bytes);
+            drawUncached(font, single, cursor_x, cursor_y, framebuffer);
+        }
+        s += bytes;
+    }
+}
+
+void GlyphCache::drawUncached(const GFXfont *font, const char *text, int32_t *cursor_x, int32_t cursor_y, uint8_t *framebuffer)
+{
+    stats.uncached++;
+    write_string(font, text, cursor_x, &cursor_y, framebuffer);
+}
+
+const GlyphCache::Bitmap *GlyphCache::findGlyph(const GFXfont *font, uint32_t code_point, int phase)
+{
+    // Open addressing; slots are never freed, so probing stops at the first empty one
+    size_t index = (((uint32_t)(uintptr_t)font >> 4) ^ (code_point * 2654435761u) ^ phase) % GLYPH_SLOTS;
+    for (size_t probe = 0; probe < GLYPH_SLOTS; probe++)
+    {
+        GlyphSlot &slot = glyph_slots[(index + probe) % GLYPH_SLOTS];
+        if (!slot.font)
+        {
+            stats.glyph_misses++;
+            char single[5] = {};
+            int32_t length = 0;
+            if (code_point < 0x80)
+            {
+                single[length++] = code_point;
+            }
+            else if (code_point < 0x800)
+            {
+                single[length++] = 0xC0 | (code_point >> 6);
+                single[length++] = 0x80 | (code_point & 0x3F);
+            }
+            else if (code_point < 0x10000)
+            {
+                single[length++] = 0xE0 | (code_point >> 12);
+                single[length++] = 0x80 | ((code_point >> 6) & 0x3F);
+                single[length++] = 0x80 | (code_point & 0x3F);
+            }
+            else
+            {
+                single[length++] = 0xF0 | (code_point >> 18);
+                single[length++] = 0x80 | ((code_point >> 12) & 0x3F);
+                single[length++] = 0x80 | ((code_point >> 6) & 0x3F);
+                single[length++] = 0x80 | (code_point & 0x3F);
+            }
+
+            Bitmap bitmap;
+            if (!measure(font, single, phase, bitmap))
+                return nullptr;
+            size_t size = 2 * bitmap.stride * bitmap.height;
+            if (size > GLYPH_ARENA_SIZE)
+                return nullptr;
+
+            // A full cache starts over, with a quarter of the table kept free so probes stay short;
+            // the glyphs on screen come back within a frame
+            GlyphSlot *target = &slot;
+            if (probe >= GLYPH_SLOTS / 4 * 3 || arena_used + size > GLYPH_ARENA_SIZE)
+            {
+                resetGlyphs();
+                target = &glyph_slots[index];
+            }
+
+            bitmap.rows = arena + arena_used;
+            arena_used += size;
+            stats.arena_used = arena_used;
+            render(font, single, phase, bitmap);
+
+            target->font = font;
+            target->code_point = code_point;
+            target->phase = phase;
+            target->bitmap = bitmap;
+            return &target->bitmap;
+        }
+        if (slot.font == font && slot.code_point == code_point && slot.phase == phase)
+        {
+            stats.glyph_hits++;
+            return &slot.bitmap;
+        }
+    }
+    return nullptr;
+}
+
+void GlyphCache::resetGlyphs()
+{
+    memset(glyph_slots, 0, GLYPH_SLOTS * sizeof(GlyphSlot));
+    arena_used = 0;
+    stats.arena_used = 0;
+    stats.glyph_flushes++;
+}
+
+const GlyphCache::Bitmap *GlyphCache::findRun(const GFXfont *font, const char *text, int phase)
+{
+    RunSlot *victim = &run_slots[0];
+    for (size_t i = 0; i < RUN_SLOTS; i++)
+    {
+        RunSlot &slot = run_slots[i];
+        if (slot.font == font && slot.phase == phase && strcmp(slot.text, text) == 0)
+        {
+            stats.run_hits++;
+            slot.last_used = ++run_clock;
+            return &slot.bitmap;
+        }
+        if (slot.last_used < victim->last_used)
+            victim = &slot;
+    }
+    stats.run_misses++;
+
+    // Only strings seen twice become runs; one-offs are cheaper to draw glyph by glyph
+    uint32_t hash = hashText(font, text, phase);
+    bool seen = false;
+    for (size_t i = 0; i < RUN_SEEN_SLOTS && !seen; i++)
+    {
+        seen = run_seen[i] == hash;
+    }
+    if (!seen)
+    {
+        run_seen[run_seen_next] = hash;
+        run_seen_next = (run_seen_next + 1) % RUN_SEEN_SLOTS;
+        return nullptr;
+    }
+
+    Bitmap bitmap;
+    if (!measure(font, text, phase, bitmap))
+        return nullptr;
+    size_t size = 2 * bitmap.stride * bitmap.height;
+    if (size > RUN_BUDGET)
+        return nullptr;
+
+    // Least recently used runs make room, empty slots go first since they were never used
+    for (;;)
+    {
+        if (victim->font)
+        {
+            free(victim->bitmap.rows);
+            stats.run_bytes -= 2 * victim->bitmap.stride * victim->bitmap.height;
+            victim->font = nullptr;
+            victim->last_used = 0;
+        }
+        if (stats.run_bytes + size <= RUN_BUDGET)
+            break;
+        for (size_t i = 0; i < RUN_SLOTS; i++)
+        {
+            if (run_slots[i].font && (!victim->font || run_slots[i].last_used < victim->last_used))
+                victim = &run_slots[i];
+        }
+    }
+
+    bitmap.rows = size ? (uint8_t *)ps_malloc(size) : nullptr;
+    if (size && !bitmap.rows)
+        return nullptr;
+    stats.run_bytes += size;
+    render(font, text, phase, bitmap);
+
+    victim->font = font;
+    victim->phase = phase;
+    strcpy(victim->text, text);
+    victim->last_used = ++run_clock;
+    victim->bitmap = bitmap;
+    return &victim->bitmap;
+}
+
+bool GlyphCache::measure(const GFXfont *font, const char *text, int phase, Bitmap &bitmap)
+{
+    // Union of the glyph boxes, which is all the driver draws into
+    int32_t x = 0;
+    int32_t min_x = INT_MAX;
+    int32_t max_x = INT_MIN;
+    int32_t min_y = INT_MAX;
+    int32_t max_y = INT_MIN;
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        s += Utf8::decode(s, &code_point);
+
+        // A missing glyph makes the driver look for a fallback; leave that to it
+        const GFXglyph *glyph = GlyphIndex::find(font, code_point);
+        if (!glyph)
+            return false;
+
+        if (glyph->width && glyph->height)
+        {
+            min_x = min(min_x, x + glyph->left);
+            max_x = max(max_x, x + glyph->left + glyph->width);
+            min_y = min(min_y, (int32_t)-glyph->top);
+            max_y = max(max_y, (int32_t)(glyph->height - glyph->top));
+        }
+        x += glyph->advance_x;
+    }
+
+    bitmap = {nullptr, 0, 0, 0, 0, (int16_t)x};
+    if (min_x > max_x)
+        return true;
+
+    int32_t start = SCRATCH_X + phase;
+    if (start + min_x < 0 || start + max_x > EPD_WIDTH ||
+        SCRATCH_BASELINE + min_y < 0 || SCRATCH_BASELINE + max_y > SCRATCH_ROWS)
+        return false;
+
+    int32_t first_byte = (start + min_x) / 2;
+    int32_t last_byte = (start + max_x + 1) / 2;
+    bitmap.byte_offset = first_byte - SCRATCH_X / 2;
+    bitmap.top = min_y;
+    bitmap.stride = last_byte - first_byte;
+    bitmap.height = max_y - min_y;
+    return true;
+}
+
+void GlyphCache::render(const GFXfont *font, const char *text, int phase, Bitmap &bitmap)
+{
+    // The same text over black and over white; the driver only writes where the two agree
+    size_t first = (SCRATCH_BASELINE + bitmap.top) * SCRATCH_STRIDE + SCRATCH_X / 2 + bitmap.byte_offset;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int row = 0; row < bitmap.height; row++)
+        {
+            memset(scratch[pass] + first + row * SCRATCH_STRIDE, pass ? 0xFF : 0x00, bitmap.stride);
+        }
+        int32_t x = SCRATCH_X + phase;
+        int32_t y = SCRATCH_BASELINE;
+        write_string(font, text, &x, &y, scratch[pass]);
+    }
+
+    uint8_t *pixels = bitmap.rows;
+    uint8_t *mask = bitmap.rows + bitmap.stride * bitmap.height;
+    for (int row = 0; row < bitmap.height; row++)
+    {
+        const uint8_t *over_black = scratch[0] + first + row * SCRATCH_STRIDE;
+        const uint8_t *over_white = scratch[1] + first + row * SCRATCH_STRIDE;
+        for (int i = 0; i < bitmap.stride; i++)
+        {
+            uint8_t differs = over_black[i] ^ over_white[i];
+            uint8_t written = ((differs & 0x0F) ? 0 : 0x0F) | ((differs & 0xF0) ? 0 : 0xF0);
+            *pixels++ = over_black[i] & written;
+            *mask++ = written;
+        }
+    }
+}
+
+bool GlyphCache::fits(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y)
+{
+    // Anything the driver would clip is left to it
+    int32_t first_byte = cursor_x / 2 + bitmap.byte_offset;
+    int32_t first_row = cursor_y + bitmap.top;
+    return cursor_x >= 0 && first_byte >= 0 && first_byte + bitmap.stride <= (int32_t)SCRATCH_STRIDE &&
+           first_row >= 0 && first_row + bitmap.height <= EPD_HEIGHT;
+}
+
+void GlyphCache::blit(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y, uint8_t *framebuffer)
+{
+    const uint8_t *pixels = bitmap.rows;
+    const uint8_t *mask = bitmap.rows + bitmap.stride * bitmap.height;
+    uint8_t *row = framebuffer + (cursor_y + bitmap.top) * SCRATCH_STRIDE + cursor_x / 2 + bitmap.byte_offset;
+    for (int y = 0; y < bitmap.height; y++)
+    {
+        FrameKernels::blitMasked(row, pixels, mask, bitmap.stride);
+        pixels += bitmap.stride;
+        mask += bitmap.stride;
+        row += SCRATCH_STRIDE;
+    }
+}
+
+void GlyphCache::blitMono(const Bitmap &bitmap, int32_t cursor_x, int32_t cursor_y, uint8_t *frame)
+{
+    const uint8_t *pixels = bitmap.rows;
+    const uint8_t *mask = bitmap.rows + bitmap.stride * bitmap.height;
+    for (int y = 0; y < bitmap.height; y++, pixels += bitmap.stride, mask += bitmap.stride)
+    {
+        int32_t yy = cursor_y + bitmap.top + y;
+        if (yy < 0 || yy >= EPD_HEIGHT)
+            continue;
+
+        uint8_t *row = frame + yy * FrameKernels::MONO_ROW_BYTES;
+        int32_t x = cursor_x + 2 * bitmap.byte_offset;
+        for (int i = 0; i < bitmap.stride; i++, x += 2)
+        {
+            uint8_t covered = mono_pairs.covered[mask[i]];
+            if (!covered)
+                continue;
+
+            uint8_t black = mono_pairs.black[pixels[i]] & covered;
+            if (x >= 0 && x + 1 < EPD_WIDTH)
+            {
+                // Both pixels in a 16-bit window, which the second byte only enters at an odd x
+                int shift = 14 - x % 8;
+                uint16_t write = covered << shift;
+                uint16_t set = black << shift;
+                uint8_t *dst = row + x / 8;
+                dst[0] = (dst[0] & ~(write >> 8)) | (set >> 8);
+                if (write & 0xFF)
+                    dst[1] = (dst[1] & ~write) | set;
+                continue;
+            }
+
+            // Clipped at the panel edge, like the driver clips
+            for (int pixel = 0; pixel < 2; pixel++)
+            {
+                int32_t xx = x + pixel;
+                uint8_t bit = 0x02 >> pixel;
+                if (xx < 0 || xx >= EPD_WIDTH || !(covered & bit))
+                    continue;
+                if (black & bit)
+                    row[xx / 8] |= 0x80 >> (xx % 8);
+                else
+                    row[xx / 8] &= ~(0x80 >> (xx % 8));
+            }
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#include "GlyphIndex.h"
+#include "Utf8.h"
+
+struct FontIndex
+{
+    const GFXfont *font;
+    uint16_t direct[GlyphIndex::DIRECT_LIMIT]; // Glyph number + 1, 0 when missing
+};
+
+static FontIndex font_indexes[GlyphIndex::MAX_FONTS];
+static size_t font_count = 0;
+
+// The intervals are sorted, as the driver's early exit already assumes
+static GFXglyph *search(const GFXfont *font, uint32_t code_point)
+{
+    size_t low = 0;
+    size_t high = font->interval_count;
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        const UnicodeInterval &interval = font->intervals[middle];
+        if (code_point < interval.first)
+        {
+            high = middle;
+        }
+        else if (code_point > interval.last)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return &font->glyph[interval.offset + (code_point - interval.first)];
+        }
+    }
+    return nullptr;
+}
+
+// Spellings for characters a font may lack, German ones first
+struct Substitute
+{
+    uint32_t code_point;
+    const char *text;
+};
+
+static const Substitute SUBSTITUTES[] = {
+    {0x00A0, " "}, {0x00C4, "Ae"}, {0x00C6, "AE"}, {0x00D6, "Oe"}, {0x00DC, "Ue"}, {0x00DF, "ss"},
+    {0x00E4, "ae"}, {0x00E6, "ae"}, {0x00F6, "oe"}, {0x00FC, "ue"}, {0x1E9E, "SS"},
+    {0x2010, "-"}, {0x2011, "-"}, {0x2013, "-"}, {0x2014, "-"}, {0x2018, "'"}, {0x2019, "'"},
+    {0x201A, ","}, {0x201C, "\""}, {0x201D, "\""}, {0x201E, "\""}, {0x2026, "..."}};
+
+// Base letters of Latin-1 0xC0 to 0xFF, '.' where there is none
+static const char LATIN1_LETTERS[] = "AAAAAAACEEEEIIIIDNOOOOO.OUUUUY.."
+                                     "aaaaaaaceeeeiiiidnooooo.ouuuuy.y";
+
+static const char *substitute(uint32_t code_point, char *letter)
+{
+    for (const Substitute &entry : SUBSTITUTES)
+    {
+        if (entry.code_point == code_point)
+            return entry.text;
+    }
+    if (code_point >= 0xC0 && code_point <= 0xFF && LATIN1_LETTERS[code_point - 0xC0] != '.')
+    {
+        letter[0] = LATIN1_LETTERS[code_point - 0xC0];
+        return letter;
+    }
+    return nullptr;
+}
+
+namespace GlyphIndex
+{
+    bool add(const GFXfont *font)
+    {
+        for (size_t i = 0; i < font_count; i++)
+        {
+            if (font_indexes[i].font == font)
+                return true;
+        }
+        if (font_count == MAX_FONTS)
+            return false;
+
+        FontIndex &index = font_indexes[font_count];
+        for (uint32_t code_point = 0; code_point < DIRECT_LIMIT; code_point++)
+        {
+            GFXglyph *glyph = search(font, code_point);
+            index.direct[code_point] = glyph ? glyph - font->glyph + 1 : 0;
+        }
+        index.font = font;
+        font_count++;
+        return true;
+    }
+
+    GFXglyph *find(const GFXfont *font, uint32_t code_point)
+    {
+        if (code_point < DIRECT_LIMIT)
+        {
+            for (size_t i = 0; i < font_count; i++)
+            {
+                if (font_indexes[i].font != font)
+                    continue;
+
+                uint16_t glyph = font_indexes[i].direct[code_point];
+                return glyph ? &font->glyph[glyph - 1] : nullptr;
+            }
+        }
+        return search(font, code_point);
+    }
+
+    bool covers(const GFXfont *font, const char *text)
+    {
+        for (const uint8_t *s = (const uint8_t *)text; *s;)
+        {
+            uint32_t code_point;
+            size_t bytes = Utf8::decode(s, &code_point);
+            if (!bytes || !find(font, code_point))
+                return false;
+            s += bytes;
+        }
+        return true;
+    }
+
+    void normalize(const GFXfont *font, const char *text, char *out, size_t size)
+    {
+        size_t used = 0;
+        for (const uint8_t *s = (const uint8_t *)text; *s;)
+        {
+            uint32_t code_point;
+            size_t bytes = Utf8::decode(s, &code_point);
+            if (!bytes)
+            {
+                s++;
+                continue;
+            }
+
+            const char *copy = (const char *)s;
+            size_t length = bytes;
+            char letter[2] = {};
+            if (font && !find(font, code_point))
+            {
+                copy = substitute(code_point, letter);
+                length = copy ? strlen(copy) : 0;
+                for (size_t i = 0; i < length; i++)
+                {
+                    if (!find(font, (uint8_t)copy[i]))
+                        length = 0;
+                }
+            }
+            s += bytes;
+
+            if (used + length >= size)
+                break;
+            memcpy(out + used, copy, length);
+            used += length;
+        }
+        out[used] = '\0';
+    }
+}
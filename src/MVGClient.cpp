@@ -1,78 +1,376 @@
 #include "MVGClient.h"
 #include "config.h"
+#include "ChunkedStream.h"
+#include "GlyphIndex.h"
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <time.h>
+#include <freertos/task.h>
 
-MVGClient::MVGClient() {}
+static const size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
+static_assert(CONFIG_COUNT <= DepartureTable::MAX_STATIONS, "Too many stations configured for the departure table");
 
-void MVGClient::fetchDepartures()
+// Checks a comma separated transportTypes list for one type
+static bool containsType(const String &types, const char *type, size_t type_length)
+{
+    const char *token = types.c_str();
+    while (*token)
+    {
+        const char *end = strchr(token, ',');
+        size_t length = end ? end - token : strlen(token);
+        if (length == type_length && strncmp(token, type, length) == 0)
+            return true;
+        if (!end)
+            break;
+        token = end + 1;
+    }
+    return false;
+}
+
+// Longest name or destination kept, which is more than a column shows
+static const size_t MAX_TEXT_SIZE = DepartureTable::MAX_NAME_LENGTH + 1;
+
+const char *MVGClient::RESPONSE_HEADERS[] = {"Transfer-Encoding", "Date"};
+
+MVGClient::MVGClient(TimeKeeper &time_keeper, size_t max_in_flight)
+    : time_keeper(time_keeper),
+      text_font(nullptr),
+      max_in_flight(max(min(max_in_flight, (size_t)MAX_IN_FLIGHT), (size_t)1)),
+      worker_count(0),
+      job_queue(nullptr),
+      done_queue(nullptr),
+      results_lock(nullptr),
+      fetch_stats{},
+      cycle_history{},
+      cycle_count(0),
+      request_group_count(0),
+      updated_mask(0),
+      station_delays{}
+{
+    for (Connection &connection : connections)
+    {
+        connection.owner = this;
+    }
+
+    // Fields copied out of each departure, everything else is skipped while parsing
+    JsonObject fields = filter.createNestedObject();
+    fields["label"] = true;
+    fields["transportType"] = true;
+    fields["destination"] = true;
+    fields["departureTime"] = true;
+    fields["realtimeDepartureTime"] = true;
+}
+
+void MVGClient::fetchDepartures(uint32_t station_mask)
 {
     Serial.println("\n=== Fetching MVG departures ===");
-    station_list.clear();
+    if (station_mask == ALL_STATIONS)
+    {
+        station_table.clear();
+    }
+    else
+    {
+        // Labels of departures that have since been replaced would otherwise fill the table over time
+        station_table.compactLines();
+    }
+    updated_mask = 0;
+
+    // configs[] lives in another translation unit, so plan on first use rather than at construction
+    if (request_group_count == 0)
+    {
+        planRequests();
+        startWorkers();
+    }
+
+    unsigned long cycle_start = millis();
+    size_t queued = 0;
+    for (size_t g = 0; g < request_group_count; g++)
+    {
+        if (request_groups[g].config_mask & station_mask)
+        {
+            uint8_t group_index = g;
+            xQueueSend(job_queue, &group_index, portMAX_DELAY);
+            queued++;
+        }
+    }
+
+    // The calling task works through the queue as well, so max_in_flight requests run at once
+    size_t finished = 0;
+    uint8_t group_index;
+    while (xQueueReceive(job_queue, &group_index, 0) == pdTRUE)
+    {
+        runRequestGroup(connections[0], group_index);
+        finished++;
+    }
+    while (finished < queued)
+    {
+        xQueueReceive(done_queue, &group_index, portMAX_DELAY);
+        finished++;
+    }
 
-    // Iterate through configured stations
-    for (const Config &config : configs)
+    recordCycle(millis() - cycle_start);
+
+    Serial.printf("Fetch cycle done in %u ms (p50 %u ms, p95 %u ms, %u in flight): %u requests, %u TLS handshakes (%u resumed), %u ms average per request\n",
+                  fetch_stats.last_cycle_ms,
+                  fetch_stats.cycle_p50_ms,
+                  fetch_stats.cycle_p95_ms,
+                  (unsigned)max_in_flight,
+                  fetch_stats.requests,
+                  fetch_stats.handshakes,
+                  fetch_stats.resumed_handshakes,
+                  fetch_stats.requests ? fetch_stats.total_request_ms / fetch_stats.requests : 0);
+}
+
+void MVGClient::startWorkers()
+{
+    job_queue = xQueueCreate(DepartureTable::MAX_STATIONS, sizeof(uint8_t));
+    done_queue = xQueueCreate(DepartureTable::MAX_STATIONS, sizeof(uint8_t));
+    results_lock = xSemaphoreCreateMutex();
+
+    // More connections than requests would only sit idle
+    size_t workers = min(max_in_flight, request_group_count) - 1;
+    UBaseType_t priority = uxTaskPriorityGet(nullptr);
+    for (worker_count = 0; worker_count < workers; worker_count++)
+    {
+        xTaskCreate(workerTask, "fetch", WORKER_TASK_STACK, &connections[worker_count + 1], priority, nullptr);
+    }
+}
+
+void MVGClient::workerTask(void *parameter)
+{
+    Connection &connection = *(Connection *)parameter;
+    MVGClient &client = *connection.owner;
+
+    for (;;)
     {
-        Serial.printf("\nStation: %s\n", config.pretty_name.c_str());
+        uint8_t group_index;
+        xQueueReceive(client.job_queue, &group_index, portMAX_DELAY);
+        client.runRequestGroup(connection, group_index);
+        xQueueSend(client.done_queue, &group_index, portMAX_DELAY);
+    }
+}
+
+void MVGClient::runRequestGroup(Connection &connection, size_t group_index)
+{
+    const RequestGroup &group = request_groups[group_index];
+    Serial.printf("\nStation: %s (%u configs)\n", group.first->bahnhof.c_str(), (unsigned)group.config_count);
+
+    String url = constructUrl(group);
+    if (!makeRequest(connection, url))
+        return;
+
+    // Fan the shared response back out to every config of the group
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        if (group.config_mask & (1UL << i))
+        {
+            appendToStationList(i, configs[i], connection.doc);
+        }
+    }
+    xSemaphoreGive(results_lock);
+}
+
+void MVGClient::recordCycle(uint32_t cycle_ms)
+{
+    cycle_history[cycle_count++ % CYCLE_HISTORY] = cycle_ms;
+
+    uint32_t sorted[CYCLE_HISTORY];
+    size_t count = min(cycle_count, (size_t)CYCLE_HISTORY);
+    memcpy(sorted, cycle_history, count * sizeof(uint32_t));
+    for (size_t i = 1; i < count; i++)
+    {
+        uint32_t value = sorted[i];
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    // Nearest rank, so p95 of fewer than 20 cycles is the slowest one
+    fetch_stats.last_cycle_ms = cycle_ms;
+    fetch_stats.cycle_p50_ms = sorted[(count * 50 + 99) / 100 - 1];
+    fetch_stats.cycle_p95_ms = sorted[(count * 95 + 99) / 100 - 1];
+}
 
-        String url = constructUrl(config);
+void MVGClient::planRequests()
+{
+    request_group_count = 0;
 
-        delay(50);
-        String response = makeRequest(url);
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        const Config &config = configs[i];
+        RequestGroup *group = nullptr;
 
-        if (!response.isEmpty())
+        for (size_t g = 0; g < request_group_count; g++)
         {
-            doc.clear();
-            DeserializationError error = deserializeJson(doc, response);
-            if (error)
+            if (request_groups[g].first->bahnhof == config.bahnhof &&
+                request_groups[g].first->time_offset == config.time_offset)
             {
-                Serial.print(F("deserializeJson() failed: "));
-                Serial.println(error.c_str());
+                group = &request_groups[g];
+                break;
             }
-            else
+        }
+
+        if (!group)
+        {
+            group = &request_groups[request_group_count++];
+            group->first = &config;
+            group->transport_types = config.include_type;
+            group->config_mask = 0;
+            group->config_count = 0;
+        }
+        else if (group->transport_types.isEmpty() || config.include_type.isEmpty())
+        {
+            group->transport_types = "";
+        }
+        else
+        {
+            const char *token = config.include_type.c_str();
+            while (*token)
             {
-                appendToStationList(config.pretty_name.c_str());
+                const char *end = strchr(token, ',');
+                size_t length = end ? end - token : strlen(token);
+                if (length > 0 && !containsType(group->transport_types, token, length))
+                {
+                    group->transport_types += ",";
+                    group->transport_types.concat(token, length);
+                }
+                if (!end)
+                    break;
+                token = end + 1;
             }
         }
+
+        group->config_mask |= 1UL << i;
+        group->config_count++;
     }
+
+    Serial.printf("Request plan: %u configs -> %u requests\n", (unsigned)CONFIG_COUNT, (unsigned)request_group_count);
 }
 
-String MVGClient::constructUrl(const Config &config)
+String MVGClient::constructUrl(const RequestGroup &group)
 {
+    size_t limit = DEPARTURES_PER_STATION;
+    if (group.config_count > 1)
+    {
+        limit = min(DEPARTURES_PER_STATION * group.config_count * COALESCED_LIMIT_FACTOR, (size_t)MAX_REQUEST_LIMIT);
+    }
+
     String url = MVG_BASE_URL;
     url += MVG_DEPARTURE_ENDPOINT;
-    url += "?globalId=" + config.bahnhof;
-    url += "&limit=5";
+    url += "?globalId=" + group.first->bahnhof;
+    url += "&limit=" + String((unsigned)limit);
 
-    if (!config.include_type.isEmpty())
+    if (!group.transport_types.isEmpty())
     {
-        url += "&transportTypes=" + config.include_type;
+        url += "&transportTypes=" + group.transport_types;
     }
 
-    if (!config.time_offset.isEmpty() && config.time_offset != "0")
+    if (!group.first->time_offset.isEmpty() && group.first->time_offset != "0")
     {
-        url += "&offsetInMinutes=" + config.time_offset;
+        url += "&offsetInMinutes=" + group.first->time_offset;
     }
 
     return url;
 }
 
-String MVGClient::makeRequest(const String &url)
+bool MVGClient::makeRequest(Connection &connection, const String &url)
 {
-    HTTPClient http;
-    http.begin(url);
+    HTTPClient &http = connection.http;
+    JsonDocument &doc = connection.doc;
+    unsigned long request_start = millis();
+    bool reused = false;
+    int httpResponseCode = 0;
+    uint32_t handshakes = 0;
+
+    // begin() resets the request state but keeps a connected socket, so a
+    // connection is only ended once it cannot be used for the next request
+    http.begin(connection.secure_client, url);
+    http.setReuse(true);
     http.addHeader("Accept", "application/json");
     http.addHeader("User-Agent", "MVG_ESP32_Display/1.0");
+    http.collectHeaders(RESPONSE_HEADERS, sizeof(RESPONSE_HEADERS) / sizeof(RESPONSE_HEADERS[0]));
 
-    Serial.println("Making request to MVG API: " + url);
-    int httpResponseCode = http.GET();
-    String payload = "[]";
+    // A connection closed by the server is only noticed when the request fails, so retry once on a fresh one
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        reused = http.connected();
+        if (!reused)
+        {
+            handshakes++;
+        }
+
+        Serial.println("Making request to MVG API: " + url);
+        httpResponseCode = http.GET();
+        if (httpResponseCode > 0 || !reused)
+            break;
 
+        Serial.println("Kept-alive connection was closed by the server, reconnecting");
+        connection.secure_client.stop();
+    }
+
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    fetch_stats.requests++;
+    fetch_stats.handshakes += handshakes;
+    if (!reused && connection.secure_client.sessionResumed())
+    {
+        fetch_stats.resumed_handshakes++;
+    }
+    // Sets the clock before appendToStationList compares departures against it
     if (httpResponseCode > 0)
+    {
+        time_keeper.applyHttpDate(http.header("Date"));
+    }
+    xSemaphoreGive(results_lock);
+
+    bool parsed = false;
+
+    if (httpResponseCode == HTTP_CODE_OK)
     {
         Serial.printf("HTTP Response code: %d\n", httpResponseCode);
-        payload = http.getString();
+
+        uint32_t heap_before = ESP.getFreeHeap();
+        unsigned long parse_start = micros();
+
+        // Keep-alive rules out HTTP/1.0, so the body may arrive chunked
+        bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+        ChunkedStream chunked_body(http.getStream());
+        Stream &body = chunked ? (Stream &)chunked_body : (Stream &)http.getStream();
+
+        doc.clear();
+        DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+
+        unsigned long parse_time = micros() - parse_start;
+        xSemaphoreTake(results_lock, portMAX_DELAY);
+        fetch_stats.total_parse_us += parse_time;
+        xSemaphoreGive(results_lock);
+
+        if (error)
+        {
+            Serial.print(F("deserializeJson() failed: "));
+            Serial.println(error.c_str());
+        }
+        else
+        {
+            parsed = true;
+        }
+
+        // The next response has to start on a clean stream; a plain body is
+        // drained by HTTPClient before it sends the next request
+        if (chunked)
+        {
+            chunked_body.drain();
+        }
+
+        Serial.printf("Parsed %u bytes of JSON in %lu us (heap free %u -> %u, min %u)\n",
+                      (unsigned)doc.memoryUsage(),
+                      parse_time,
+                      heap_before,
+                      ESP.getFreeHeap(),
+                      ESP.getMinFreeHeap());
     }
     else
     {
@@ -80,12 +378,39 @@ String MVGClient::makeRequest(const String &url)
         Serial.println(httpResponseCode);
     }
 
-    http.end();
-    return payload;
+    // Unread error bodies or a broken parse leave the stream in an unknown state
+    if (!parsed)
+    {
+        http.end();
+        connection.secure_client.stop();
+    }
+
+    uint32_t request_ms = millis() - request_start;
+    xSemaphoreTake(results_lock, portMAX_DELAY);
+    fetch_stats.last_request_ms = request_ms;
+    fetch_stats.total_request_ms += request_ms;
+    xSemaphoreGive(results_lock);
+    Serial.printf("Request took %u ms on a %s connection\n",
+                  request_ms,
+                  reused ? "reused" : "new");
+
+    return parsed;
 }
 
-void MVGClient::appendToStationList(const char *station_name)
+void MVGClient::closeConnection()
 {
+    for (Connection &connection : connections)
+    {
+        connection.http.end();
+        connection.secure_client.stop();
+    }
+}
+
+void MVGClient::appendToStationList(size_t station, const Config &config, JsonDocument &doc)
+{
+    char station_name[MAX_TEXT_SIZE];
+    GlyphIndex::normalize(text_font, config.pretty_name.c_str(), station_name, sizeof(station_name));
+
     JsonArray departures = doc.as<JsonArray>();
     if (departures.isNull())
     {
@@ -93,59 +418,71 @@ void MVGClient::appendToStationList(const char *station_name)
         return;
     }
 
-    Station station;
-    station.station_name = String(station_name);
+    station_table.resetStation(station, station_name);
+    updated_mask |= 1UL << station;
+
+    time_t now;
+    time(&now);
+    uint32_t total_delay = 0;
+    size_t realtime_count = 0;
 
     for (JsonVariant departure : departures)
     {
-        String line = departure["label"].as<const char *>();
-        const char *transportType = departure["transportType"].as<const char *>();
+        const char *label = departure["label"] | "";
+        const char *transportType = departure["transportType"] | "";
+
+        // A coalesced response also carries the types other configs asked for
+        if (!config.include_type.isEmpty() && !containsType(config.include_type, transportType, strlen(transportType)))
+            continue;
 
+        if (station_table.departureCount(station) >= DEPARTURES_PER_STATION)
+            break;
+
+        const char *prefix = "";
         if (strcmp(transportType, "TRAM") == 0)
-            line = "T" + line;
+            prefix = "T";
         else if (strcmp(transportType, "SBAHN") == 0)
-            line = "S" + line;
-        else if (strcmp(transportType, "UBAHN") == 0)
-            line = "" + line;
+            prefix = "S";
         else if (strcmp(transportType, "BUS") == 0)
-            line = "B" + line;
+            prefix = "B";
+
+        char label_text[DepartureTable::LINE_LABEL_SIZE];
+        snprintf(label_text, sizeof(label_text), "%s%s", prefix, label);
+        char line[DepartureTable::LINE_LABEL_SIZE];
+        GlyphIndex::normalize(text_font, label_text, line, sizeof(line));
 
-        String destination = departure["destination"].as<const char *>();
+        // Normalized once here rather than on every redraw of the countdown
+        char destination[MAX_TEXT_SIZE];
+        GlyphIndex::normalize(text_font, departure["destination"] | "", destination, sizeof(destination));
 
-        time_t now;
-        time(&now);
-        unsigned long departure_time = departure["departureTime"].as<long long>() / 1000;
+        time_t departure_time = departure["departureTime"].as<long long>() / 1000;
 
         if (departure.containsKey("realtimeDepartureTime"))
         {
+            time_t planned_time = departure_time;
             departure_time = departure["realtimeDepartureTime"].as<long long>() / 1000;
+            total_delay += labs((long)(departure_time - planned_time));
+            realtime_count++;
         }
 
-        unsigned long minutes_to_departure = 0;
         if (departure_time > now)
         {
-            minutes_to_departure = (departure_time - now) / 60;
-
-            Departure dep = {
-                line,
-                destination,
-                String(minutes_to_departure)};
-            station.departure_list.push_back(dep);
-
-            Serial.print(line);
-            Serial.print(" to ");
-            Serial.print(destination);
-            Serial.print(" in ");
-            Serial.print(minutes_to_departure);
-            Serial.println(" minutes \n");
+            if (!station_table.addDeparture(station, line, destination, departure_time))
+            {
+                Serial.println("Departure table full, skipping remaining departures");
+                break;
+            }
+
+            Serial.printf("%s to %s in %ld minutes \n\n",
+                          line,
+                          destination,
+                          DepartureTable::minutesUntil(departure_time, now));
         }
     }
 
-    if (!station.departure_list.empty())
-    {
-        station_list.push_back(station);
-        Serial.printf("Added %d departures for station %s\n",
-                      station.departure_list.size(),
-                      station_name);
-    }
-}
\ No newline at end of file
+    station_delays[station] = realtime_count ? min(total_delay / (uint32_t)realtime_count, (uint32_t)UINT16_MAX) : 0;
+
+    Serial.printf("Added %u departures for station %s\n",
+                  (unsigned)station_table.departureCount(station),
+                  station_name);
+}
@@ -1,32 +1,55 @@
 #include "ModeManager.h"
+#include <driver/gpio.h>
 #include <esp_sleep.h>
-#include "utilities.h"
+#include <esp_timer.h>
 
-// Static instance pointer for button callback
+// Static instance pointer for the interrupt and timer callbacks
 static ModeManager *instance = nullptr;
 
 ModeManager::ModeManager()
-    : btn1(BUTTON_1), currentMode(DisplayMode::SLEEP), sleepRequested(false), lastInteraction(0)
+    : eventQueue(nullptr), debounceTimer(nullptr), currentMode(DisplayMode::SLEEP), sleepRequested(false), lastInteraction(0)
 {
     instance = this;
 
+    buttonPins[0] = BUTTON_1;
 #if defined(CONFIG_IDF_TARGET_ESP32)
-    btn2 = Button2(BUTTON_2);
-    btn3 = Button2(BUTTON_3);
+    buttonPins[1] = BUTTON_2;
+    buttonPins[2] = BUTTON_3;
 #endif
+
+    for (size_t button = 0; button < BUTTON_COUNT; button++)
+    {
+        buttonPressed[button] = false;
+        firstEdgeUs[button] = 0;
+    }
 }
 
 void ModeManager::init()
 {
     Serial.println("Initializing ModeManager...");
 
-    // Configure button handlers
-    btn1.setPressedHandler(onButtonPressed);
+    eventQueue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(ButtonEvent));
+    debounceTimer = xTimerCreate("debounce", pdMS_TO_TICKS(DEBOUNCE_MS), pdFALSE, nullptr, onDebounceTimer);
 
-#if defined(CONFIG_IDF_TARGET_ESP32)
-    btn2.setPressedHandler(onButtonPressed);
-    btn3.setPressedHandler(onButtonPressed);
-#endif
+    // Fails harmlessly when the Arduino core already installed the service
+    gpio_install_isr_service(0);
+
+    for (size_t button = 0; button < BUTTON_COUNT; button++)
+    {
+        gpio_num_t pin = (gpio_num_t)buttonPins[button];
+        gpio_config_t config = {};
+        config.pin_bit_mask = 1ULL << pin;
+        config.mode = GPIO_MODE_INPUT;
+        config.pull_up_en = GPIO_PULLUP_ENABLE;
+        config.intr_type = GPIO_INTR_DISABLE;
+        gpio_config(&config);
+
+        gpio_isr_handler_add(pin, onButtonInterrupt, (void *)button);
+        armButton(button);
+    }
+
+    // The buttons also end an automatic light sleep, so live mode can idle between events
+    esp_sleep_enable_gpio_wakeup();
 
     // Start in sleep mode
     currentMode = DisplayMode::SLEEP;
@@ -35,32 +58,111 @@ void ModeManager::init()
     Serial.println("ModeManager initialized in SLEEP mode");
 }
 
-void ModeManager::update()
+// Level interrupts work as light sleep wakeup sources, where edges can be missed,
+// so each button waits for the level opposite to its debounced state
+void ModeManager::armButton(size_t button)
 {
-    // Update button states
-    btn1.loop();
+    gpio_num_t pin = (gpio_num_t)buttonPins[button];
+    gpio_int_type_t level = buttonPressed[button] ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL;
 
-#if defined(CONFIG_IDF_TARGET_ESP32)
-    btn2.loop();
-    btn3.loop();
-#endif
+    gpio_set_intr_type(pin, level);
+    gpio_wakeup_enable(pin, level);
+    gpio_intr_enable(pin);
+}
 
-    // Check for automatic sleep timeout in live mode
-    if (currentMode == DisplayMode::LIVE)
+void IRAM_ATTR ModeManager::onButtonInterrupt(void *arg)
+{
+    size_t button = (size_t)arg;
+
+    // A level interrupt keeps firing, so it stays off until the timer has looked at the pin
+    gpio_intr_disable((gpio_num_t)instance->buttonPins[button]);
+    if (instance->firstEdgeUs[button] == 0)
     {
-        if (millis() - lastInteraction > LIVE_MODE_TIMEOUT)
+        instance->firstEdgeUs[button] = esp_timer_get_time();
+    }
+
+    BaseType_t woken = pdFALSE;
+    xTimerResetFromISR(instance->debounceTimer, &woken);
+    if (woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void ModeManager::onDebounceTimer(TimerHandle_t timer)
+{
+    for (size_t button = 0; button < BUTTON_COUNT; button++)
+    {
+        bool pressed = gpio_get_level((gpio_num_t)instance->buttonPins[button]) == 0;
+        if (pressed != instance->buttonPressed[button])
         {
-            Serial.println("Live mode timeout - requesting sleep");
-            sleepRequested = true;
+            instance->buttonPressed[button] = pressed;
+            if (pressed)
+            {
+                ButtonEvent event = {(uint8_t)button, instance->firstEdgeUs[button]};
+                xQueueSend(instance->eventQueue, &event, 0);
+            }
         }
+        instance->firstEdgeUs[button] = 0;
+        instance->armButton(button);
     }
 }
 
-void ModeManager::onButtonPressed(Button2 &btn)
+TickType_t ModeManager::ticksUntilTimeout() const
+{
+    if (currentMode != DisplayMode::LIVE || sleepRequested)
+        return portMAX_DELAY;
+
+    unsigned long elapsed = millis() - lastInteraction;
+    // update() times out once more than LIVE_MODE_TIMEOUT has passed
+    return elapsed > LIVE_MODE_TIMEOUT ? 0 : pdMS_TO_TICKS(LIVE_MODE_TIMEOUT - elapsed + 1);
+}
+
+bool ModeManager::isDebouncing() const
 {
-    if (instance)
+    for (size_t button = 0; button < BUTTON_COUNT; button++)
     {
-        instance->handleButtonPress();
+        if (firstEdgeUs[button] != 0)
+            return true;
+    }
+    return false;
+}
+
+bool ModeManager::isButtonHeld() const
+{
+    for (size_t button = 0; button < BUTTON_COUNT; button++)
+    {
+        if (buttonPressed[button])
+            return true;
+    }
+    return false;
+}
+
+void ModeManager::wake()
+{
+    ButtonEvent event = {NO_BUTTON, 0};
+    xQueueSend(eventQueue, &event, 0);
+}
+
+void ModeManager::update(TickType_t timeout)
+{
+    ButtonEvent event;
+    if (xQueueReceive(eventQueue, &event, timeout) == pdTRUE && event.button != NO_BUTTON)
+    {
+        Serial.printf("Button %u pressed, handled %lld ms after the interrupt\n",
+                      (unsigned)event.button + 1,
+                      (long long)((esp_timer_get_time() - event.interrupt_us) / 1000));
+        handleButtonPress();
+    }
+
+    // Check for automatic sleep timeout in live mode
+    if (currentMode == DisplayMode::LIVE)
+    {
+        if (millis() - lastInteraction > LIVE_MODE_TIMEOUT)
+        {
+            Serial.println("Live mode timeout - requesting sleep");
+            sleepRequested = true;
+        }
     }
 }
 
@@ -86,8 +188,11 @@ void ModeManager::enterSleepMode()
     Serial.println("Entering SLEEP mode");
     currentMode = DisplayMode::SLEEP;
     sleepRequested = false;
+    armDeepSleepWakeup();
+}
 
-// Configure wake-up source
+void ModeManager::armDeepSleepWakeup()
+{
 #if defined(CONFIG_IDF_TARGET_ESP32S3)
     esp_sleep_enable_ext1_wakeup(_BV(BUTTON_1), ESP_EXT1_WAKEUP_ANY_LOW);
 #elif defined(CONFIG_IDF_TARGET_ESP32)
@@ -101,3 +206,11 @@ void ModeManager::enterLiveMode()
     currentMode = DisplayMode::LIVE;
     lastInteraction = millis();
 }
+
+void ModeManager::resumeLiveMode(unsigned long remaining_ms)
+{
+    Serial.printf("Resuming LIVE mode, %lu s left\n", remaining_ms / 1000);
+    currentMode = DisplayMode::LIVE;
+    sleepRequested = false;
+    lastInteraction = millis() - (LIVE_MODE_TIMEOUT - min(remaining_ms, (unsigned long)LIVE_MODE_TIMEOUT));
+}
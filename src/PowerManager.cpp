@@ -0,0 +1,214 @@
+#include "PowerManager.h"
+#include <freertos/task.h>
+#include <esp_sleep.h>
+#include <climits>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+PowerManager::PowerManager()
+    : lock(nullptr), changed(nullptr), wake_callback(nullptr), sleep_blocker(nullptr), deep_sleep_handler(nullptr), automatic_light_sleep(false),
+      busy_count(0), radio_on(false), last_account_ms(0), stats({0, 0, 0, 0, 0}), reported({0, 0, 0, 0, 0}), last_report_ms(0)
+{
+    for (size_t i = 0; i < DEADLINE_COUNT; i++)
+    {
+        deadlines[i] = NO_DEADLINE;
+    }
+}
+
+void PowerManager::init()
+{
+    lock = xSemaphoreCreateMutex();
+    changed = xSemaphoreCreateBinary();
+    last_account_ms = millis();
+    last_report_ms = last_account_ms;
+
+#if CONFIG_PM_ENABLE
+#if CONFIG_IDF_TARGET_ESP32S3
+    esp_pm_config_esp32s3_t pm_config = {};
+#else
+    esp_pm_config_esp32_t pm_config = {};
+#endif
+    pm_config.max_freq_mhz = 240;
+    pm_config.min_freq_mhz = 80;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    pm_config.light_sleep_enable = true;
+#endif
+    esp_err_t err = esp_pm_configure(&pm_config);
+    automatic_light_sleep = err == ESP_OK && pm_config.light_sleep_enable;
+    Serial.printf("Power management: %s\n", err == ESP_OK ? "enabled" : esp_err_to_name(err));
+#endif
+
+    Serial.printf("Power management: %s light sleep between deadlines\n",
+                  automatic_light_sleep ? "automatic" : "explicit");
+
+    // Lowest priority, so it only runs once every other task is blocked
+    xTaskCreate(powerTask, "power", POWER_TASK_STACK, this, tskIDLE_PRIORITY, nullptr);
+}
+
+void PowerManager::setDeadline(Deadline deadline, unsigned long at_ms)
+{
+    deadlines[deadline] = at_ms;
+    xSemaphoreGive(changed);
+}
+
+long PowerManager::timeUntil(Deadline deadline) const
+{
+    unsigned long at_ms = deadlines[deadline];
+    if (at_ms == NO_DEADLINE)
+        return -1;
+    return max((long)(at_ms - millis()), 0L);
+}
+
+void PowerManager::beginWork()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    account();
+    busy_count++;
+    xSemaphoreGive(lock);
+}
+
+void PowerManager::endWork()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    account();
+    if (busy_count > 0)
+        busy_count--;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(changed);
+}
+
+void PowerManager::setRadioOn(bool on)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    account();
+    radio_on = on;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(changed);
+}
+
+// Books the time since the last call to the current state; called with the lock held
+void PowerManager::account()
+{
+    unsigned long now = millis();
+    uint32_t elapsed = now - last_account_ms;
+    last_account_ms = now;
+
+    if (busy_count > 0)
+        stats.active_ms += elapsed;
+    else if (radio_on)
+        stats.idle_radio_ms += elapsed;
+    else
+        stats.idle_ms += elapsed;
+}
+
+void PowerManager::powerTask(void *parameter)
+{
+    PowerManager *manager = (PowerManager *)parameter;
+    for (;;)
+    {
+        manager->runIdle();
+    }
+}
+
+void PowerManager::runIdle()
+{
+    unsigned long now = millis();
+    long window = LONG_MAX;
+    for (size_t i = 0; i < DEADLINE_COUNT; i++)
+    {
+        if (deadlines[i] != NO_DEADLINE)
+            window = min(window, (long)(deadlines[i] - now));
+    }
+
+    if (now - last_report_ms >= ENERGY_REPORT_INTERVAL)
+    {
+        reportEnergy();
+    }
+
+    // Explicit light sleep drops the WiFi association, so it waits until the radio is off
+    bool blocked = sleep_blocker && sleep_blocker();
+    if (blocked)
+    {
+        // Nobody reports when the blocker clears, so it is polled
+        window = min(window, (long)MIN_IDLE_WAIT_MS);
+    }
+
+    if (deep_sleep_handler && !blocked && busy_count == 0 && window != LONG_MAX && window >= (long)MIN_DEEP_SLEEP_MS)
+    {
+        deep_sleep_handler(window);
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool can_sleep = !automatic_light_sleep && !blocked && busy_count == 0 && !radio_on && window >= (long)MIN_LIGHT_SLEEP_MS;
+    if (can_sleep)
+    {
+        account();
+    }
+    xSemaphoreGive(lock);
+
+    if (!can_sleep)
+    {
+        // Sleeps in the idle task until something changes or the next deadline passes
+        TickType_t wait = window == LONG_MAX ? portMAX_DELAY : pdMS_TO_TICKS(max(window, (long)MIN_IDLE_WAIT_MS));
+        xSemaphoreTake(changed, wait);
+        return;
+    }
+
+    // A window without deadlines still wakes up for the energy report
+    unsigned long until_report = last_report_ms + ENERGY_REPORT_INTERVAL - now;
+    unsigned long sleep_ms = min((unsigned long)window, max(until_report, (unsigned long)MIN_LIGHT_SLEEP_MS));
+    esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000);
+
+    unsigned long sleep_start = millis();
+    esp_light_sleep_start();
+    uint32_t slept = millis() - sleep_start;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats.light_sleep_ms += slept;
+    stats.light_sleeps++;
+    last_account_ms = millis();
+    xSemaphoreGive(lock);
+
+    // Timeouts of blocked tasks count ticks, which stood still while asleep
+    if (wake_callback)
+    {
+        wake_callback();
+    }
+    // The woken tasks and the button interrupt get to run before the next sleep decision
+    taskYIELD();
+}
+
+void PowerManager::reportEnergy()
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    account();
+    PowerStats interval = {
+        stats.active_ms - reported.active_ms,
+        stats.idle_radio_ms - reported.idle_radio_ms,
+        stats.idle_ms - reported.idle_ms,
+        stats.light_sleep_ms - reported.light_sleep_ms,
+        stats.light_sleeps - reported.light_sleeps};
+    reported = stats;
+    unsigned long now = millis();
+    unsigned long elapsed = now - last_report_ms;
+    last_report_ms = now;
+    xSemaphoreGive(lock);
+
+    float idle_radio_ma = automatic_light_sleep ? IDLE_RADIO_AUTO_SLEEP_MA : IDLE_RADIO_MA;
+    float charge_mas = (interval.active_ms * ACTIVE_MA +
+                        interval.idle_radio_ms * idle_radio_ma +
+                        interval.idle_ms * IDLE_MA +
+                        interval.light_sleep_ms * LIGHT_SLEEP_MA) /
+                       1000.0f;
+    float minutes = elapsed / 60000.0f;
+
+    Serial.printf("Energy: %.1f mJ per minute, %.2f mA average (active %u ms, idle with WiFi %u ms, idle %u ms, light sleep %u ms in %u sleeps)\n",
+                  minutes > 0 ? charge_mas * SUPPLY_VOLTAGE / minutes : 0.0f,
+                  elapsed ? charge_mas * 1000.0f / elapsed : 0.0f,
+                  interval.active_ms,
+                  interval.idle_radio_ms,
+                  interval.idle_ms,
+                  interval.light_sleep_ms,
+                  interval.light_sleeps);
+}
@@ -0,0 +1,367 @@
+#include "TLSSessionClient.h"
+#include "TLSSessionStore.h"
+
+#ifdef NATIVE_HAL
+
+#include <NativeHAL.h>
+
+TLSSessionClient::TLSSessionClient() : resumed(false)
+{
+    TLSSessionStore::init();
+}
+
+int TLSSessionClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    resumed = false;
+
+    // Same offer and resume detection as the mbedtls client, against the emulated server
+    TLSSessionStore::lock();
+    NativeHAL::TlsSession offered;
+    const uint8_t *data = nullptr;
+    const char *source = nullptr;
+    size_t length = TLSSessionStore::find(host, &data, &source);
+    bool offering = length && NativeHAL::tlsSessionLoad(data, length, offered);
+    if (offering)
+    {
+        Serial.printf("TLS: offering saved session (%u bytes from %s)\n", (unsigned)length, source);
+    }
+
+    NativeHAL::TlsSession session;
+    NativeHAL::tlsHandshake(host, offering ? &offered : nullptr, session);
+    resumed = offering && memcmp(offered.master, session.master, sizeof(session.master)) == 0;
+
+    length = NativeHAL::tlsSessionSave(session, TLSSessionStore::scratch(), TLSSessionStore::SCRATCH_SIZE);
+    if (length)
+    {
+        TLSSessionStore::save(host, TLSSessionStore::scratch(), length, resumed);
+    }
+    TLSSessionStore::unlock();
+
+    Serial.printf("TLS: %s handshake with %s\n", resumed ? "resumed" : "full", host);
+    return WiFiClientSecure::connect(host, port);
+}
+
+#else
+
+#include <esp_sleep.h>
+
+// Only the first connection after a boot or wake is interesting for the time-to-first-byte log
+static bool first_connection = true;
+
+TLSSessionClient::TLSSessionClient()
+    : seeded(false), active(false), resumed(false), first_byte_logged(true), offered(false), peeked(-1), connect_start(0)
+{
+    mbedtls_net_init(&net);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+
+    // Clients are constructed before any task runs, so this cannot race
+    TLSSessionStore::init();
+}
+
+TLSSessionClient::~TLSSessionClient()
+{
+    stop();
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+}
+
+bool TLSSessionClient::seed()
+{
+    if (seeded)
+        return true;
+
+    static const char personalization[] = "mvg_tls_client";
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char *)personalization, sizeof(personalization) - 1);
+    if (ret != 0)
+    {
+        Serial.printf("TLS: DRBG seed failed: -0x%04x\n", -ret);
+        return false;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0)
+    {
+        Serial.printf("TLS: config defaults failed: -0x%04x\n", -ret);
+        return false;
+    }
+
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    seeded = true;
+    return true;
+}
+
+int TLSSessionClient::connect(IPAddress ip, uint16_t port)
+{
+    return connect(ip.toString().c_str(), port, DEFAULT_TIMEOUT_MS);
+}
+
+int TLSSessionClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    return connect(ip.toString().c_str(), port, timeout);
+}
+
+int TLSSessionClient::connect(const char *host, uint16_t port)
+{
+    return connect(host, port, DEFAULT_TIMEOUT_MS);
+}
+
+int TLSSessionClient::connect(const char *host, uint16_t port, int32_t timeout)
+{
+    stop();
+    if (!seed())
+        return 0;
+
+    connect_start = millis();
+    resumed = false;
+    offered = false;
+
+    char port_string[6];
+    snprintf(port_string, sizeof(port_string), "%u", port);
+
+    int ret = mbedtls_net_connect(&net, host, port_string, MBEDTLS_NET_PROTO_TCP);
+    if (ret != 0)
+    {
+        Serial.printf("TLS: connect to %s failed: -0x%04x\n", host, -ret);
+        return 0;
+    }
+
+    ret = mbedtls_ssl_setup(&ssl, &conf);
+    if (ret == 0)
+        ret = mbedtls_ssl_set_hostname(&ssl, host);
+    if (ret != 0)
+    {
+        Serial.printf("TLS: setup failed: -0x%04x\n", -ret);
+        stop();
+        return 0;
+    }
+
+    // Non-blocking, like WiFiClientSecure, so available() can poll without stalling
+    mbedtls_net_set_nonblock(&net);
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    TLSSessionStore::lock();
+    offerSavedSession(host);
+    TLSSessionStore::unlock();
+
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0)
+    {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            Serial.printf("TLS: handshake failed: -0x%04x\n", -ret);
+            stop();
+            return 0;
+        }
+        if ((int32_t)(millis() - connect_start) > timeout)
+        {
+            Serial.println("TLS: handshake timed out");
+            stop();
+            return 0;
+        }
+        vTaskDelay(2);
+    }
+
+    active = true;
+    TLSSessionStore::lock();
+    saveSession(host);
+    TLSSessionStore::unlock();
+
+    Serial.printf("TLS: %s handshake with %s took %lu ms\n",
+                  resumed ? "resumed" : "full",
+                  host,
+                  millis() - connect_start);
+
+    first_byte_logged = !first_connection;
+    first_connection = false;
+    return 1;
+}
+
+void TLSSessionClient::offerSavedSession(const char *host)
+{
+    const uint8_t *data = nullptr;
+    const char *source = nullptr;
+    size_t length = TLSSessionStore::find(host, &data, &source);
+    if (!length)
+        return;
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, data, length) == 0 && mbedtls_ssl_set_session(&ssl, &session) == 0)
+    {
+        offered = true;
+        memcpy(offered_master, session.master, sizeof(offered_master));
+        Serial.printf("TLS: offering saved session (%u bytes from %s)\n", (unsigned)length, source);
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+void TLSSessionClient::saveSession(const char *host)
+{
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(&ssl, &session) != 0)
+    {
+        mbedtls_ssl_session_free(&session);
+        return;
+    }
+
+    // Only an abbreviated handshake keeps the master secret of the offered session
+    resumed = offered && memcmp(offered_master, session.master, sizeof(offered_master)) == 0;
+
+    size_t length = 0;
+    int ret = mbedtls_ssl_session_save(&session, TLSSessionStore::scratch(), TLSSessionStore::SCRATCH_SIZE, &length);
+    mbedtls_ssl_session_free(&session);
+    if (ret != 0)
+    {
+        Serial.printf("TLS: session does not fit the cache: -0x%04x\n", -ret);
+        return;
+    }
+    TLSSessionStore::save(host, TLSSessionStore::scratch(), length, resumed);
+}
+
+size_t TLSSessionClient::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t TLSSessionClient::write(const uint8_t *buf, size_t size)
+{
+    if (!active)
+        return 0;
+
+    size_t written = 0;
+    unsigned long start = millis();
+    while (written < size)
+    {
+        int ret = mbedtls_ssl_write(&ssl, buf + written, size - written);
+        if (ret > 0)
+        {
+            written += ret;
+        }
+        else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            Serial.printf("TLS: write failed: -0x%04x\n", -ret);
+            stop();
+            break;
+        }
+        else if (millis() - start > (unsigned long)DEFAULT_TIMEOUT_MS)
+        {
+            break;
+        }
+        else
+        {
+            vTaskDelay(1);
+        }
+    }
+    return written;
+}
+
+int TLSSessionClient::available()
+{
+    if (!active)
+        return peeked >= 0 ? 1 : 0;
+
+    // A zero length read processes pending records without consuming data
+    int ret = mbedtls_ssl_read(&ssl, NULL, 0);
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        stop();
+        return peeked >= 0 ? 1 : 0;
+    }
+    return mbedtls_ssl_get_bytes_avail(&ssl) + (peeked >= 0 ? 1 : 0);
+}
+
+int TLSSessionClient::readRecord(uint8_t *buf, size_t size)
+{
+    if (!active)
+        return -1;
+
+    int ret = mbedtls_ssl_read(&ssl, buf, size);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return -1;
+    if (ret <= 0)
+    {
+        stop();
+        return -1;
+    }
+
+    if (!first_byte_logged)
+    {
+        first_byte_logged = true;
+        Serial.printf("TLS: first byte %lu ms after connecting (%s wake, %s session)\n",
+                      millis() - connect_start,
+                      esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED ? "cold" : "deep sleep",
+                      resumed ? "resumed" : "new");
+    }
+    return ret;
+}
+
+int TLSSessionClient::read()
+{
+    uint8_t data;
+    return read(&data, 1) == 1 ? data : -1;
+}
+
+int TLSSessionClient::read(uint8_t *buf, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    if (peeked >= 0)
+    {
+        buf[0] = peeked;
+        peeked = -1;
+        int ret = size > 1 && available() ? readRecord(buf + 1, size - 1) : 0;
+        return ret > 0 ? ret + 1 : 1;
+    }
+    return readRecord(buf, size);
+}
+
+int TLSSessionClient::peek()
+{
+    if (peeked < 0)
+    {
+        uint8_t data;
+        if (readRecord(&data, 1) == 1)
+        {
+            peeked = data;
+        }
+    }
+    return peeked;
+}
+
+void TLSSessionClient::flush()
+{
+}
+
+void TLSSessionClient::stop()
+{
+    if (active)
+    {
+        mbedtls_ssl_close_notify(&ssl);
+    }
+    active = false;
+    peeked = -1;
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_net_free(&net);
+}
+
+uint8_t TLSSessionClient::connected()
+{
+    if (active)
+    {
+        available();
+    }
+    return active || peeked >= 0;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "TLSSessionStore.h"
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const uint32_t SESSION_MAGIC = 0x544C5331; // "TLS1"
+static const size_t SESSION_HOST_SIZE = 48;
+static const size_t RTC_SESSION_SIZE = 2048;
+static const char *NVS_NAMESPACE = "tls";
+
+// Survives deep sleep but not a power cycle, so the NVS copy is the fallback
+struct SavedSession
+{
+    uint32_t magic;
+    uint16_t length;
+    char host[SESSION_HOST_SIZE];
+    uint8_t data[RTC_SESSION_SIZE];
+};
+
+RTC_DATA_ATTR static SavedSession rtc_session;
+// Shared by loading and saving, which only happen under the lock
+static uint8_t session_buffer[TLSSessionStore::SCRATCH_SIZE];
+static SemaphoreHandle_t session_lock = nullptr;
+
+static bool loadFromNvs(const char *host, uint8_t *buffer, size_t &length)
+{
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, true))
+        return false;
+
+    bool found = preferences.getString("host", "") == host;
+    if (found)
+    {
+        length = preferences.getBytes("session", buffer, TLSSessionStore::SCRATCH_SIZE);
+        found = length > 0;
+    }
+    preferences.end();
+    return found;
+}
+
+static void storeToNvs(const char *host, const uint8_t *buffer, size_t length)
+{
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, false))
+        return;
+
+    preferences.putString("host", host);
+    preferences.putBytes("session", buffer, length);
+    preferences.end();
+}
+
+namespace TLSSessionStore
+{
+    void init()
+    {
+        if (!session_lock)
+        {
+            session_lock = xSemaphoreCreateMutex();
+        }
+    }
+
+    void lock()
+    {
+        xSemaphoreTake(session_lock, portMAX_DELAY);
+    }
+
+    void unlock()
+    {
+        xSemaphoreGive(session_lock);
+    }
+
+    size_t find(const char *host, const uint8_t **data, const char **source)
+    {
+        size_t length = 0;
+        if (rtc_session.magic == SESSION_MAGIC && strncmp(rtc_session.host, host, SESSION_HOST_SIZE) == 0)
+        {
+            *data = rtc_session.data;
+            *source = "RTC memory";
+            return rtc_session.length;
+        }
+        if (loadFromNvs(host, session_buffer, length))
+        {
+            *data = session_buffer;
+            *source = "NVS";
+            return length;
+        }
+        return 0;
+    }
+
+    uint8_t *scratch()
+    {
+        return session_buffer;
+    }
+
+    void save(const char *host, const uint8_t *data, size_t length, bool resumed)
+    {
+        if (length <= RTC_SESSION_SIZE)
+        {
+            // A resumed session may still come with a renewed ticket
+            if (rtc_session.magic != SESSION_MAGIC || rtc_session.length != length ||
+                memcmp(rtc_session.data, data, length) != 0)
+            {
+                rtc_session.magic = SESSION_MAGIC;
+                rtc_session.length = length;
+                strncpy(rtc_session.host, host, SESSION_HOST_SIZE - 1);
+                rtc_session.host[SESSION_HOST_SIZE - 1] = '\0';
+                memcpy(rtc_session.data, data, length);
+            }
+        }
+        else
+        {
+            rtc_session.magic = 0;
+            // Writing NVS wears flash, so only a new session is stored there
+            if (!resumed)
+            {
+                storeToNvs(host, data, length);
+            }
+        }
+    }
+}
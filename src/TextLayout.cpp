@@ -0,0 +1,186 @@
+#include "TextLayout.h"
+#include "GlyphIndex.h"
+#include "Utf8.h"
+#include <cstring>
+
+static const uint32_t ELLIPSIS = 0x2026;
+
+bool RenderList::addText(const GFXfont *font, const char *text, size_t length, const char *suffix, int32_t x, int32_t y)
+{
+    size_t suffix_length = strlen(suffix);
+    if (count >= MAX_ITEMS || text_used + length + suffix_length + 1 > TEXT_SIZE)
+        return false;
+
+    char *copy = texts + text_used;
+    memcpy(copy, text, length);
+    memcpy(copy + length, suffix, suffix_length + 1);
+    items[count++] = {Kind::TEXT, 0, font, x, y, 0, 0, (uint16_t)text_used};
+    text_used += length + suffix_length + 1;
+    return true;
+}
+
+bool RenderList::addFill(int32_t x, int32_t y, int32_t width, int32_t height, uint8_t color)
+{
+    if (count >= MAX_ITEMS)
+        return false;
+
+    items[count++] = {Kind::FILL, color, nullptr, x, y, width, height, 0};
+    return true;
+}
+
+static uint32_t hashFit(const GFXfont *font, const char *text, int32_t max_width)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)font ^ (uint32_t)max_width;
+    for (const char *c = text; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+static int32_t advance(const GFXfont *font, uint32_t code_point)
+{
+    // Like the driver, a code point the font lacks takes no space
+    const GFXglyph *glyph = GlyphIndex::find(font, code_point);
+    return glyph ? glyph->advance_x : 0;
+}
+
+TextLayout::TextLayout()
+    : slots(nullptr), clock(0), uncached({0, 0, false, false}), uncached_spelled{}, stats{}
+{
+}
+
+bool TextLayout::init()
+{
+    slots = (FitSlot *)ps_calloc(FIT_SLOTS, sizeof(FitSlot));
+    if (!slots)
+    {
+        Serial.println("No memory for the layout cache, text is measured every time");
+        return false;
+    }
+    return true;
+}
+
+int32_t TextLayout::measure(const GFXfont *font, const char *text)
+{
+    int32_t width = 0;
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+        if (!bytes)
+        {
+            // Not UTF-8; counted as nothing rather than guessing at what the driver makes of it
+            s++;
+            continue;
+        }
+        width += advance(font, code_point);
+        s += bytes;
+    }
+    return width;
+}
+
+bool TextLayout::place(RenderList &list, const GFXfont *font, const char *text, int32_t x, int32_t y, int32_t width, Align align)
+{
+    const char *drawn = text;
+    const Fit &fitted = findFit(font, text, width, &drawn);
+    int32_t origin = align == Align::RIGHT ? x + width - fitted.width : x;
+    return list.addText(font, drawn, fitted.length, fitted.ellipsis ? ellipsis(font) : "", origin, y);
+}
+
+TextLayout::Fit TextLayout::fit(const GFXfont *font, const char *text, int32_t max_width, char *spelled, size_t spelled_size)
+{
+    bool spelling = !GlyphIndex::covers(font, text);
+    if (spelling)
+    {
+        GlyphIndex::normalize(font, text, spelled, spelled_size);
+        text = spelled;
+    }
+
+    size_t length = strlen(text);
+    int32_t width = measure(font, text);
+    if (width <= max_width)
+        return {(uint16_t)length, (int16_t)width, false, spelling};
+
+    int32_t room = max_width - measure(font, ellipsis(font));
+    if (room < 0)
+        return {0, 0, false, spelling};
+
+    // The longest prefix that leaves room for the ellipsis, without a space or comma
+    // left dangling in front of it
+    size_t kept = 0;
+    int32_t kept_width = 0;
+    int32_t prefix_width = 0;
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+        if (!bytes)
+        {
+            s++;
+            continue;
+        }
+        prefix_width += advance(font, code_point);
+        if (prefix_width > room)
+            break;
+        s += bytes;
+        if (code_point != ' ' && code_point != ',')
+        {
+            kept = s - (const uint8_t *)text;
+            kept_width = prefix_width;
+        }
+    }
+    return {(uint16_t)kept, (int16_t)(kept_width + max_width - room), true, spelling};
+}
+
+const char *TextLayout::ellipsis(const GFXfont *font)
+{
+    return GlyphIndex::find(font, ELLIPSIS) ? "\xE2\x80\xA6" : "...";
+}
+
+const TextLayout::Fit &TextLayout::findFit(const GFXfont *font, const char *text, int32_t max_width, const char **drawn)
+{
+    if (!slots || strlen(text) > MAX_TEXT_LENGTH)
+    {
+        stats.fit_misses++;
+        uncached = fit(font, text, max_width, uncached_spelled, sizeof(uncached_spelled));
+        if (uncached.spelled)
+            *drawn = uncached_spelled;
+        return uncached;
+    }
+
+    clock++;
+    size_t index = hashFit(font, text, max_width) % FIT_SLOTS;
+    FitSlot *victim = nullptr;
+    for (size_t probe = 0; probe < FIT_PROBES; probe++)
+    {
+        FitSlot &slot = slots[(index + probe) % FIT_SLOTS];
+        if (slot.font == font && slot.max_width == max_width && strcmp(slot.text, text) == 0)
+        {
+            stats.fit_hits++;
+            slot.last_used = clock;
+            if (slot.fit.spelled)
+                *drawn = slot.spelled;
+            return slot.fit;
+        }
+        if (!victim || !slot.font || (victim->font && slot.last_used < victim->last_used))
+        {
+            victim = &slot;
+        }
+    }
+
+    stats.fit_misses++;
+    victim->font = font;
+    victim->max_width = max_width;
+    victim->last_used = clock;
+    strcpy(victim->text, text);
+    victim->fit = fit(font, text, max_width, victim->spelled, sizeof(victim->spelled));
+    if (victim->fit.ellipsis)
+    {
+        stats.truncated++;
+    }
+    if (victim->fit.spelled)
+        *drawn = victim->spelled;
+    return victim->fit;
+}
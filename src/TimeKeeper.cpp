@@ -0,0 +1,203 @@
+#include "TimeKeeper.h"
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+static const uint32_t CLOCK_MAGIC = 0x434C4B31; // "CLK1"
+
+// Sync bookkeeping, kept across deep sleep together with the clock itself
+struct ClockState
+{
+    uint32_t magic;
+    time_t last_sync;
+    uint32_t sync_uncertainty_ms;
+    time_t last_ntp_sync;
+    TimeStats stats;
+};
+
+RTC_DATA_ATTR static ClockState clock_state;
+
+TimeKeeper *TimeKeeper::instance = nullptr;
+
+// Days since 1970-01-01 for a proleptic Gregorian date, without relying on timegm()
+static long daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    long era = year / 400;
+    long year_of_era = year - era * 400;
+    long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Parses the IMF-fixdate form, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+static bool parseHttpDate(const char *text, time_t &result)
+{
+    static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char month_name[4];
+    int day, year, hour, minute, second;
+
+    if (sscanf(text, "%*3s, %d %3s %d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) != 6)
+        return false;
+
+    const char *month = strstr(MONTHS, month_name);
+    if (!month || (month - MONTHS) % 3 != 0)
+        return false;
+
+    long days = daysFromCivil(year, (month - MONTHS) / 3 + 1, day);
+    result = (time_t)days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+TimeKeeper::TimeKeeper(uint32_t max_error_ms)
+    : max_error_ms(max_error_ms), ntp_running(false), ntp_done(false), ntp_start_wall_ms(0), ntp_start_millis(0)
+{
+    instance = this;
+
+    // RTC memory starts out random after a power cycle
+    if (clock_state.magic != CLOCK_MAGIC)
+    {
+        memset(&clock_state, 0, sizeof(clock_state));
+        clock_state.magic = CLOCK_MAGIC;
+        clock_state.stats.drift_ppm = DEFAULT_DRIFT_PPM;
+    }
+}
+
+bool TimeKeeper::isValid() const
+{
+    return time(nullptr) >= MIN_VALID_TIME && clock_state.last_sync != 0;
+}
+
+uint32_t TimeKeeper::estimatedErrorMs() const
+{
+    if (!isValid())
+        return UINT32_MAX;
+
+    time_t elapsed = time(nullptr) - clock_state.last_sync;
+    if (elapsed < 0)
+        elapsed = 0;
+    return clock_state.sync_uncertainty_ms + (uint32_t)((uint64_t)clock_state.stats.drift_ppm * elapsed / 1000);
+}
+
+const TimeStats &TimeKeeper::getStats() const
+{
+    return clock_state.stats;
+}
+
+void TimeKeeper::maintain()
+{
+    if (ntp_done)
+    {
+        // Stop SNTP so it does not poll again on its own schedule
+        sntp_stop();
+        ntp_running = false;
+        ntp_done = false;
+    }
+
+    uint32_t error_ms = estimatedErrorMs();
+    if (error_ms <= max_error_ms)
+    {
+        clock_state.stats.skipped_syncs++;
+        Serial.printf("Clock: estimated error %u ms within %u ms, no NTP sync needed\n", error_ms, max_error_ms);
+        return;
+    }
+
+    if (ntp_running)
+        return;
+
+    Serial.println("Clock: starting background NTP sync");
+    ntp_start_wall_ms = wallClockMs();
+    ntp_start_millis = millis();
+    ntp_running = true;
+    sntp_set_time_sync_notification_cb(onNtpSync);
+    // Does not block; the time arrives through onNtpSync
+    configTime(0, 0, NTP_SERVER);
+}
+
+void TimeKeeper::onNtpSync(struct timeval *tv)
+{
+    TimeKeeper *keeper = instance;
+    if (!keeper || !keeper->ntp_running || keeper->ntp_done)
+        return;
+
+    // SNTP has already set the clock, so compare against where it would have been without it
+    int64_t expected_ms = keeper->ntp_start_wall_ms + (int64_t)(millis() - keeper->ntp_start_millis);
+    int64_t ntp_ms = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+    bool had_time = keeper->ntp_start_wall_ms / 1000 >= MIN_VALID_TIME;
+
+    if (had_time && clock_state.last_ntp_sync != 0)
+    {
+        time_t interval = tv->tv_sec - clock_state.last_ntp_sync;
+        if (interval >= MIN_DRIFT_INTERVAL)
+        {
+            uint64_t error_ms = (uint64_t)llabs(ntp_ms - expected_ms);
+            clock_state.stats.drift_ppm = max((uint32_t)(error_ms * 1000 / interval), (uint32_t)MIN_DRIFT_PPM);
+        }
+    }
+
+    clock_state.stats.ntp_syncs++;
+    clock_state.last_ntp_sync = tv->tv_sec;
+    keeper->recordSync("NTP", had_time ? ntp_ms - expected_ms : 0, NTP_UNCERTAINTY_MS);
+    keeper->ntp_done = true;
+}
+
+void TimeKeeper::applyHttpDate(const String &date)
+{
+    time_t header_time;
+    if (date.isEmpty() || !parseHttpDate(date.c_str(), header_time))
+        return;
+
+    // Only worth it when the header is better than what the clock already knows
+    if (estimatedErrorMs() <= HEADER_UNCERTAINTY_MS)
+        return;
+
+    int64_t now_ms = wallClockMs();
+    // The server stamped the header somewhere within the second it names
+    int64_t header_ms = (int64_t)header_time * 1000 + 500;
+    int64_t correction_ms = header_ms - now_ms;
+    bool had_time = now_ms / 1000 >= MIN_VALID_TIME;
+
+    if (!had_time || llabs(correction_ms) > (int64_t)HEADER_UNCERTAINTY_MS)
+    {
+        struct timeval tv;
+        tv.tv_sec = header_ms / 1000;
+        tv.tv_usec = (header_ms % 1000) * 1000;
+        settimeofday(&tv, nullptr);
+
+        // Keep a running NTP measurement relative to the clock it will see
+        ntp_start_wall_ms += correction_ms;
+    }
+    else
+    {
+        // The clock agrees with the header, which still bounds its error
+        correction_ms = 0;
+    }
+
+    clock_state.stats.header_syncs++;
+    recordSync("Date header", had_time ? correction_ms : 0, HEADER_UNCERTAINTY_MS);
+}
+
+void TimeKeeper::recordSync(const char *source, int64_t correction_ms, uint32_t uncertainty_ms)
+{
+    clock_state.last_sync = time(nullptr);
+    clock_state.sync_uncertainty_ms = uncertainty_ms;
+    clock_state.stats.last_correction_ms = (int32_t)correction_ms;
+    if (llabs(correction_ms) > llabs(clock_state.stats.max_correction_ms))
+    {
+        clock_state.stats.max_correction_ms = (int32_t)correction_ms;
+    }
+
+    Serial.printf("Clock: synced from %s, corrected by %ld ms (drift %u ppm, %u NTP / %u header / %u skipped syncs)\n",
+                  source,
+                  (long)correction_ms,
+                  clock_state.stats.drift_ppm,
+                  clock_state.stats.ntp_syncs,
+                  clock_state.stats.header_syncs,
+                  clock_state.stats.skipped_syncs);
+}
+
+int64_t TimeKeeper::wallClockMs()
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
@@ -1,6 +1,23 @@
 #include "WiFiManager.h"
 #include "secrets.h"
 
+static const uint32_t CACHE_MAGIC = 0x57494649; // "WIFI"
+
+// Last working association, kept across deep sleep for a directed reconnect
+struct ConnectionCache
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t local_ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+RTC_DATA_ATTR static ConnectionCache connection_cache;
+RTC_DATA_ATTR static ConnectStats connect_stats;
+
 WiFiManager::WiFiManager() {}
 
 bool WiFiManager::connect()
@@ -16,34 +33,23 @@ void WiFiManager::ensureConnection()
     }
 }
 
+const ConnectStats &WiFiManager::getConnectStats() const
+{
+    return connect_stats;
+}
+
 bool WiFiManager::setupWiFi()
 {
     Serial.println("\n=== Setting up WiFi ===");
     WiFi.mode(WIFI_STA);
-    WiFi.begin(wifi_config.ssid, wifi_config.password);
 
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20)
-    {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-    }
-    Serial.println("");
-    const char *ntpServer = "pool.ntp.org";
-    configTime(0, 0, ntpServer);
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo, 1000))
-    {
-        Serial.println("Failed to obtain time");
-    }
-    else
-    {
-        Serial.println("Time obtained successfully");
-    }
+    bool connected = connectCached() || connectWithScan();
 
-    if (WiFi.status() == WL_CONNECTED)
+    if (connected)
     {
+        // Between requests the radio only wakes for every third DTIM beacon (the default listen interval)
+        WiFi.setSleep(WIFI_PS_MAX_MODEM);
+
         Serial.print("Connected to WiFi, IP: ");
         Serial.println(WiFi.localIP());
         return true;
@@ -55,10 +61,94 @@ bool WiFiManager::setupWiFi()
     }
 }
 
+bool WiFiManager::connectCached()
+{
+    if (connection_cache.magic != CACHE_MAGIC)
+        return false;
+
+    unsigned long start = millis();
+    WiFi.config(IPAddress(connection_cache.local_ip),
+                IPAddress(connection_cache.gateway),
+                IPAddress(connection_cache.subnet),
+                IPAddress(connection_cache.dns));
+    WiFi.begin(wifi_config.ssid, wifi_config.password, connection_cache.channel, connection_cache.bssid);
+
+    if (!waitForConnection(FAST_CONNECT_TIMEOUT))
+    {
+        // The access point moved or the address went stale, start over with a scan and DHCP
+        Serial.printf("Cached WiFi connect failed after %lu ms, falling back to a full scan\n", millis() - start);
+        connection_cache.magic = 0;
+        connect_stats.failed_fast_connects++;
+        WiFi.disconnect();
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());
+        return false;
+    }
+
+    connect_stats.last_connect_ms = millis() - start;
+    connect_stats.fast_connects++;
+    connect_stats.total_fast_ms += connect_stats.last_connect_ms;
+
+    Serial.printf("Connected via cached BSSID on channel %d in %u ms", connection_cache.channel, connect_stats.last_connect_ms);
+    if (connect_stats.scan_connects > 0)
+    {
+        Serial.printf(", %ld ms faster than the average scan connect",
+                      (long)(connect_stats.total_scan_ms / connect_stats.scan_connects) - (long)connect_stats.last_connect_ms);
+    }
+    Serial.println("");
+    return true;
+}
+
+bool WiFiManager::connectWithScan()
+{
+    unsigned long start = millis();
+    WiFi.begin(wifi_config.ssid, wifi_config.password);
+
+    if (!waitForConnection(SCAN_CONNECT_TIMEOUT))
+        return false;
+
+    connect_stats.last_connect_ms = millis() - start;
+    connect_stats.scan_connects++;
+    connect_stats.total_scan_ms += connect_stats.last_connect_ms;
+    Serial.printf("Connected after a full scan and DHCP in %u ms\n", connect_stats.last_connect_ms);
+
+    rememberConnection();
+    return true;
+}
+
+bool WiFiManager::waitForConnection(uint32_t timeout)
+{
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED)
+    {
+        if (millis() - start >= timeout)
+            return false;
+        delay(CONNECT_POLL_INTERVAL);
+    }
+    return true;
+}
+
+void WiFiManager::rememberConnection()
+{
+    memcpy(connection_cache.bssid, WiFi.BSSID(), sizeof(connection_cache.bssid));
+    connection_cache.channel = WiFi.channel();
+    connection_cache.local_ip = WiFi.localIP();
+    connection_cache.gateway = WiFi.gatewayIP();
+    connection_cache.subnet = WiFi.subnetMask();
+    connection_cache.dns = WiFi.dnsIP(0);
+    connection_cache.magic = CACHE_MAGIC;
+}
+
+void WiFiManager::disconnect()
+{
+    Serial.println("Turning WiFi off");
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+}
+
 void WiFiManager::reconnect()
 {
     Serial.println("Reconnecting to WiFi...");
     WiFi.disconnect();
     delay(1000);
     setupWiFi();
-}
\ No newline at end of file
+}
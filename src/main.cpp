@@ -4,142 +4,1061 @@
 #include "DisplayManager.h"
 #include "ModeManager.h"
 #include "BatteryMonitor.h"
+#include "TimeKeeper.h"
+#include "PowerManager.h"
+#include "DepartureSnapshot.h"
+#include "FetchScheduler.h"
 #include "config.h"
 #include <time.h>
 #include <esp_sleep.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
 
+const uint32_t MAX_CLOCK_ERROR = 30000; // Allowed clock error in ms before NTP is asked again
+const size_t FETCH_CONCURRENCY = 2;     // Requests of a fetch cycle in flight at once
+
+TimeKeeper timeKeeper(MAX_CLOCK_ERROR);
 WiFiManager wifiManager;
-MVGClient mvgClient;
+MVGClient mvgClient(timeKeeper, FETCH_CONCURRENCY);
 DisplayManager displayManager;
 ModeManager modeManager;
 BatteryMonitor batteryMonitor;
+PowerManager powerManager;
+DepartureSnapshot snapshot;
+FetchScheduler fetchScheduler;
 
-unsigned long lastUpdateTime = 0;
-unsigned long lastBatteryCheck = 0;
-const unsigned long UPDATE_INTERVAL = 60000;         // 1 minute in milliseconds
+const unsigned long TICK_INTERVAL = 60000;           // Longest countdown wait, refreshes follow the minute changes
 const unsigned long BATTERY_CHECK_INTERVAL = 300000; // 5 minutes in milliseconds
+const unsigned long CAROUSEL_INTERVAL = 5000;        // Each station is shown for 5 seconds after a fetch
+const unsigned long PREFETCH_MARGIN = 1000;          // Added to the p95 fetch time when asking for the next station
+const unsigned long PREFETCH_WAIT = 5000;            // Longest a carousel step waits for its station to arrive
+const unsigned long RADIO_OFF_MIN_INTERVAL = 180000; // Longer gaps between fetches are spent with WiFi off, shorter ones in modem sleep
+const unsigned long FIXED_FETCH_INTERVAL = 60000;    // The old schedule of refetching everything, as a baseline for the rates
+const bool DEEP_SLEEP_IN_LIVE_MODE = true;           // Deep sleep between updates instead of staying up through live mode
+const FrameFormat DEPARTURE_FORMAT = FrameFormat::MONO1; // Departure screens are plain black text, so they are composed at 1bpp
+const bool DASHBOARD_LAYOUT = false;                 // Every station on one screen, one refresh per fetch cycle, instead of the carousel
+const size_t DASHBOARD_SECTION_ROWS = 4;             // Most departures a station gets on the dashboard
+const size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
 
-void setup()
+// Dropping WiFi throws away the kept-alive connection, so only gaps it would not have survived anyway qualify
+static_assert(RADIO_OFF_MIN_INTERVAL > MVGClient::KEEP_ALIVE_IDLE_MS, "WiFi would go off while the connection is still kept alive");
+static_assert(RADIO_OFF_MIN_INTERVAL > FetchScheduler::MIN_INTERVAL * 1000UL && RADIO_OFF_MIN_INTERVAL > FIXED_FETCH_INTERVAL,
+              "WiFi would go off between regular fetches");
+
+// Task layout: input runs at the highest priority so a blocking fetch or a
+// long panel update never delays a button; network and render only meet at
+// the published table and the prefetch queue, so fetching the next station
+// overlaps with showing the current one
+const uint32_t NETWORK_TASK_STACK = 12288;
+const uint32_t RENDER_TASK_STACK = 6144;
+const uint32_t INPUT_TASK_STACK = 4096;
+const UBaseType_t NETWORK_TASK_PRIORITY = 1;
+const UBaseType_t RENDER_TASK_PRIORITY = 2;
+const UBaseType_t INPUT_TASK_PRIORITY = 3;
+const UBaseType_t RENDER_QUEUE_LENGTH = 4;
+const UBaseType_t PREFETCH_QUEUE_LENGTH = DepartureTable::MAX_STATIONS;
+
+const EventBits_t LIVE_MODE_BIT = 1 << 0; // Set while live mode is active
+const EventBits_t FETCH_NOW_BIT = 1 << 1; // Fetch without waiting out the interval
+const EventBits_t RESCHEDULE_BIT = 1 << 2; // Re-check the fetch deadline, e.g. after light sleep
+
+enum class RenderCommand : uint8_t
 {
-    Serial.begin(115200);
-    Serial.println("Starting MVG Display...");
+    SHOW_CONNECTING,
+    SHOW_DEPARTURES, // First station of a fetch cycle is in, start the carousel
+    STATION_READY,   // A prefetched station is in
+    SHOW_SLEEP,
+    DEEP_SLEEP,
+    RESCHEDULE // Re-check the render deadline
+};
 
-    // Initialize mode manager (handles buttons)
-    modeManager.init();
+EventGroupHandle_t appEvents;
+QueueHandle_t renderQueue;
+// Stations the carousel is about to show, for the network task to fetch ahead of them
+QueueHandle_t prefetchQueue;
 
-    // Initialize battery monitor
-    batteryMonitor.init();
+// Latest fetch result, written by the network task and copied out by the render task
+DepartureTable publishedTable;
+unsigned long publishedFetchedAt[DepartureTable::MAX_STATIONS]; // millis() each station's response came in
+uint32_t publishedPending = 0;                                 // Due stations the network task has yet to fetch
+SemaphoreHandle_t publishedTableMutex;
 
-    // Small delay to let system stabilize
-    delay(1000);
+// Render task copy of the published table that the screen is drawn from
+DepartureTable shownTable;
 
-    // Initialize display
-    displayManager.init();
-    if (!displayManager.isInitialized())
+// Station currently on screen and which table rows its lines show
+const size_t NO_STATION = SIZE_MAX;
+size_t shownStation = NO_STATION;
+size_t shownDepartures[DepartureTable::MAX_DEPARTURES];
+size_t shownRows = 0;
+time_t shownAt = 0; // Wall clock the minutes on screen were computed for
+unsigned long shownFetchedAt[DepartureTable::MAX_STATIONS];
+
+// Next carousel screen, composed in the display's back buffer
+size_t composedStation = NO_STATION;
+size_t composedDepartures[DepartureTable::MAX_DEPARTURES];
+size_t composedRows = 0;
+time_t composedAt = 0;
+
+// Dashboard on screen and which grid row each of its departures is drawn in
+struct DashboardRow
+{
+    uint8_t station;
+    uint8_t departure;
+    uint8_t row;
+};
+bool dashboardShown = false;
+DashboardRow dashboardRows[DepartureTable::MAX_STATIONS * DASHBOARD_SECTION_ROWS];
+size_t dashboardRowCount = 0;
+unsigned long dashboardTickedAt = 0; // millis() of the last dashboard refresh
+
+// Panel refreshes already added to the fetch rates
+uint32_t recordedRefreshes = 0;
+
+// A live mode resumed from deep sleep starts out with the restored departures
+unsigned long resumedFetchDelay = 0;
+
+// Draws a station screen from the table, skipping departures that already left;
+// returns how many rows were drawn and fills in which table rows they show
+size_t composeStation(size_t station, size_t *departures, time_t now)
+{
+    const DepartureTable &stations = shownTable;
+    displayManager.setFrameFormat(DEPARTURE_FORMAT);
+    displayManager.startStationDisplay(stations.stationName(station));
+
+    size_t rows = 0;
+    for (size_t i = 0; i < stations.departureCount(station); i++)
     {
-        Serial.println("Failed to initialize display!");
+        uint32_t departure_time = stations.departureTime(station, i);
+        if ((time_t)departure_time <= now)
+            continue;
+
+        if (!displayManager.displayDeparture(
+                stations.line(station, i),
+                stations.destination(station, i),
+                DepartureTable::minutesUntil(departure_time, now)))
+        {
+            break; // Stop if display is full
+        }
+        departures[rows++] = i;
+    }
+    return rows;
+}
+
+// Draws every station with upcoming departures as a section of the dashboard. Rows are
+// shared out evenly, up to DASHBOARD_SECTION_ROWS each, and what a short section leaves
+// goes to the ones after it
+void composeDashboard(time_t now)
+{
+    const DepartureTable &stations = shownTable;
+    displayManager.setFrameFormat(DEPARTURE_FORMAT);
+    displayManager.startDashboard();
+    dashboardRowCount = 0;
+
+    size_t upcoming[DepartureTable::MAX_STATIONS];
+    size_t sections = 0;
+    for (size_t station = 0; station < stations.stationCount(); station++)
+    {
+        upcoming[station] = 0;
+        for (size_t i = 0; i < stations.departureCount(station); i++)
+        {
+            if ((time_t)stations.departureTime(station, i) > now)
+                upcoming[station]++;
+        }
+        if (upcoming[station])
+            sections++;
+    }
+
+    for (size_t station = 0; station < stations.stationCount() && sections; station++)
+    {
+        if (!upcoming[station])
+            continue;
+
+        // Rows left once every remaining section has its header
+        size_t spare = displayManager.rowsLeft() > sections ? displayManager.rowsLeft() - sections : 0;
+        size_t rows = min(min(DASHBOARD_SECTION_ROWS, upcoming[station]), (spare + sections - 1) / sections);
+        sections--;
+        if (!rows || !displayManager.addSection(stations.stationName(station)))
+            continue;
+
+        for (size_t i = 0; i < stations.departureCount(station) && rows; i++)
+        {
+            uint32_t departure_time = stations.departureTime(station, i);
+            if ((time_t)departure_time <= now)
+                continue;
+
+            size_t row = displayManager.currentRow();
+            if (!displayManager.displayDeparture(
+                    stations.line(station, i),
+                    stations.destination(station, i),
+                    DepartureTable::minutesUntil(departure_time, now)))
+            {
+                break;
+            }
+            dashboardRows[dashboardRowCount++] = {(uint8_t)station, (uint8_t)i, (uint8_t)row};
+            rows--;
+        }
+    }
+}
+
+void showDashboard()
+{
+    time_t now;
+    time(&now);
+    composeDashboard(now);
+    dashboardShown = true;
+    shownAt = now;
+    dashboardTickedAt = millis();
+
+    // All stations go up in one refresh
+    displayManager.commit();
+}
+
+void showStation(size_t station)
+{
+    time_t now;
+    time(&now);
+    shownRows = composeStation(station, shownDepartures, now);
+    shownStation = station;
+    shownAt = now;
+
+    // Push all rows of this station in one refresh
+    displayManager.commit();
+}
+
+// Prepares the next carousel screen off-screen, so switching to it is only a commit
+void composeBackFrame(size_t station)
+{
+    if (!displayManager.beginBackFrame())
+    {
+        composedStation = NO_STATION;
         return;
     }
 
-    // Start in sleep mode - display static information
-    displayManager.displaySleepMode();
-    displayManager.powerOff();
+    time(&composedAt);
+    composedRows = composeStation(station, composedDepartures, composedAt);
+    composedStation = station;
+    displayManager.endBackFrame();
+}
 
-    Serial.println("Setup complete - entering sleep mode");
+// Puts a carousel station up, from the back buffer when it was composed ahead
+void presentStation(size_t station)
+{
+    if (composedStation == station && displayManager.presentBackFrame())
+    {
+        shownStation = station;
+        shownRows = composedRows;
+        shownAt = composedAt;
+        memcpy(shownDepartures, composedDepartures, sizeof(shownDepartures));
+    }
+    else
+    {
+        showStation(station);
+    }
+    composedStation = NO_STATION;
+
+    if (shownFetchedAt[station])
+    {
+        Serial.printf("Station %u on screen %lu ms after its fetch\n", (unsigned)station, millis() - shownFetchedAt[station]);
+    }
 }
 
-void loop()
+// Recomputes the minute fields of the shown station from the stored departure times
+void tickShownStation()
 {
-    // Update mode manager (handles button presses and timeouts)
-    modeManager.update();
+    const DepartureTable &stations = shownTable;
+    if (shownStation == NO_STATION)
+        return;
+
+    time_t now;
+    time(&now);
+
+    for (size_t row = 0; row < shownRows; row++)
+    {
+        if ((time_t)stations.departureTime(shownStation, shownDepartures[row]) <= now)
+        {
+            // A train has left, so the rows below move up
+            showStation(shownStation);
+            return;
+        }
+    }
+
+    for (size_t row = 0; row < shownRows; row++)
+    {
+        uint32_t departure_time = stations.departureTime(shownStation, shownDepartures[row]);
+        displayManager.updateDepartureMinutes(row, DepartureTable::minutesUntil(departure_time, now));
+    }
+    shownAt = now;
+    displayManager.commit();
+}
+
+// Recomputes the minute fields of every dashboard section in one refresh
+void tickDashboard()
+{
+    const DepartureTable &stations = shownTable;
+    if (!dashboardShown)
+        return;
 
-    unsigned long currentTime = millis();
+    time_t now;
+    time(&now);
 
-    if (modeManager.getCurrentMode() == DisplayMode::SLEEP)
+    for (size_t i = 0; i < dashboardRowCount; i++)
     {
-        // In sleep mode, just wait for button press
-        if (modeManager.shouldEnterSleep())
+        if ((time_t)stations.departureTime(dashboardRows[i].station, dashboardRows[i].departure) <= now)
         {
-            Serial.println("Entering deep sleep...");
-            displayManager.powerOff();
-            esp_deep_sleep_start();
+            // A train has left, so its section loses a row and the sections below move up
+            showDashboard();
+            return;
         }
-        delay(100);
+    }
+
+    for (size_t i = 0; i < dashboardRowCount; i++)
+    {
+        uint32_t departure_time = stations.departureTime(dashboardRows[i].station, dashboardRows[i].departure);
+        displayManager.updateDepartureMinutes(dashboardRows[i].row, DepartureTable::minutesUntil(departure_time, now));
+    }
+    shownAt = now;
+    dashboardTickedAt = millis();
+    displayManager.commit();
+}
+
+// Time until a minute on the dashboard changes. The sections count down at different
+// seconds, so their changes are taken together at most once per TICK_INTERVAL
+unsigned long nextDashboardTickDelay()
+{
+    time_t now;
+    time(&now);
+
+    unsigned long delay_ms = TICK_INTERVAL;
+    for (size_t i = 0; i < dashboardRowCount; i++)
+    {
+        long remaining = (long)shownTable.departureTime(dashboardRows[i].station, dashboardRows[i].departure) - now;
+        if (remaining < 0)
+            return 0;
+        delay_ms = min(delay_ms, (unsigned long)(remaining % 60 + 1) * 1000UL);
+    }
+
+    unsigned long since = millis() - dashboardTickedAt;
+    return max(delay_ms, since < TICK_INTERVAL ? TICK_INTERVAL - since : 0UL);
+}
+
+// Time until a minute on screen changes, so the countdown only wakes up when it has something to draw
+unsigned long nextTickDelay()
+{
+    if (dashboardShown)
+        return nextDashboardTickDelay();
+    if (shownStation == NO_STATION)
+        return TICK_INTERVAL;
+
+    time_t now;
+    time(&now);
+
+    unsigned long delay_ms = TICK_INTERVAL;
+    for (size_t row = 0; row < shownRows; row++)
+    {
+        long remaining = (long)shownTable.departureTime(shownStation, shownDepartures[row]) - now;
+        if (remaining < 0)
+            return 0;
+        // The whole minutes shown drop once the remaining seconds pass the next multiple of 60
+        delay_ms = min(delay_ms, (unsigned long)(remaining % 60 + 1) * 1000UL);
+    }
+    return delay_ms;
+}
+
+void sendRenderCommand(RenderCommand command)
+{
+    xQueueSend(renderQueue, &command, portMAX_DELAY);
+}
+
+// Light sleep stops the tick count, so blocked tasks are told to look at the clock again
+void rescheduleTasks()
+{
+    RenderCommand command = RenderCommand::RESCHEDULE;
+    xQueueSend(renderQueue, &command, 0);
+    xEventGroupSetBits(appEvents, RESCHEDULE_BIT);
+    modeManager.wake();
+}
+
+void powerDownRadio()
+{
+    if (!wifiManager.isConnected())
+        return;
+
+    mvgClient.closeConnection();
+    wifiManager.disconnect();
+    powerManager.setRadioOn(false);
+}
+
+// Adds the panel refreshes since the last call to the fetch rates, which outlast deep sleep
+void recordRefreshes()
+{
+    uint32_t refreshes = displayManager.getFrameStats().refreshes;
+    fetchScheduler.recordRefreshes(refreshes - recordedRefreshes);
+    recordedRefreshes = refreshes;
+}
+
+// Logs the fetch rates of live mode next to what the fixed schedule would have needed
+void logFetchRates()
+{
+    FetchRates rates = fetchScheduler.getRates();
+    if (!rates.live_s || !rates.cycles)
+        return;
+
+    // The fixed schedule fetched every station each time, so it costs what a full cycle costs here
+    float fixedCyclesPerHour = 3600000.0f / FIXED_FETCH_INTERVAL;
+    uint32_t fullCycleRadioMs = rates.full_cycles ? rates.full_radio_ms / rates.full_cycles : rates.radio_ms / rates.cycles;
+    Serial.printf("Fetch rates over the last hour of %lu s of live mode: %.1f requests/h, %.1f s radio/h (fixed schedule: %.1f requests/h, %.1f s radio/h)\n",
+                  (unsigned long)rates.live_s,
+                  rates.requests_per_hour,
+                  rates.radio_s_per_hour,
+                  fixedCyclesPerHour * mvgClient.getRequestCount(),
+                  fixedCyclesPerHour * fullCycleRadioMs / 1000.0f);
+    Serial.printf("Panel refreshes over %lu s of live mode: %u, %.1f/h in the last hour (%s)\n",
+                  (unsigned long)rates.live_s,
+                  rates.refreshes,
+                  rates.refreshes_per_hour,
+                  DASHBOARD_LAYOUT ? "dashboard" : "carousel");
+}
+
+void logFrameStats()
+{
+    FrameStats frames = displayManager.getFrameStats();
+    if (!frames.frames_handed)
         return;
+
+    Serial.printf("Frames: %u handed off, %u pushed, %u replaced, %u refreshes; compose %u us (max %u), handoff %u us (max %u), push %u ms (max %u)\n",
+                  frames.frames_handed, frames.frames_pushed, frames.frames_replaced, frames.refreshes,
+                  frames.last_compose_us, frames.max_compose_us,
+                  frames.last_handoff_us, frames.max_handoff_us,
+                  frames.last_push_ms, frames.max_push_ms);
+
+    if (frames.gray_pushes || frames.mono_pushes)
+    {
+        Serial.printf("Push by format: gray %u frames, %u ms avg, %u byte buffers; mono %u frames, %u ms avg, %u byte buffers\n",
+                      frames.gray_pushes, frames.gray_pushes ? frames.gray_push_ms / frames.gray_pushes : 0,
+                      (unsigned)DisplayManager::composeBytes(FrameFormat::GRAY4),
+                      frames.mono_pushes, frames.mono_pushes ? frames.mono_push_ms / frames.mono_pushes : 0,
+                      (unsigned)DisplayManager::composeBytes(FrameFormat::MONO1));
+    }
+
+    const GlyphCacheStats &glyphs = displayManager.getGlyphCacheStats();
+    Serial.printf("Glyph cache: %u/%u glyph hits, %u/%u run hits, %u drawn by the driver, %u flushes, %u + %u bytes\n",
+                  glyphs.glyph_hits, glyphs.glyph_hits + glyphs.glyph_misses,
+                  glyphs.run_hits, glyphs.run_hits + glyphs.run_misses,
+                  glyphs.uncached, glyphs.glyph_flushes, glyphs.arena_used, glyphs.run_bytes);
+
+    const TextLayoutStats &layout = displayManager.getLayoutStats();
+    Serial.printf("Layout: %u/%u fits cached, %u strings truncated\n",
+                  layout.fit_hits, layout.fit_hits + layout.fit_misses, layout.truncated);
+}
+
+// Fetches the stations in stationMask and hands the table to the render task; returns the stations that got a response
+uint32_t fetchAndPublish(uint32_t stationMask, uint32_t pending)
+{
+    Serial.printf("Fetching live departures (stations 0x%x)...\n", (unsigned)stationMask);
+    mvgClient.fetchDepartures(stationMask);
+    uint32_t updated = mvgClient.getUpdatedMask();
+    unsigned long fetchedAt = millis();
+
+    xSemaphoreTake(publishedTableMutex, portMAX_DELAY);
+    publishedTable = mvgClient.getStationList();
+    for (size_t station = 0; station < CONFIG_COUNT; station++)
+    {
+        if (updated & (1UL << station))
+        {
+            publishedFetchedAt[station] = fetchedAt;
+        }
     }
+    publishedPending = pending & ~updated;
+    xSemaphoreGive(publishedTableMutex);
+    return updated;
+}
 
-    // Live mode - handle data updates
-    if (modeManager.getCurrentMode() == DisplayMode::LIVE)
+// Fetches each pending station when the carousel asks for it, and whatever it did not ask for in time together
+uint32_t servePrefetches(uint32_t pending)
+{
+    uint32_t updated = 0;
+    while (pending && (xEventGroupGetBits(appEvents) & LIVE_MODE_BIT))
     {
+        unsigned long wait = CAROUSEL_INTERVAL + PREFETCH_WAIT;
+        powerManager.setDeadline(PowerManager::FETCH, millis() + wait);
+        powerManager.endWork();
+        uint8_t station;
+        bool requested = xQueueReceive(prefetchQueue, &station, pdMS_TO_TICKS(wait)) == pdTRUE;
+        powerManager.beginWork();
 
-        unsigned long currentTime = millis();
+        uint32_t stationMask = requested ? pending & (1UL << station) : pending;
+        if (!stationMask)
+            continue;
+
+        uint32_t fetched = fetchAndPublish(stationMask, pending & ~stationMask);
+        updated |= fetched;
+        pending &= ~(stationMask | fetched);
+        sendRenderCommand(RenderCommand::STATION_READY);
+    }
+    return updated;
+}
+
+// Fetches while live mode is active, each station at the interval its departures allow
+void networkTask(void *parameter)
+{
+    unsigned long nextFetch = millis() + resumedFetchDelay;
 
-        // Check if it's time to update or if we just switched to live mode
-        if (currentTime - lastUpdateTime >= UPDATE_INTERVAL || lastUpdateTime == 0)
+    for (;;)
+    {
+        if (!(xEventGroupGetBits(appEvents) & LIVE_MODE_BIT))
+        {
+            // Nothing to fetch until live mode comes back
+            powerDownRadio();
+            powerManager.setDeadline(PowerManager::FETCH, PowerManager::NO_DEADLINE);
+            xEventGroupWaitBits(appEvents, LIVE_MODE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        }
+
+        // Re-entering live mode cuts the wait short
+        powerManager.setDeadline(PowerManager::FETCH, nextFetch);
+        EventBits_t bits;
+        for (;;)
+        {
+            bits = xEventGroupGetBits(appEvents);
+            long remaining = (long)(nextFetch - millis());
+            if (remaining <= 0 || (bits & FETCH_NOW_BIT) || !(bits & LIVE_MODE_BIT))
+                break;
+
+            xEventGroupWaitBits(appEvents, FETCH_NOW_BIT | RESCHEDULE_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(remaining));
+            xEventGroupClearBits(appEvents, RESCHEDULE_BIT);
+        }
+        if (!(bits & LIVE_MODE_BIT))
+            continue;
+
+        xEventGroupClearBits(appEvents, FETCH_NOW_BIT);
+        powerManager.beginWork();
+
+        time_t now;
+        time(&now);
+        if (bits & FETCH_NOW_BIT)
         {
-            Serial.println("Live mode - powering on display and connecting to WiFi...");
-            if (!wifiManager.isConnected())
+            fetchScheduler.startLive(now);
+        }
+        uint32_t stationMask = fetchScheduler.dueStations(CONFIG_COUNT, now);
+        bool allStations = stationMask == (1UL << CONFIG_COUNT) - 1;
+        uint32_t updatedMask = 0;
+        unsigned long cycleStart = millis();
+        uint32_t requestsBefore = mvgClient.getFetchStats().requests;
+
+        if (!wifiManager.isConnected())
+        {
+            Serial.println("Powering on display and connecting to WiFi...");
+            sendRenderCommand(RenderCommand::SHOW_CONNECTING);
+            wifiManager.connect();
+        }
+
+        wifiManager.ensureConnection();
+        powerManager.setRadioOn(wifiManager.isConnected());
+
+        if (wifiManager.isConnected())
+        {
+            timeKeeper.maintain();
+
+            if (DASHBOARD_LAYOUT)
             {
-                Serial.println("Powering on display and connecting to WiFi...");
-                wifiManager.connect();
+                // The dashboard shows every station, so all due stations are fetched before it is redrawn once
+                updatedMask = fetchAndPublish(stationMask, 0);
+                sendRenderCommand(RenderCommand::SHOW_DEPARTURES);
+            }
+            else
+            {
+                // Only the first due station is fetched up front; each of the others is fetched
+                // while the carousel shows the station before it, so it is fresh when its turn comes
+                xQueueReset(prefetchQueue);
+                uint32_t firstStation = stationMask & (~stationMask + 1);
+                updatedMask = fetchAndPublish(firstStation, stationMask & ~firstStation);
+                sendRenderCommand(RenderCommand::SHOW_DEPARTURES);
+                updatedMask |= servePrefetches(stationMask & ~firstStation & ~updatedMask);
+            }
+        }
+        else
+        {
+            Serial.println("WiFi connection failed in live mode");
+        }
+
+        bool connected = wifiManager.isConnected();
+        time(&now);
+        // A shared request also refreshes configs of the same station that were not due yet
+        for (size_t station = 0; station < CONFIG_COUNT; station++)
+        {
+            if (!((stationMask | updatedMask) & (1UL << station)))
+                continue;
+
+            bool updated = updatedMask & (1UL << station);
+            fetchScheduler.planStation(station, mvgClient.getStationList(), updated, mvgClient.getMeanDelay(station), now);
+            Serial.printf("Station %u: next fetch in %ld s (mean delay %u s)\n",
+                          (unsigned)station,
+                          (long)fetchScheduler.interval(station),
+                          fetchScheduler.volatility(station));
+        }
+        // Live mode may cost as much as the fixed schedule did, never more
+        fetchScheduler.setRequestBudget(3600000UL / FIXED_FETCH_INTERVAL * mvgClient.getRequestCount(), now);
+        fetchScheduler.recordCycle(mvgClient.getFetchStats().requests - requestsBefore,
+                                   connected ? millis() - cycleStart : 0,
+                                   allStations,
+                                   now);
+        recordRefreshes();
+        logFetchRates();
+
+        long untilFetch = max((long)(fetchScheduler.nextFetchTime(CONFIG_COUNT) - now), 0L);
+        unsigned long fetchInterval = untilFetch * 1000UL;
+        nextFetch = millis() + fetchInterval;
+        Serial.printf("Next fetch in %lu s\n", fetchInterval / 1000);
+
+        // Without automatic light sleep the chip can only sleep with the radio off,
+        // and a reconnect through the cached access point is cheaper than staying associated
+        if (!powerManager.hasAutomaticLightSleep() && fetchInterval >= RADIO_OFF_MIN_INTERVAL)
+        {
+            powerDownRadio();
+        }
+
+        powerManager.endWork();
+    }
+}
+
+// Copies the latest fetch result for drawing; returns the due stations that are still being fetched
+uint32_t takePublished()
+{
+    xSemaphoreTake(publishedTableMutex, portMAX_DELAY);
+    shownTable = publishedTable;
+    memcpy(shownFetchedAt, publishedFetchedAt, sizeof(shownFetchedAt));
+    uint32_t pending = publishedPending;
+    xSemaphoreGive(publishedTableMutex);
+    return pending;
+}
+
+// How long before a carousel step its station is asked for, so the response is in by then
+unsigned long prefetchLead()
+{
+    return min(mvgClient.getFetchStats().cycle_p95_ms + PREFETCH_MARGIN, CAROUSEL_INTERVAL);
+}
+
+// Owns the display: runs the station carousel after each fetch, then counts down the last station.
+// While a station is up, the next one is fetched and composed in the back buffer. With
+// DASHBOARD_LAYOUT every fetch redraws the dashboard instead, which then counts down
+void renderTask(void *parameter)
+{
+    size_t carouselStation = NO_STATION; // Next station the carousel shows
+    uint32_t pendingStations = 0;        // Due stations the network task has not fetched yet
+    bool prefetchRequested = false;
+    bool waitingForStation = false;
+    unsigned long prefetchAt = 0;
+    unsigned long nextUpdate = millis() + nextTickDelay();
+
+    for (;;)
+    {
+        bool prefetchDue = carouselStation < CONFIG_COUNT && !prefetchRequested &&
+                           (pendingStations & (1UL << carouselStation));
+        unsigned long wakeAt = prefetchDue && (long)(prefetchAt - nextUpdate) < 0 ? prefetchAt : nextUpdate;
+
+        TickType_t wait = portMAX_DELAY;
+        if (carouselStation != NO_STATION || shownStation != NO_STATION || dashboardShown)
+        {
+            long remaining = (long)(wakeAt - millis());
+            wait = remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+            powerManager.setDeadline(PowerManager::RENDER, wakeAt);
+        }
+        else
+        {
+            powerManager.setDeadline(PowerManager::RENDER, PowerManager::NO_DEADLINE);
+        }
+
+        RenderCommand command;
+        bool received = xQueueReceive(renderQueue, &command, wait) == pdTRUE;
+        if (received && command == RenderCommand::RESCHEDULE)
+            continue;
+
+        powerManager.beginWork();
+        if (received)
+        {
+            switch (command)
+            {
+            case RenderCommand::SHOW_CONNECTING:
+            {
+                // Departures stay up while the radio reconnects between fetches
+                if (shownStation != NO_STATION || carouselStation != NO_STATION || dashboardShown)
+                    break;
+
                 displayManager.powerOn();
                 displayManager.displayConnecting();
                 // Display battery status text
                 String batteryStatus = batteryMonitor.getBatteryStatus();
                 Serial.println("Battery: " + batteryStatus);
                 displayManager.displayBatteryStatus(batteryStatus);
+                break;
             }
-
-            wifiManager.ensureConnection();
-
-            if (wifiManager.isConnected())
+            case RenderCommand::SHOW_DEPARTURES:
+                pendingStations = takePublished();
+                shownStation = NO_STATION;
+                composedStation = NO_STATION;
+                if (DASHBOARD_LAYOUT)
+                {
+                    showDashboard();
+                    nextUpdate = millis() + nextTickDelay();
+                    break;
+                }
+                carouselStation = 0;
+                prefetchRequested = false;
+                waitingForStation = false;
+                nextUpdate = millis();
+                break;
+            case RenderCommand::STATION_READY:
             {
-                Serial.println("Fetching live departures...");
-                mvgClient.fetchDepartures();
+                unsigned long shownFetch = shownStation != NO_STATION ? shownFetchedAt[shownStation] : 0;
+                pendingStations = takePublished();
 
-                // Display departures for each station
-                const auto &stations = mvgClient.getStationList();
-                for (const auto &station : stations)
+                // A shared request may have refreshed the station on screen, whose rows then point elsewhere
+                if (shownStation != NO_STATION && shownFetchedAt[shownStation] != shownFetch)
                 {
-                    displayManager.startStationDisplay(station.station_name.c_str());
-
-                    for (const auto &departure : station.departure_list)
+                    showStation(shownStation);
+                }
+                if (carouselStation < CONFIG_COUNT && !(pendingStations & (1UL << carouselStation)))
+                {
+                    if (shownTable.departureCount(carouselStation) > 0)
+                    {
+                        composeBackFrame(carouselStation);
+                    }
+                    if (waitingForStation)
                     {
-                        if (!displayManager.displayDeparture(
-                                departure.line,
-                                departure.destination,
-                                departure.time_to_departure))
-                        {
-                            break; // Stop if display is full
-                        }
+                        nextUpdate = millis();
                     }
+                }
+                break;
+            }
+            case RenderCommand::SHOW_SLEEP:
+                carouselStation = NO_STATION;
+                shownStation = NO_STATION;
+                dashboardShown = false;
+                composedStation = NO_STATION;
+                displayManager.displaySleepMode();
+                displayManager.powerOff();
+                logFrameStats();
+                break;
+            case RenderCommand::DEEP_SLEEP:
+                Serial.println("Entering deep sleep...");
+                displayManager.powerOff();
+                esp_deep_sleep_start();
+                break;
+            case RenderCommand::RESCHEDULE:
+                break;
+            }
+        }
+        else if (carouselStation != NO_STATION && (long)(millis() - nextUpdate) < 0)
+        {
+            // Woke up ahead of the step to ask for its station
+            uint8_t station = carouselStation;
+            xQueueSend(prefetchQueue, &station, 0);
+            prefetchRequested = true;
+        }
+        else if (carouselStation != NO_STATION)
+        {
+            // Stations without departures are skipped, unless they are still being fetched
+            while (carouselStation < CONFIG_COUNT && !(pendingStations & (1UL << carouselStation)) &&
+                   shownTable.departureCount(carouselStation) == 0)
+            {
+                carouselStation++;
+            }
 
-                    delay(5000); // Show each station for 5 seconds
+            if (carouselStation >= CONFIG_COUNT)
+            {
+                // The last station stays up and counts down until the next fetch
+                carouselStation = NO_STATION;
+                nextUpdate = millis() + nextTickDelay();
+            }
+            else if ((pendingStations & (1UL << carouselStation)) && !waitingForStation)
+            {
+                // Late: hold the current screen until the station arrives or the wait runs out
+                if (!prefetchRequested)
+                {
+                    uint8_t station = carouselStation;
+                    xQueueSend(prefetchQueue, &station, 0);
+                    prefetchRequested = true;
                 }
+                waitingForStation = true;
+                nextUpdate = millis() + PREFETCH_WAIT;
+            }
+            else if (shownTable.departureCount(carouselStation) == 0)
+            {
+                // Gave up waiting and there is nothing older to show
+                carouselStation++;
+                waitingForStation = false;
+                nextUpdate = millis();
             }
             else
             {
-                Serial.println("WiFi connection failed in live mode");
-                // Show error message on display
-                displayManager.clear();
-                int32_t cursor_x = 50;
-                int32_t cursor_y = 300;
-                // Note: You might need to add an error display method to DisplayManager
+                presentStation(carouselStation++);
+                prefetchRequested = false;
+                waitingForStation = false;
+                nextUpdate = millis() + CAROUSEL_INTERVAL;
+                prefetchAt = nextUpdate - prefetchLead();
+
+                // A station that is not due again is composed straight away
+                if (carouselStation < CONFIG_COUNT && !(pendingStations & (1UL << carouselStation)) &&
+                    shownTable.departureCount(carouselStation) > 0)
+                {
+                    composeBackFrame(carouselStation);
+                }
+            }
+        }
+        else
+        {
+            // Between fetches the countdown runs locally from the absolute departure times
+            if (dashboardShown)
+            {
+                tickDashboard();
             }
+            else
+            {
+                tickShownStation();
+            }
+            nextUpdate = millis() + nextTickDelay();
+        }
+        powerManager.endWork();
+    }
+}
 
-            lastUpdateTime = currentTime;
+// Sleeps on the button queue and turns mode changes into events for the other tasks
+void inputTask(void *parameter)
+{
+    DisplayMode lastMode = modeManager.getCurrentMode();
+    uint32_t wakeups = 0;
+    unsigned long wakeupsSince = millis();
+
+    for (;;)
+    {
+        // Blocks until a button press or the live mode timeout
+        TickType_t wait = modeManager.ticksUntilTimeout();
+        powerManager.setDeadline(PowerManager::MODE_TIMEOUT,
+                                 wait == portMAX_DELAY ? PowerManager::NO_DEADLINE : millis() + wait);
+        modeManager.update(wait);
+        wakeups++;
+        DisplayMode mode = modeManager.getCurrentMode();
+
+        if (mode == DisplayMode::LIVE && lastMode != DisplayMode::LIVE)
+        {
+            Serial.println("Live mode - waking the network task");
+            xEventGroupSetBits(appEvents, LIVE_MODE_BIT | FETCH_NOW_BIT);
         }
 
-        // Check if we should go back to sleep mode
-        if (modeManager.shouldEnterSleep())
+        if (mode == DisplayMode::LIVE && modeManager.shouldEnterSleep())
         {
             Serial.println("Returning to sleep mode...");
             modeManager.enterSleepMode();
-            displayManager.displaySleepMode();
-            displayManager.powerOff();
-            lastUpdateTime = 0; // Reset update timer
+            xEventGroupClearBits(appEvents, LIVE_MODE_BIT);
+            xEventGroupSetBits(appEvents, RESCHEDULE_BIT);
+            sendRenderCommand(RenderCommand::SHOW_SLEEP);
+            mode = DisplayMode::SLEEP;
         }
+        else if (mode == DisplayMode::SLEEP && modeManager.shouldEnterSleep())
+        {
+            sendRenderCommand(RenderCommand::DEEP_SLEEP);
+        }
+
+        if (mode != lastMode)
+        {
+            unsigned long elapsed = millis() - wakeupsSince;
+            Serial.printf("Input task woke %u times in %lu s (%.2f per second)\n",
+                          wakeups,
+                          elapsed / 1000,
+                          elapsed ? wakeups * 1000.0f / elapsed : 0.0f);
+            wakeups = 0;
+            wakeupsSince = millis();
+        }
+
+        lastMode = mode;
+    }
+}
+
+// Takes a long idle window of live mode in deep sleep; the snapshot brings the screen back on the timer wake
+void enterLiveDeepSleep(unsigned long window_ms)
+{
+    long fetchIn = powerManager.timeUntil(PowerManager::FETCH);
+    long liveLeft = powerManager.timeUntil(PowerManager::MODE_TIMEOUT);
+    if (!DEEP_SLEEP_IN_LIVE_MODE || !(xEventGroupGetBits(appEvents) & LIVE_MODE_BIT) ||
+        fetchIn < 0 || liveLeft < 0 || !timeKeeper.isValid() || modeManager.isButtonHeld())
+        return;
+
+    time_t now;
+    time(&now);
+
+    ShownScreen screen = {DepartureSnapshot::NO_STATION, 0, {}, (uint32_t)shownAt};
+    if (dashboardShown)
+    {
+        screen.station = DepartureSnapshot::DASHBOARD;
+    }
+    else if (shownStation != NO_STATION)
+    {
+        screen.station = shownStation;
+        screen.rows = shownRows;
+        for (size_t row = 0; row < shownRows; row++)
+        {
+            screen.departures[row] = shownDepartures[row];
+        }
+    }
+
+    LiveSchedule schedule = {(uint32_t)(now + liveLeft / 1000)};
+    if (!snapshot.save(shownTable, screen, schedule))
+        return;
+
+    powerDownRadio();
+    displayManager.powerOff();
+    recordRefreshes();
+    logFrameStats();
+    modeManager.armDeepSleepWakeup();
+    esp_sleep_enable_timer_wakeup((uint64_t)window_ms * 1000);
+
+    Serial.printf("Deep sleep for %lu s until the next update\n", window_ms / 1000);
+    Serial.flush();
+    esp_deep_sleep_start();
+}
+
+// After a wake from live mode deep sleep the panel still shows the last frame,
+// so the snapshot brings the countdown up to date before anything else starts
+bool resumeLiveMode()
+{
+    esp_sleep_source_t cause = esp_sleep_get_wakeup_cause();
+    if ((cause != ESP_SLEEP_WAKEUP_TIMER && cause != ESP_SLEEP_WAKEUP_EXT1) || !snapshot.isValid())
+        return false;
+
+    ShownScreen screen;
+    if (!snapshot.restore(shownTable, screen))
+        return false;
+
+    // Used up either way; the next deep sleep writes a fresh one
+    snapshot.invalidate();
+
+    time_t now;
+    time(&now);
+    const LiveSchedule &schedule = snapshot.getSchedule();
+    bool buttonWake = cause == ESP_SLEEP_WAKEUP_EXT1;
+    if (!buttonWake && now >= (time_t)schedule.live_until)
+    {
+        Serial.println("Live mode ran out during deep sleep");
+        return false;
+    }
+
+    displayManager.init(true);
+    if (!displayManager.isInitialized())
+        return false;
+
+    // Redraw the frame the panel still shows, so the next commit only pushes what changed since
+    if (screen.station == DepartureSnapshot::DASHBOARD)
+    {
+        composeDashboard(screen.drawn_at);
+        displayManager.adoptFrame();
+
+        dashboardShown = true;
+        tickDashboard();
+    }
+    else if (screen.station != DepartureSnapshot::NO_STATION)
+    {
+        displayManager.setFrameFormat(DEPARTURE_FORMAT);
+        displayManager.startStationDisplay(shownTable.stationName(screen.station));
+        for (size_t row = 0; row < screen.rows; row++)
+        {
+            size_t index = screen.departures[row];
+            displayManager.displayDeparture(shownTable.line(screen.station, index),
+                                            shownTable.destination(screen.station, index),
+                                            DepartureTable::minutesUntil(shownTable.departureTime(screen.station, index), screen.drawn_at));
+            shownDepartures[row] = index;
+        }
+        displayManager.adoptFrame();
+
+        shownStation = screen.station;
+        shownRows = screen.rows;
+        tickShownStation();
+    }
+
+    mvgClient.restoreStations(shownTable);
+    publishedTable = shownTable;
+    // The fetch plan is kept in RTC memory as well
+    time_t nextFetch = fetchScheduler.nextFetchTime(CONFIG_COUNT);
+    resumedFetchDelay = nextFetch > now ? (nextFetch - now) * 1000UL : 0;
+
+    if (buttonWake)
+    {
+        // A press in live mode restarts its timeout
+        modeManager.enterLiveMode();
     }
+    else
+    {
+        modeManager.resumeLiveMode((schedule.live_until - now) * 1000UL);
+    }
+
+    Serial.printf("Woke from deep sleep (%s): departures up to date %lu ms after wake, next fetch in %lu s\n",
+                  buttonWake ? "button" : "timer",
+                  (unsigned long)(esp_timer_get_time() / 1000),
+                  resumedFetchDelay / 1000);
+    return true;
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("Starting MVG Display...");
 
-    delay(1000); // Small delay to prevent busy waiting
+    // Initialize mode manager (handles buttons)
+    modeManager.init();
+
+    // Initialize battery monitor
+    batteryMonitor.init();
+
+    // Departures keep what the station font draws; smaller fonts spell the rest out per screen
+    mvgClient.setTextFont(displayManager.stationFont());
+
+    bool resumed = DEEP_SLEEP_IN_LIVE_MODE && resumeLiveMode();
+    if (!resumed)
+    {
+        // Small delay to let system stabilize
+        delay(1000);
+
+        // Initialize display
+        displayManager.init();
+        if (!displayManager.isInitialized())
+        {
+            Serial.println("Failed to initialize display!");
+            return;
+        }
+
+        // Start in sleep mode - display static information
+        displayManager.displaySleepMode();
+        displayManager.powerOff();
+    }
+
+    appEvents = xEventGroupCreate();
+    if (resumed)
+    {
+        xEventGroupSetBits(appEvents, LIVE_MODE_BIT);
+    }
+    renderQueue = xQueueCreate(RENDER_QUEUE_LENGTH, sizeof(RenderCommand));
+    prefetchQueue = xQueueCreate(PREFETCH_QUEUE_LENGTH, sizeof(uint8_t));
+    publishedTableMutex = xSemaphoreCreateMutex();
+
+    xTaskCreate(inputTask, "input", INPUT_TASK_STACK, nullptr, INPUT_TASK_PRIORITY, nullptr);
+    xTaskCreate(renderTask, "render", RENDER_TASK_STACK, nullptr, RENDER_TASK_PRIORITY, nullptr);
+    xTaskCreate(networkTask, "network", NETWORK_TASK_STACK, nullptr, NETWORK_TASK_PRIORITY, nullptr);
+
+    powerManager.setWakeCallback(rescheduleTasks);
+    // Neither the debounce timer nor a waveform on the panel task is a deadline the power task knows about
+    powerManager.setSleepBlocker([]
+                                 { return modeManager.isDebouncing() || displayManager.isBusy(); });
+    powerManager.setDeepSleepHandler(enterLiveDeepSleep);
+    powerManager.init();
+
+    Serial.println(resumed ? "Setup complete - live mode resumed" : "Setup complete - entering sleep mode");
+}
+
+void loop()
+{
+    // All work happens in the tasks started by setup()
+    vTaskDelete(NULL);
 }
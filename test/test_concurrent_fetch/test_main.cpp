@@ -0,0 +1,212 @@
+#include <Arduino.h>
+#include <NativeHAL.h>
+#include <unity.h>
+#include "MVGClient.h"
+#include "config.h"
+
+// fetchDepartures() against a mock /departures server whose responses take a
+// while, so the requests of a cycle overlap: each response has to land in the
+// slots of its own configs, no more than max_in_flight requests may be open
+// at once, and a failed request must leave the other stations alone.
+
+static const size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
+static const time_t EPOCH = 1760000000;
+static const unsigned long RESPONSE_MS = 400;
+
+static size_t in_flight = 0;
+static size_t max_in_flight_seen = 0;
+static size_t responses = 0;
+// Requests for this globalId get failing_code instead of departures
+static String failing_station;
+static int failing_code = HTTP_CODE_OK;
+
+static String queryValue(const String &url, const char *key)
+{
+    int start = url.indexOf(key);
+    if (start < 0)
+        return String();
+    start += strlen(key);
+    int end = url.indexOf('&', start);
+    return url.substring(start, end < 0 ? url.length() : end);
+}
+
+// Every destination starts with the globalId it was requested for, so a
+// response that lands in the wrong station's slot is caught
+static int mockServer(const String &url, String &body)
+{
+    in_flight++;
+    max_in_flight_seen = max(max_in_flight_seen, in_flight);
+    // Blocks only the requesting task, so the other requests of the cycle run meanwhile
+    delay(RESPONSE_MS);
+    in_flight--;
+    responses++;
+
+    String station = queryValue(url, "globalId=");
+    if (station == failing_station)
+        return failing_code;
+
+    String types = queryValue(url, "transportTypes=");
+    if (types.isEmpty())
+        types = "UBAHN";
+    size_t limit = queryValue(url, "limit=").toInt();
+
+    // One departure of each requested type in turn
+    body = "[";
+    const char *type = types.c_str();
+    for (size_t i = 0; i < limit; i++)
+    {
+        const char *end = strchr(type, ',');
+        size_t length = end ? end - type : strlen(type);
+        char departure[256];
+        long long planned = (long long)(EPOCH + 600 + i * 120) * 1000;
+        snprintf(departure, sizeof(departure),
+                 "%s{\"label\":\"%u\",\"transportType\":\"%.*s\",\"destination\":\"%s %u\",\"departureTime\":%lld}",
+                 i ? "," : "", (unsigned)(i + 1), (int)length, type, station.c_str(), (unsigned)i, planned);
+        body += departure;
+        type = end ? end + 1 : types.c_str();
+    }
+    body += "]";
+    return HTTP_CODE_OK;
+}
+
+static uint32_t stationsOf(const String &bahnhof)
+{
+    uint32_t mask = 0;
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        if (configs[i].bahnhof == bahnhof)
+            mask |= 1UL << i;
+    }
+    return mask;
+}
+
+static void checkStation(const DepartureTable &table, size_t station)
+{
+    TEST_ASSERT_EQUAL_STRING(configs[station].pretty_name.c_str(), table.stationName(station));
+    TEST_ASSERT_TRUE(table.departureCount(station) > 0);
+    for (size_t i = 0; i < table.departureCount(station); i++)
+    {
+        const char *destination = table.destination(station, i);
+        TEST_ASSERT_EQUAL(0, strncmp(destination, configs[station].bahnhof.c_str(), configs[station].bahnhof.length()));
+        TEST_ASSERT_EQUAL(' ', destination[configs[station].bahnhof.length()]);
+    }
+}
+
+void setUp()
+{
+    NativeHAL::setEpoch(EPOCH);
+    NativeHAL::setHttpDelay(0, 0);
+    NativeHAL::setHttpResponder(mockServer);
+    in_flight = 0;
+    max_in_flight_seen = 0;
+    responses = 0;
+    failing_station = "";
+    failing_code = HTTP_CODE_OK;
+}
+
+void tearDown()
+{
+}
+
+// Worker tasks outlive a test, so every client is kept for the whole run
+static TimeKeeper time_keeper(1000);
+static MVGClient serial_client(time_keeper, 1);
+static MVGClient parallel_client(time_keeper, MVGClient::MAX_IN_FLIGHT);
+
+void test_responses_land_in_their_stations()
+{
+    // Jitter lets the requests finish in a different order than they were queued
+    NativeHAL::setHttpDelay(100, 300);
+    for (int round = 0; round < 3; round++)
+    {
+        parallel_client.fetchDepartures();
+        TEST_ASSERT_EQUAL_UINT32((1UL << CONFIG_COUNT) - 1, parallel_client.getUpdatedMask());
+        for (size_t i = 0; i < CONFIG_COUNT; i++)
+        {
+            checkStation(parallel_client.getStationList(), i);
+        }
+    }
+}
+
+void test_requests_in_flight_stay_within_the_limit()
+{
+    size_t groups = parallel_client.getRequestCount();
+    parallel_client.fetchDepartures();
+    uint32_t parallel_ms = parallel_client.getFetchStats().last_cycle_ms;
+    TEST_ASSERT_EQUAL(groups, responses);
+    TEST_ASSERT_EQUAL(min(groups, MVGClient::MAX_IN_FLIGHT), max_in_flight_seen);
+
+    max_in_flight_seen = 0;
+    serial_client.fetchDepartures();
+    uint32_t serial_ms = serial_client.getFetchStats().last_cycle_ms;
+    TEST_ASSERT_EQUAL(1, max_in_flight_seen);
+
+    char message[128];
+    snprintf(message, sizeof(message), "%u requests of %lu ms: %u ms one at a time, %u ms with up to %u in flight",
+             (unsigned)groups, RESPONSE_MS, serial_ms, parallel_ms, (unsigned)MVGClient::MAX_IN_FLIGHT);
+    TEST_MESSAGE(message);
+    // A cycle takes as many round trips as it has waves of requests
+    size_t waves = (groups + MVGClient::MAX_IN_FLIGHT - 1) / MVGClient::MAX_IN_FLIGHT;
+    TEST_ASSERT_TRUE(parallel_ms >= waves * RESPONSE_MS && parallel_ms < (waves + 1) * RESPONSE_MS);
+    TEST_ASSERT_TRUE(serial_ms >= groups * RESPONSE_MS);
+}
+
+static void checkFailedStation(int code)
+{
+    parallel_client.fetchDepartures();
+    DepartureTable before = parallel_client.getStationList();
+
+    failing_station = configs[0].bahnhof;
+    failing_code = code;
+    uint32_t failing = stationsOf(failing_station);
+    uint32_t others = ((1UL << CONFIG_COUNT) - 1) & ~failing;
+
+    // A refetch by mask keeps what the failed stations showed before
+    parallel_client.fetchDepartures(failing | others);
+    const DepartureTable &table = parallel_client.getStationList();
+    TEST_ASSERT_EQUAL_UINT32(others, parallel_client.getUpdatedMask());
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        checkStation(table, i);
+        if (failing & (1UL << i))
+        {
+            TEST_ASSERT_EQUAL(before.departureCount(i), table.departureCount(i));
+        }
+    }
+
+    // A full fetch starts over, so only the failed stations are empty
+    parallel_client.fetchDepartures();
+    TEST_ASSERT_EQUAL_UINT32(others, parallel_client.getUpdatedMask());
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        if (failing & (1UL << i))
+            TEST_ASSERT_EQUAL(0, table.departureCount(i));
+        else
+            checkStation(table, i);
+    }
+
+    // The failed connection was dropped, and the next cycle gets every station again
+    failing_station = "";
+    parallel_client.fetchDepartures();
+    TEST_ASSERT_EQUAL_UINT32((1UL << CONFIG_COUNT) - 1, parallel_client.getUpdatedMask());
+}
+
+void test_not_found_leaves_the_other_stations()
+{
+    checkFailedStation(HTTP_CODE_NOT_FOUND);
+}
+
+void test_connection_error_leaves_the_other_stations()
+{
+    checkFailedStation(HTTPC_ERROR_CONNECTION_REFUSED);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_responses_land_in_their_stations);
+    RUN_TEST(test_requests_in_flight_stay_within_the_limit);
+    RUN_TEST(test_not_found_leaves_the_other_stations);
+    RUN_TEST(test_connection_error_leaves_the_other_stations);
+    return UNITY_END();
+}
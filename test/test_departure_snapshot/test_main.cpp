@@ -0,0 +1,144 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "DepartureSnapshot.h"
+#include "Utf8.h"
+
+// Encoded size and encode/decode time of the RTC snapshot, from the live-mode
+// case of three stations to a table filled to every limit. A cut destination
+// has to be a prefix of the original that still decodes as UTF-8.
+
+static const uint32_t BASE_TIME = 1760000000;
+
+static DepartureTable table;
+static DepartureTable restored;
+static DepartureSnapshot snapshot;
+
+// Destinations are cut to what the station's arena has room for, so the
+// characters past the first few bytes of destination_text have to be ASCII
+static void fill(size_t stations, size_t departures, const char *name, const char *destination_text)
+{
+    table.clear();
+    size_t destination_size = min((DepartureTable::ARENA_SIZE - strlen(name) - 1) / departures,
+                                  DepartureTable::MAX_NAME_LENGTH + 1);
+    for (size_t station = 0; station < stations; station++)
+    {
+        table.resetStation(station, name);
+        for (size_t i = 0; i < departures; i++)
+        {
+            char line[DepartureTable::LINE_LABEL_SIZE];
+            char destination[DepartureTable::MAX_NAME_LENGTH + 1];
+            snprintf(line, sizeof(line), "X%u", (unsigned)(station * departures + i));
+            snprintf(destination, destination_size, "%u %s", (unsigned)(station * departures + i), destination_text);
+            TEST_ASSERT_TRUE(table.addDeparture(station, line, destination, BASE_TIME + i * 120));
+        }
+    }
+}
+
+static void report(const char *label)
+{
+    const SnapshotStats &stats = snapshot.getStats();
+    char message[128];
+    snprintf(message, sizeof(message), "%s: %u bytes, encode %u us, decode %u us",
+             label, (unsigned)stats.encoded_bytes, (unsigned)stats.encode_us, (unsigned)stats.decode_us);
+    TEST_MESSAGE(message);
+}
+
+static void saveAndRestore()
+{
+    ShownScreen screen = {0, 1, {0}, BASE_TIME};
+    ShownScreen shown;
+    TEST_ASSERT_TRUE(snapshot.save(table, screen, LiveSchedule{BASE_TIME + 3600}));
+    TEST_ASSERT_TRUE(snapshot.restore(restored, shown));
+    TEST_ASSERT_EQUAL(table.stationCount(), restored.stationCount());
+}
+
+void setUp()
+{
+    snapshot.invalidate();
+}
+
+void tearDown()
+{
+}
+
+void test_live_mode_stations_keep_long_destinations()
+{
+    // Three stations of five departures, every destination long and different
+    fill(3, 5, "M\xC3\xBCnchen Hauptbahnhof (Tief)", "M\xC3\xBCnchen Flughafen Terminal via Neufahrn and Freising");
+    saveAndRestore();
+    report("3 stations x 5");
+
+    for (size_t station = 0; station < 3; station++)
+    {
+        TEST_ASSERT_EQUAL_STRING(table.stationName(station), restored.stationName(station));
+        for (size_t i = 0; i < 5; i++)
+        {
+            TEST_ASSERT_EQUAL_STRING(table.line(station, i), restored.line(station, i));
+            TEST_ASSERT_EQUAL_STRING(table.destination(station, i), restored.destination(station, i));
+            TEST_ASSERT_EQUAL_UINT32(table.departureTime(station, i), restored.departureTime(station, i));
+        }
+    }
+}
+
+static void checkUtf8Prefix(const char *text, const char *original)
+{
+    TEST_ASSERT_EQUAL(0, strncmp(text, original, strlen(text)));
+    for (const uint8_t *s = (const uint8_t *)text; *s;)
+    {
+        uint32_t code_point;
+        size_t bytes = Utf8::decode(s, &code_point);
+        TEST_ASSERT_TRUE(bytes > 0);
+        s += bytes;
+    }
+}
+
+void test_cut_destinations_end_on_a_character()
+{
+    // Four stations of eight two-byte umlaut destinations only fit once they are cut
+    fill(4, 8, "Sendlinger Tor", "\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84"
+                                 "\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84\xC3\x84");
+    saveAndRestore();
+    report("4 stations x 8");
+
+    for (size_t station = 0; station < 4; station++)
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            const char *text = restored.destination(station, i);
+            TEST_ASSERT_TRUE(strlen(text) < strlen(table.destination(station, i)));
+            checkUtf8Prefix(text, table.destination(station, i));
+        }
+    }
+}
+
+void test_full_table_fits_with_shorter_destinations()
+{
+    // Every limit at once: names and destinations as long as the client keeps them
+    char name[DepartureTable::MAX_NAME_LENGTH + 1];
+    memset(name, 'N', DepartureTable::MAX_NAME_LENGTH);
+    name[DepartureTable::MAX_NAME_LENGTH] = '\0';
+    fill(DepartureTable::MAX_STATIONS, DepartureTable::MAX_DEPARTURES, name,
+         "\xC3\x9C" "ber \xC3\xA4\xC3\xB6\xC3\xBC lange Zielangabe mit viel Text am Ende");
+    saveAndRestore();
+    report("8 stations x 10");
+
+    for (size_t station = 0; station < DepartureTable::MAX_STATIONS; station++)
+    {
+        TEST_ASSERT_EQUAL(DepartureTable::MAX_DEPARTURES, restored.departureCount(station));
+        for (size_t i = 0; i < DepartureTable::MAX_DEPARTURES; i++)
+        {
+            checkUtf8Prefix(restored.destination(station, i), table.destination(station, i));
+            TEST_ASSERT_EQUAL_STRING(table.line(station, i), restored.line(station, i));
+            TEST_ASSERT_EQUAL_UINT32(table.departureTime(station, i), restored.departureTime(station, i));
+        }
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_live_mode_stations_keep_long_destinations);
+    RUN_TEST(test_cut_destinations_end_on_a_character);
+    RUN_TEST(test_full_table_fits_with_shorter_destinations);
+    return UNITY_END();
+}
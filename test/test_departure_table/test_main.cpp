@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include <new>
+#include <unity.h>
+#include "DepartureTable.h"
+
+// The line table across many live-mode cycles, where clear() is never called,
+// and a count of the heap allocations a fetch cycle's table operations make.
+
+static const size_t STATIONS = 3;
+static const size_t DEPARTURES = 5;
+static const int CYCLES = 200;
+static const uint32_t BASE_TIME = 1760000000;
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *block = malloc(size ? size : 1);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void operator delete(void *block) noexcept
+{
+    free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+    free(block);
+}
+
+static DepartureTable table;
+
+// Every cycle brings labels no earlier cycle used, as when lines change over the day
+static void fillStation(size_t station, int cycle)
+{
+    table.resetStation(station, "Marienplatz");
+    for (size_t i = 0; i < DEPARTURES; i++)
+    {
+        char label[DepartureTable::LINE_LABEL_SIZE];
+        snprintf(label, sizeof(label), "%u", (unsigned)((cycle * STATIONS + station) * DEPARTURES + i) % 10000);
+        table.addDeparture(station, label, "Moosach", BASE_TIME + i * 60);
+    }
+}
+
+static void checkStation(size_t station, int cycle)
+{
+    for (size_t i = 0; i < DEPARTURES; i++)
+    {
+        char label[DepartureTable::LINE_LABEL_SIZE];
+        snprintf(label, sizeof(label), "%u", (unsigned)((cycle * STATIONS + station) * DEPARTURES + i) % 10000);
+        TEST_ASSERT_EQUAL_STRING(label, table.line(station, i));
+    }
+}
+
+void setUp()
+{
+    table.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_labels_never_run_out_across_live_cycles()
+{
+    for (int cycle = 0; cycle < CYCLES; cycle++)
+    {
+        table.compactLines();
+        for (size_t station = 0; station < STATIONS; station++)
+        {
+            fillStation(station, cycle);
+        }
+        for (size_t station = 0; station < STATIONS; station++)
+        {
+            checkStation(station, cycle);
+        }
+    }
+}
+
+void test_partial_refetch_keeps_the_other_labels()
+{
+    fillStation(0, 0);
+    for (int cycle = 1; cycle < CYCLES; cycle++)
+    {
+        // Only station 1 is due; station 0 keeps the departures of cycle 0
+        table.compactLines();
+        fillStation(1, cycle);
+        checkStation(0, 0);
+        checkStation(1, cycle);
+    }
+}
+
+void test_full_table_compacts_instead_of_dropping_labels()
+{
+    // Without compactLines() between cycles internLine() has to make room itself
+    for (int cycle = 0; cycle < CYCLES; cycle++)
+    {
+        fillStation(cycle % STATIONS, cycle);
+        checkStation(cycle % STATIONS, cycle);
+    }
+}
+
+void test_fetch_cycle_does_not_allocate()
+{
+    DepartureTable restored;
+    uint8_t snapshot[1024];
+    size_t before = allocations;
+    unsigned long start = micros();
+    for (int cycle = 0; cycle < CYCLES; cycle++)
+    {
+        table.compactLines();
+        for (size_t station = 0; station < STATIONS; station++)
+        {
+            fillStation(station, cycle);
+        }
+        size_t length = table.encode(snapshot, sizeof(snapshot));
+        TEST_ASSERT_TRUE(length > 0);
+        TEST_ASSERT_TRUE(restored.decode(snapshot, length));
+    }
+    unsigned long elapsed = micros() - start;
+
+    char message[96];
+    snprintf(message, sizeof(message), "%u allocations in %d cycles, %lu us per cycle",
+             (unsigned)(allocations - before), CYCLES, elapsed / CYCLES);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, allocations - before);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_labels_never_run_out_across_live_cycles);
+    RUN_TEST(test_partial_refetch_keeps_the_other_labels);
+    RUN_TEST(test_full_table_compacts_instead_of_dropping_labels);
+    RUN_TEST(test_fetch_cycle_does_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "FetchScheduler.h"
+
+// Drives FetchScheduler through hours of emulated live mode: the request budget
+// has to hold in every hour, and the hourly rates have to follow the recent
+// cycles rather than the whole run.
+
+static const size_t STATIONS = 3;
+static const time_t START = 1760000000;
+static const uint32_t BUDGET_PER_HOUR = 60;
+// What the budget may be saved up to, plus the largest cycle that can overdraw it
+static const uint32_t BUDGET_SLACK = BUDGET_PER_HOUR * 300 / 3600 + STATIONS;
+
+static DepartureTable table;
+
+// A departure every two minutes from 90 s on, so every station wants the shortest interval
+static void busyStations(time_t now)
+{
+    for (size_t station = 0; station < STATIONS; station++)
+    {
+        table.resetStation(station, "Marienplatz");
+        for (size_t i = 0; i < 5; i++)
+        {
+            table.addDeparture(station, "U3", "Moosach", now + 90 + station * 20 + i * 120);
+        }
+    }
+}
+
+// Nothing leaves for a long time, so every station backs off to the longest interval
+static void quietStations(time_t now)
+{
+    for (size_t station = 0; station < STATIONS; station++)
+    {
+        table.resetStation(station, "Marienplatz");
+        table.addDeparture(station, "U3", "Moosach", now + 7200);
+    }
+}
+
+// One request per due station, every response arrives
+static time_t runCycle(FetchScheduler &scheduler, time_t now, uint32_t *requests)
+{
+    uint32_t due = scheduler.dueStations(STATIONS, now);
+    uint32_t count = 0;
+    for (size_t station = 0; station < STATIONS; station++)
+    {
+        if (!(due & (1UL << station)))
+            continue;
+        scheduler.planStation(station, table, true, 90, now);
+        count++;
+    }
+    scheduler.recordCycle(count, count * 400, due == (1UL << STATIONS) - 1, now);
+    *requests = count;
+    return max(scheduler.nextFetchTime(STATIONS), now + 1);
+}
+
+void setUp()
+{
+    table.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_budget_holds_in_every_hour()
+{
+    FetchScheduler scheduler;
+    scheduler.setRequestBudget(BUDGET_PER_HOUR, START);
+    scheduler.startLive(START);
+
+    // Requests per minute over six hours, to check every hour-long window
+    static const size_t MINUTES = 6 * 60;
+    uint32_t per_minute[MINUTES] = {};
+    uint32_t total = 0;
+    for (time_t now = START; now < START + (time_t)MINUTES * 60;)
+    {
+        busyStations(now);
+        uint32_t requests;
+        time_t next = runCycle(scheduler, now, &requests);
+        per_minute[(now - START) / 60] += requests;
+        total += requests;
+        now = next;
+    }
+
+    uint32_t worst_hour = 0;
+    for (size_t start = 0; start + 60 <= MINUTES; start++)
+    {
+        uint32_t hour = 0;
+        for (size_t minute = start; minute < start + 60; minute++)
+        {
+            hour += per_minute[minute];
+        }
+        worst_hour = max(worst_hour, hour);
+    }
+
+    char message[96];
+    snprintf(message, sizeof(message), "%u requests in 6 h, worst hour %u against a budget of %u",
+             (unsigned)total, (unsigned)worst_hour, (unsigned)BUDGET_PER_HOUR);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(worst_hour <= BUDGET_PER_HOUR + BUDGET_SLACK);
+    // The budget is a cap, busy stations still get all of it
+    TEST_ASSERT_TRUE(total >= 6 * BUDGET_PER_HOUR - BUDGET_SLACK);
+}
+
+void test_without_budget_busy_stations_exceed_it()
+{
+    FetchScheduler scheduler;
+    scheduler.setRequestBudget(0, START);
+    scheduler.startLive(START);
+
+    uint32_t total = 0;
+    for (time_t now = START; now < START + 3600;)
+    {
+        busyStations(now);
+        uint32_t requests;
+        now = runCycle(scheduler, now, &requests);
+        total += requests;
+    }
+    TEST_ASSERT_TRUE(total > BUDGET_PER_HOUR + BUDGET_SLACK);
+}
+
+void test_rates_follow_the_last_hour()
+{
+    FetchScheduler scheduler;
+    scheduler.setRequestBudget(0, START);
+    scheduler.startLive(START);
+
+    // Three busy hours, then three quiet ones
+    time_t now = START;
+    uint32_t requests;
+    while (now < START + 3 * 3600)
+    {
+        busyStations(now);
+        now = runCycle(scheduler, now, &requests);
+    }
+    float busy_rate = scheduler.getRates().requests_per_hour;
+
+    uint32_t quiet_requests = 0;
+    time_t quiet_start = now;
+    while (now < START + 6 * 3600)
+    {
+        quietStations(now);
+        now = runCycle(scheduler, now, &requests);
+        quiet_requests += requests;
+    }
+    FetchRates rates = scheduler.getRates();
+    float quiet_rate = quiet_requests * 3600.0f / (now - quiet_start);
+    float lifetime_rate = rates.requests * 3600.0f / rates.live_s;
+
+    char message[128];
+    snprintf(message, sizeof(message), "busy %.0f/h, then quiet %.1f/h measured, %.1f/h reported, lifetime average %.1f/h",
+             busy_rate, quiet_rate, rates.requests_per_hour, lifetime_rate);
+    TEST_MESSAGE(message);
+    // Three time constants later the busy hours weigh about 5 %
+    TEST_ASSERT_TRUE(rates.requests_per_hour < quiet_rate + 0.1f * busy_rate);
+    TEST_ASSERT_TRUE(rates.requests_per_hour < lifetime_rate / 2);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_budget_holds_in_every_hour);
+    RUN_TEST(test_without_budget_busy_stations_exceed_it);
+    RUN_TEST(test_rates_follow_the_last_hour);
+    return UNITY_END();
+}
@@ -0,0 +1,280 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "FrameKernels.h"
+
+// Golden tests of the framebuffer kernels against per-pixel reference
+// implementations written from the panel's pixel format, over random and
+// clipped rectangles, every head and tail offset and single-nibble changes.
+// The cycle benchmark reports each kernel next to the code it replaces; both
+// sides are plain C, the kernels only work on whole rows instead of pixels.
+
+static const size_t FRAME_BYTES = EPD_WIDTH * EPD_HEIGHT / 2;
+static const size_t MONO_BYTES = EPD_WIDTH * EPD_HEIGHT / 8;
+static const size_t ROW_BYTES = EPD_WIDTH / 2;
+
+alignas(FrameKernels::FRAME_ALIGNMENT) static uint8_t expected[FRAME_BYTES];
+alignas(FrameKernels::FRAME_ALIGNMENT) static uint8_t actual[FRAME_BYTES];
+static uint8_t expected_mono[MONO_BYTES];
+static uint8_t actual_mono[MONO_BYTES];
+
+// Fixed seed, so a failure comes back on the next run
+static uint32_t random_state;
+
+static uint32_t nextRandom()
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+static void randomize(uint8_t *buffer, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        buffer[i] = nextRandom();
+    }
+}
+
+// The left pixel of a byte is its low nibble and takes the high nibble of color, as in epd_draw_pixel()
+static void referencePixel(uint8_t *frame, int32_t x, int32_t y, uint8_t color)
+{
+    if (x < 0 || x >= EPD_WIDTH || y < 0 || y >= EPD_HEIGHT)
+        return;
+    uint8_t &byte = frame[y * ROW_BYTES + x / 2];
+    byte = (x & 1) ? (byte & 0x0F) | (color & 0xF0) : (byte & 0xF0) | (color >> 4);
+}
+
+static void referenceFillRect(uint8_t *frame, int32_t x, int32_t y, int32_t width, int32_t height, uint8_t color)
+{
+    for (int32_t yy = y; yy < y + height; yy++)
+    {
+        for (int32_t xx = x; xx < x + width; xx++)
+        {
+            referencePixel(frame, xx, yy, color);
+        }
+    }
+}
+
+// Leftmost pixel in the high bit, set for black
+static void referenceFillRectMono(uint8_t *frame, int32_t x, int32_t y, int32_t width, int32_t height, bool black)
+{
+    for (int32_t yy = max(y, (int32_t)0); yy < min(y + height, (int32_t)EPD_HEIGHT); yy++)
+    {
+        for (int32_t xx = max(x, (int32_t)0); xx < min(x + width, (int32_t)EPD_WIDTH); xx++)
+        {
+            uint8_t &byte = frame[yy * FrameKernels::MONO_ROW_BYTES + xx / 8];
+            uint8_t bit = 0x80 >> (xx % 8);
+            byte = black ? byte | bit : byte & ~bit;
+        }
+    }
+}
+
+void setUp()
+{
+    random_state = 42;
+}
+
+void tearDown()
+{
+}
+
+void test_fill_matches_at_every_offset()
+{
+    for (size_t offset = 0; offset < 2 * FrameKernels::FRAME_ALIGNMENT; offset++)
+    {
+        for (size_t length = 0; length < 100; length++)
+        {
+            memset(expected, 0x11, 256);
+            memset(actual, 0x11, 256);
+            for (size_t i = 0; i < length; i++)
+            {
+                expected[offset + i] = 0xA5;
+            }
+            FrameKernels::fill(actual + offset, 0xA5, length);
+            TEST_ASSERT_EQUAL_MEMORY(expected, actual, 256);
+        }
+    }
+}
+
+void test_fill_rect_matches_pixels()
+{
+    randomize(expected, FRAME_BYTES);
+    memcpy(actual, expected, FRAME_BYTES);
+    // Partly off the panel on every side, odd and even edges, empty and one pixel wide
+    for (int i = 0; i < 2000; i++)
+    {
+        int32_t x = (int32_t)(nextRandom() % 1100) - 70;
+        int32_t y = (int32_t)(nextRandom() % 640) - 50;
+        int32_t width = nextRandom() % 400;
+        int32_t height = (i % 4 == 0) ? 1 : nextRandom() % 60;
+        uint8_t color = nextRandom();
+        referenceFillRect(expected, x, y, width, height, color);
+        FrameKernels::fillRect(actual, x, y, width, height, color);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, FRAME_BYTES);
+
+    // The driver's own fills, which DisplayManager used before
+    epd_fill_rect(101, 33, 230, 50, 0x7F, expected);
+    epd_draw_hline(40, 140, 881, 0x00, expected);
+    FrameKernels::fillRect(actual, 101, 33, 230, 50, 0x7F);
+    FrameKernels::fillRect(actual, 40, 140, 881, 1, 0x00);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, FRAME_BYTES);
+}
+
+void test_blit_masked_matches_nibbles()
+{
+    for (int i = 0; i < 2000; i++)
+    {
+        uint8_t pixels[64];
+        uint8_t mask[64];
+        size_t length = nextRandom() % 64;
+        randomize(expected, 64);
+        memcpy(actual, expected, 64);
+        for (size_t k = 0; k < 64; k++)
+        {
+            mask[k] = ((nextRandom() & 1) ? 0x0F : 0) | ((nextRandom() & 1) ? 0xF0 : 0);
+            pixels[k] = nextRandom() & mask[k];
+        }
+        for (size_t k = 0; k < length; k++)
+        {
+            for (int nibble = 0; nibble < 8; nibble += 4)
+            {
+                if ((mask[k] >> nibble) & 0xF)
+                    expected[k] = (expected[k] & ~(0xF << nibble)) | (pixels[k] & (0xF << nibble));
+            }
+        }
+        FrameKernels::blitMasked(actual, pixels, mask, length);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, 64);
+    }
+}
+
+void test_equal_rect_sees_a_single_nibble()
+{
+    randomize(expected, FRAME_BYTES);
+    memcpy(actual, expected, FRAME_BYTES);
+    for (int i = 0; i < 2000; i++)
+    {
+        size_t x = nextRandom() % ROW_BYTES;
+        size_t y = nextRandom() % EPD_HEIGHT;
+        size_t width = 1 + nextRandom() % (ROW_BYTES - x);
+        size_t rows = 1 + nextRandom() % (EPD_HEIGHT - y);
+        size_t changed = nextRandom() % FRAME_BYTES;
+        actual[changed] ^= (nextRandom() & 1) ? 0x10 : 0x01;
+
+        size_t changed_x = changed % ROW_BYTES;
+        size_t changed_y = changed / ROW_BYTES;
+        bool inside = changed_x >= x && changed_x < x + width && changed_y >= y && changed_y < y + rows;
+        size_t offset = y * ROW_BYTES + x;
+        TEST_ASSERT_EQUAL(!inside, FrameKernels::equalRect(expected + offset, actual + offset, width, rows, ROW_BYTES));
+        actual[changed] = expected[changed];
+    }
+    TEST_ASSERT_TRUE(FrameKernels::equalRect(expected, actual, ROW_BYTES, EPD_HEIGHT, ROW_BYTES));
+    TEST_ASSERT_TRUE(FrameKernels::equalRect(expected, actual, 0, EPD_HEIGHT, ROW_BYTES));
+}
+
+void test_mono_kernels_match_pixels()
+{
+    randomize(expected_mono, MONO_BYTES);
+    memcpy(actual_mono, expected_mono, MONO_BYTES);
+    for (int i = 0; i < 2000; i++)
+    {
+        int32_t x = (int32_t)(nextRandom() % 1100) - 70;
+        int32_t y = (int32_t)(nextRandom() % 640) - 50;
+        int32_t width = nextRandom() % 400;
+        int32_t height = nextRandom() % 60;
+        bool black = nextRandom() & 1;
+        referenceFillRectMono(expected_mono, x, y, width, height, black);
+        FrameKernels::fillRectMono(actual_mono, x, y, width, height, black);
+    }
+    TEST_ASSERT_EQUAL_MEMORY(expected_mono, actual_mono, MONO_BYTES);
+
+    // Black pixels become 0x0, white ones 0xF
+    for (int32_t y = 0; y < EPD_HEIGHT; y++)
+    {
+        for (int32_t x = 0; x < EPD_WIDTH; x++)
+        {
+            bool black = actual_mono[y * FrameKernels::MONO_ROW_BYTES + x / 8] & (0x80 >> (x % 8));
+            referencePixel(expected, x, y, black ? 0x00 : 0xFF);
+        }
+    }
+    FrameKernels::expandMono(actual, actual_mono, MONO_BYTES);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, FRAME_BYTES);
+}
+
+// Average cycles of a call, over enough calls to outlast the clock's resolution.
+// On the host ESP.getCycleCount() runs at 240 MHz off the wall clock
+template <typename Kernel>
+static uint32_t cyclesPerCall(int calls, Kernel kernel)
+{
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < calls; i++)
+    {
+        kernel();
+    }
+    return (ESP.getCycleCount() - start) / calls;
+}
+
+static void report(const char *label, uint32_t replaced, uint32_t kernel)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%-32s replaced %8u, kernel %8u cycles", label, (unsigned)replaced, (unsigned)kernel);
+    TEST_MESSAGE(message);
+}
+
+void test_cycles_per_kernel()
+{
+    // A clear was memset() before and is still, so it has no row here
+    report("fillRect 230x50 (epd_fill_rect)",
+           cyclesPerCall(200, []
+                         { epd_fill_rect(101, 20, 230, 50, 0xFF, expected); }),
+           cyclesPerCall(200, []
+                         { FrameKernels::fillRect(actual, 101, 20, 230, 50, 0xFF); }));
+    report("hline 880 px (epd_draw_hline)",
+           cyclesPerCall(2000, []
+                         { epd_draw_hline(40, 140, 880, 0x00, expected); }),
+           cyclesPerCall(2000, []
+                         { FrameKernels::fillRect(actual, 40, 140, 880, 1, 0x00); }));
+
+    // Every 32x32 tile of two equal frames, the worst case of the diff
+    memcpy(expected, actual, FRAME_BYTES);
+    static volatile size_t changed;
+    report("diff 510 tiles (32-bit words)",
+           cyclesPerCall(10, []
+                         {
+        const uint32_t *a = (const uint32_t *)expected;
+        const uint32_t *b = (const uint32_t *)actual;
+        size_t count = 0;
+        for (size_t word = 0; word < FRAME_BYTES / 4; word++)
+            count += a[word] != b[word];
+        changed = count; }),
+           cyclesPerCall(10, []
+                         {
+        size_t count = 0;
+        for (size_t y = 0; y < EPD_HEIGHT; y += 32)
+            for (size_t x = 0; x < ROW_BYTES; x += 16)
+            {
+                size_t offset = y * ROW_BYTES + x;
+                count += !FrameKernels::equalRect(expected + offset, actual + offset, 16, min((size_t)32, EPD_HEIGHT - y), ROW_BYTES);
+            }
+        changed = count; }));
+    report("expand mono frame (per pixel)",
+           cyclesPerCall(10, []
+                         {
+        for (int32_t y = 0; y < EPD_HEIGHT; y++)
+            for (int32_t x = 0; x < EPD_WIDTH; x++)
+                referencePixel(expected, x, y, (actual_mono[y * FrameKernels::MONO_ROW_BYTES + x / 8] & (0x80 >> (x % 8))) ? 0x00 : 0xFF); }),
+           cyclesPerCall(10, []
+                         { FrameKernels::expandMono(actual, actual_mono, MONO_BYTES); }));
+    TEST_ASSERT_EQUAL(0, changed);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fill_matches_at_every_offset);
+    RUN_TEST(test_fill_rect_matches_pixels);
+    RUN_TEST(test_blit_masked_matches_nibbles);
+    RUN_TEST(test_equal_rect_sees_a_single_nibble);
+    RUN_TEST(test_mono_kernels_match_pixels);
+    RUN_TEST(test_cycles_per_kernel);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <firasans.h>
+#include <firasans_small.h>
+#include "GlyphCache.h"
+
+// Text rendering through GlyphCache against write_string(): the frames have to
+// come out byte for byte the same, and the throughput of both is reported for
+// an hour of station screens and for the minute column alone.
+
+static const size_t FRAME_BYTES = EPD_WIDTH * EPD_HEIGHT / 2;
+static const int MINUTES = 60;
+static const int STATIONS = 3;
+// Rows of a station screen, and the lines and destinations they cycle through
+static const int ROWS = 6;
+static const int NAMES = 8;
+
+static const char *const LABELS[NAMES] = {"U3", "U6", "S8", "S1", "Bus 54", "X30", "Tram 17", "N40"};
+static const char *const DESTINATIONS[NAMES] = {"F\xC3\xBCrstenried West", "Garching-Forschungszentrum", "Flughafen M\xC3\xBCnchen",
+                                                "Freising", "M\xC3\xBCnchner Freiheit", "Ostbahnhof",
+                                                "Amalienburgstra\xC3\x9F" "e", "Hauptbahnhof"};
+static const char *const STATION_NAMES[] = {"Marienplatz", "Odeonsplatz", "Sendlinger Tor"};
+
+static uint8_t driver_frame[FRAME_BYTES];
+static uint8_t cached_frame[FRAME_BYTES];
+static GlyphCache cache;
+
+typedef void (*DrawText)(const GFXfont *font, const char *text, int32_t x, int32_t y, uint8_t *frame);
+
+static void viaDriver(const GFXfont *font, const char *text, int32_t x, int32_t y, uint8_t *frame)
+{
+    write_string(font, text, &x, &y, frame);
+}
+
+static void viaCache(const GFXfont *font, const char *text, int32_t x, int32_t y, uint8_t *frame)
+{
+    cache.drawText(font, text, &x, y, frame);
+}
+
+// An hour of station screens as the carousel draws them; returns the strings drawn
+static size_t drawHour(DrawText draw, uint8_t *frame)
+{
+    size_t strings = 0;
+    for (int minute = 0; minute < MINUTES; minute++)
+    {
+        for (int station = 0; station < STATIONS; station++)
+        {
+            memset(frame, 0xFF, FRAME_BYTES);
+            draw(&FiraSans, STATION_NAMES[station], 50, 100, frame);
+            draw(&FiraSansSmall, "87% 4.01V", 760, 50, frame);
+            for (int row = 0; row < ROWS; row++)
+            {
+                int32_t y = 200 + 52 * row;
+                int i = (row + station * 3) % NAMES;
+                char minutes[16];
+                snprintf(minutes, sizeof(minutes), "%d min", (row * 7 + minute + station) % 40);
+                // Odd columns put the same strings on the other nibble phase
+                draw(&FiraSans, LABELS[i], 50 + (row & 1), y, frame);
+                draw(&FiraSans, DESTINATIONS[(i + minute / 10) % NAMES], 180, y, frame);
+                draw(&FiraSans, minutes, 800 + (minute & 1), y, frame);
+            }
+            strings += 2 + ROWS * 3;
+        }
+    }
+    return strings;
+}
+
+// Two hours of minute updates in the right column, the most frequent redraw
+static size_t drawMinuteColumn(DrawText draw, uint8_t *frame)
+{
+    for (int minute = 0; minute < 120; minute++)
+    {
+        for (int row = 0; row < ROWS; row++)
+        {
+            char minutes[16];
+            snprintf(minutes, sizeof(minutes), "%d min", (row * 7 + minute) % 40);
+            draw(&FiraSans, minutes, 800, 200 + 52 * row, frame);
+        }
+    }
+    return 120 * ROWS;
+}
+
+static void compare(const char *label, size_t (*workload)(DrawText, uint8_t *))
+{
+    for (int pass = 0; pass < 2; pass++)
+    {
+        unsigned long start = micros();
+        size_t strings = workload(viaDriver, driver_frame);
+        unsigned long driver_us = micros() - start;
+
+        start = micros();
+        workload(viaCache, cached_frame);
+        unsigned long cache_us = micros() - start;
+
+        TEST_ASSERT_EQUAL_MEMORY(driver_frame, cached_frame, FRAME_BYTES);
+
+        char message[160];
+        snprintf(message, sizeof(message), "%s, %s: write_string %.2f us/string, GlyphCache %.2f us/string (%.1fx)",
+                 label, pass ? "warm" : "cold", (float)driver_us / strings, (float)cache_us / strings,
+                 cache_us ? (float)driver_us / cache_us : 0.0f);
+        TEST_MESSAGE(message);
+    }
+}
+
+void setUp()
+{
+    TEST_ASSERT_TRUE(cache.isReady());
+}
+
+void tearDown()
+{
+}
+
+void test_station_screens_match_write_string()
+{
+    compare("station screens", drawHour);
+
+    const GlyphCacheStats &stats = cache.getStats();
+    char message[128];
+    snprintf(message, sizeof(message), "glyph hits %u misses %u, run hits %u misses %u, uncached %u, arena %u B",
+             stats.glyph_hits, stats.glyph_misses, stats.run_hits, stats.run_misses, stats.uncached, stats.arena_used);
+    TEST_MESSAGE(message);
+    // Every glyph of the workload fits the arena, so after the first screens nothing is rasterized again.
+    // Uncached are the umlauts, which the host FiraSans lacks and the driver draws as its fallback glyph
+    TEST_ASSERT_EQUAL_UINT32(0, stats.glyph_flushes);
+    TEST_ASSERT_TRUE(stats.glyph_hits + stats.run_hits > 10 * stats.glyph_misses);
+}
+
+void test_minute_column_matches_write_string()
+{
+    compare("minute column", drawMinuteColumn);
+}
+
+void test_text_the_cache_cannot_place_matches_write_string()
+{
+    // Clipped at the panel edges, invalid UTF-8 and a code point the font lacks go to the driver
+    static const char *const TEXTS[] = {"Hauptbahnhof", "bad \xFF byte", "Snow \xE2\x98\x83", "M\xC3\xBCnchen"};
+    static const int32_t X[] = {-20, 900, 300};
+    static const int32_t Y[] = {10, 300, 560};
+    memset(driver_frame, 0xFF, FRAME_BYTES);
+    memset(cached_frame, 0xFF, FRAME_BYTES);
+    for (const char *text : TEXTS)
+    {
+        for (size_t i = 0; i < 3; i++)
+        {
+            int32_t driver_x = X[i], driver_y = Y[i], cached_x = X[i];
+            write_string(&FiraSans, text, &driver_x, &driver_y, driver_frame);
+            cache.drawText(&FiraSans, text, &cached_x, Y[i], cached_frame);
+            TEST_ASSERT_EQUAL_INT32(driver_x, cached_x);
+        }
+    }
+    TEST_ASSERT_EQUAL_MEMORY(driver_frame, cached_frame, FRAME_BYTES);
+}
+
+int main()
+{
+    cache.init();
+    UNITY_BEGIN();
+    RUN_TEST(test_station_screens_match_write_string);
+    RUN_TEST(test_minute_column_matches_write_string);
+    RUN_TEST(test_text_the_cache_cannot_place_matches_write_string);
+    return UNITY_END();
+}
@@ -0,0 +1,183 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <firasans_small.h>
+#include "GlyphIndex.h"
+#include "Utf8.h"
+
+// GlyphIndex against the driver's get_glyph(): every code point of the BMP has
+// to give the same glyph, before and after a font is indexed. FiraSansSmall is
+// ASCII only; the device-like font has the 121 intervals the epdiy converter
+// makes of FiraSans. Reports the cycles per lookup of both, and checks how names
+// are spelled for a font that lacks their characters.
+
+static const size_t GLYPH_COUNT = 1024;
+
+static UnicodeInterval device_intervals[128];
+static GFXglyph device_glyphs[GLYPH_COUNT];
+static GFXfont device_font = {nullptr, device_glyphs, device_intervals, 0, 0, 50, 38, -10};
+
+static const char *const NAMES[] = {"M\xC3\xBCnchner Freiheit", "Gro\xC3\x9Fhesseloher Br\xC3\xBC" "cke",
+                                    "Garching, Forschungszentrum", "Hauptbahnhof", "F\xC3\xBCrstenried West",
+                                    "Sendlinger Tor", "Universit\xC3\xA4t", "Odeonsplatz"};
+
+// ASCII and Latin-1 whole, then blocks of punctuation and symbols with the code points the font lacks cut out
+static void buildDeviceFont()
+{
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    auto add = [&count, &offset](uint32_t first, uint32_t last)
+    {
+        device_intervals[count++] = {first, last, offset};
+        offset += last - first + 1;
+    };
+    add(0x20, 0x7E);
+    add(0xA0, 0xFF);
+    for (uint32_t block : {0x100u, 0x2000u, 0x2100u, 0x2200u})
+    {
+        for (uint32_t first = block; first < block + 0x100 && count < 120; first += 8)
+        {
+            add(first, first + 4);
+        }
+    }
+    add(0xFFFD, 0xFFFD);
+    device_font.interval_count = count;
+
+    for (size_t i = 0; i < GLYPH_COUNT; i++)
+    {
+        device_glyphs[i].advance_x = i % 40 + 1;
+    }
+}
+
+static size_t mismatches(const GFXfont *font)
+{
+    size_t count = 0;
+    for (uint32_t code_point = 0; code_point < 0x10000; code_point++)
+    {
+        GFXglyph *expected;
+        get_glyph(font, code_point, &expected);
+        count += GlyphIndex::find(font, code_point) != expected;
+    }
+    return count;
+}
+
+static void checkNormalized(const GFXfont *font, const char *text, const char *expected)
+{
+    char out[64];
+    GlyphIndex::normalize(font, text, out, sizeof(out));
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+    TEST_ASSERT_TRUE(!font || GlyphIndex::covers(font, out));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_find_matches_get_glyph()
+{
+    TEST_ASSERT_EQUAL(121, device_font.interval_count);
+    // Not indexed yet, so every lookup searches
+    TEST_ASSERT_EQUAL(0, mismatches(&FiraSansSmall));
+    TEST_ASSERT_EQUAL(0, mismatches(&device_font));
+
+    TEST_ASSERT_TRUE(GlyphIndex::add(&FiraSansSmall));
+    TEST_ASSERT_TRUE(GlyphIndex::add(&device_font));
+    TEST_ASSERT_TRUE(GlyphIndex::add(&device_font));
+    TEST_ASSERT_EQUAL(0, mismatches(&FiraSansSmall));
+    TEST_ASSERT_EQUAL(0, mismatches(&device_font));
+}
+
+void test_names_are_spelled_for_the_font()
+{
+    TEST_ASSERT_FALSE(GlyphIndex::covers(&FiraSansSmall, NAMES[0]));
+    TEST_ASSERT_TRUE(GlyphIndex::covers(&device_font, NAMES[0]));
+    TEST_ASSERT_FALSE(GlyphIndex::covers(&device_font, "bad\xFF"));
+
+    checkNormalized(&FiraSansSmall, NAMES[0], "Muenchner Freiheit");
+    checkNormalized(&FiraSansSmall, NAMES[1], "Grosshesseloher Bruecke");
+    checkNormalized(&FiraSansSmall, "\xC3\x8Ele\xE2\x80\x93" "Caf\xC3\xA9 \xE2\x80\x9EX\xE2\x80\x9C", "Ile-Cafe \"X\"");
+    // The device font has the en dash and the closing quote, but not the low one
+    checkNormalized(&device_font, NAMES[0], NAMES[0]);
+    checkNormalized(&device_font, "\xC3\x8Ele\xE2\x80\x93" "Caf\xC3\xA9 \xE2\x80\x9EX\xE2\x80\x9C",
+                    "\xC3\x8Ele\xE2\x80\x93" "Caf\xC3\xA9 \"X\xE2\x80\x9C");
+
+    // Malformed bytes go, and a character with no spelling, with or without a font
+    checkNormalized(&FiraSansSmall, "bad\xFF\xC3 byte", "bad byte");
+    checkNormalized(&device_font, "\xE2\x98\x83 snow", " snow");
+    checkNormalized(nullptr, "bad\xFF " "Br\xC3\xBC" "cke", "bad Br\xC3\xBC" "cke");
+
+    // A full buffer ends before a spelling, never inside one
+    char out[6];
+    GlyphIndex::normalize(&FiraSansSmall, "Br\xC3\xBC" "cke", out, sizeof(out));
+    TEST_ASSERT_EQUAL_STRING("Bruec", out);
+    GlyphIndex::normalize(&FiraSansSmall, "Br\xC3\xBC" "cke", out, 4);
+    TEST_ASSERT_EQUAL_STRING("Br", out);
+}
+
+// Average cycles per code point; on the host ESP.getCycleCount() runs at 240 MHz off the wall clock
+template <typename Lookup>
+static float cyclesPerCodePoint(const uint32_t *code_points, size_t count, Lookup lookup)
+{
+    static const int REPEATS = 20000;
+    uint32_t start = ESP.getCycleCount();
+    for (int repeat = 0; repeat < REPEATS; repeat++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            lookup(code_points[i]);
+        }
+    }
+    return (float)(ESP.getCycleCount() - start) / (REPEATS * count);
+}
+
+static volatile const GFXglyph *sink;
+
+static void report(const char *label, const GFXfont *font, const uint32_t *code_points, size_t count)
+{
+    float linear = cyclesPerCodePoint(code_points, count, [font](uint32_t code_point)
+                                      {
+        GFXglyph *glyph;
+        get_glyph(font, code_point, &glyph);
+        sink = glyph; });
+    float indexed = cyclesPerCodePoint(code_points, count, [font](uint32_t code_point)
+                                       { sink = GlyphIndex::find(font, code_point); });
+
+    char message[128];
+    snprintf(message, sizeof(message), "%-28s %-14s get_glyph %6.2f, GlyphIndex %6.2f cycles/code point", label,
+             font == &device_font ? "device-like" : "FiraSansSmall", linear, indexed);
+    TEST_MESSAGE(message);
+}
+
+void test_cycles_per_lookup()
+{
+    uint32_t code_points[256];
+    size_t count = 0;
+    for (const char *name : NAMES)
+    {
+        for (const uint8_t *s = (const uint8_t *)name; *s;)
+        {
+            s += Utf8::decode(s, &code_points[count++]);
+        }
+    }
+    // Dashes and quotes, which take the binary search
+    static const uint32_t BEYOND_LATIN1[] = {0x2010, 0x2013, 0x2018, 0x201C, 0x2020};
+
+    for (const GFXfont *font : {&FiraSansSmall, (const GFXfont *)&device_font})
+    {
+        report("station names", font, code_points, count);
+        report("beyond Latin-1", font, BEYOND_LATIN1, sizeof(BEYOND_LATIN1) / sizeof(BEYOND_LATIN1[0]));
+    }
+}
+
+int main()
+{
+    buildDeviceFont();
+    UNITY_BEGIN();
+    RUN_TEST(test_find_matches_get_glyph);
+    RUN_TEST(test_names_are_spelled_for_the_font);
+    RUN_TEST(test_cycles_per_lookup);
+    return UNITY_END();
+}
@@ -0,0 +1,82 @@
+#include <Arduino.h>
+#include <NativeHAL.h>
+#include <unity.h>
+#include "MVGClient.h"
+#include "config.h"
+
+// Connection reuse of makeRequest(): the requests of a fetch cycle share one
+// kept-alive connection, and when the server has dropped it between cycles the
+// failed request is retried once on a fresh connection, which resumes the TLS session.
+
+static const size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
+static const time_t EPOCH = 1760000000;
+static const uint32_t ALL_UPDATED = (1UL << CONFIG_COUNT) - 1;
+
+static size_t responses = 0;
+
+static int emptyDepartures(const String &url, String &body)
+{
+    responses++;
+    body = "[]";
+    return HTTP_CODE_OK;
+}
+
+// Requests go one after another on the connection of the calling task
+static TimeKeeper time_keeper(1000);
+static MVGClient client(time_keeper, 1);
+
+void setUp()
+{
+    NativeHAL::setEpoch(EPOCH);
+    NativeHAL::setHttpDelay(0, 0);
+    NativeHAL::setHttpResponder(emptyDepartures);
+    client.closeConnection();
+    responses = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_cycle_shares_one_connection()
+{
+    FetchStats before = client.getFetchStats();
+    client.fetchDepartures();
+    const FetchStats &stats = client.getFetchStats();
+
+    TEST_ASSERT_TRUE_MESSAGE(client.getRequestCount() > 1, "config.h needs two request groups");
+    TEST_ASSERT_EQUAL_UINT32(ALL_UPDATED, client.getUpdatedMask());
+    TEST_ASSERT_EQUAL_UINT32(client.getRequestCount(), stats.requests - before.requests);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.handshakes - before.handshakes);
+    TEST_ASSERT_TRUE(stats.handshakes - before.handshakes < stats.requests - before.requests);
+
+    // The next cycle goes on without a handshake
+    client.fetchDepartures();
+    TEST_ASSERT_EQUAL_UINT32(1, client.getFetchStats().handshakes - before.handshakes);
+}
+
+void test_server_close_between_cycles_retries_once()
+{
+    client.fetchDepartures();
+    FetchStats before = client.getFetchStats();
+
+    NativeHAL::closeServerConnections();
+    client.fetchDepartures();
+    const FetchStats &stats = client.getFetchStats();
+
+    // The first request fails on the dropped connection without reaching the server,
+    // its retry reconnects with a resumed session and the rest of the cycle reuses that
+    TEST_ASSERT_EQUAL_UINT32(ALL_UPDATED, client.getUpdatedMask());
+    TEST_ASSERT_EQUAL(2 * client.getRequestCount(), responses);
+    TEST_ASSERT_EQUAL_UINT32(client.getRequestCount(), stats.requests - before.requests);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.handshakes - before.handshakes);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.resumed_handshakes - before.resumed_handshakes);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cycle_shares_one_connection);
+    RUN_TEST(test_server_close_between_cycles_retries_once);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <firasans.h>
+#include <firasans_small.h>
+#include "DisplayManager.h"
+#include "FrameKernels.h"
+#include "GlyphCache.h"
+
+// The 1bpp compose mode against the 4bpp one: text drawn into a mono frame has
+// to expand to the gray frame thresholded at mid gray, with the same cursor
+// advance. Reports the buffer sizes of both modes and the cycles of what a
+// screen update does in each.
+
+static const size_t FRAME_BYTES = EPD_WIDTH * EPD_HEIGHT / 2;
+static const size_t MONO_BYTES = EPD_WIDTH * EPD_HEIGHT / 8;
+static const size_t ROW_BYTES = EPD_WIDTH / 2;
+
+alignas(FrameKernels::FRAME_ALIGNMENT) static uint8_t gray[FRAME_BYTES];
+alignas(FrameKernels::FRAME_ALIGNMENT) static uint8_t expanded[FRAME_BYTES];
+static uint8_t mono[MONO_BYTES];
+static GlyphCache cache;
+
+static const char *const TEXTS[] = {"U6", "Garching, Forschungszentrum", "5 min", "12 min", "Klinikum Gro\xC3\x9Fhadern",
+                                    "F\xC3\xBCrstenried West", "S8", "Flughafen M\xC3\xBCnchen", "x"};
+
+static uint32_t random_state;
+
+static uint32_t nextRandom()
+{
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+// Bytes where the expanded mono frame differs from the gray one cut at mid gray
+static size_t thresholdDifferences()
+{
+    FrameKernels::expandMono(expanded, mono, MONO_BYTES);
+    size_t differences = 0;
+    for (size_t i = 0; i < FRAME_BYTES; i++)
+    {
+        uint8_t low = (gray[i] & 0x0F) < 0x08 ? 0x00 : 0x0F;
+        uint8_t high = (gray[i] & 0xF0) < 0x80 ? 0x00 : 0xF0;
+        differences += (low | high) != expanded[i];
+    }
+    return differences;
+}
+
+void setUp()
+{
+    random_state = 7;
+    TEST_ASSERT_TRUE(cache.isReady());
+}
+
+void tearDown()
+{
+}
+
+void test_mono_text_matches_thresholded_gray()
+{
+    for (int pass = 0; pass < 3; pass++)
+    {
+        memset(gray, 0xFF, FRAME_BYTES);
+        memset(mono, 0x00, MONO_BYTES);
+        for (int i = 0; i < 300; i++)
+        {
+            const char *text = TEXTS[nextRandom() % (sizeof(TEXTS) / sizeof(TEXTS[0]))];
+            const GFXfont *font = (nextRandom() & 1) ? &FiraSans : &FiraSansSmall;
+            int32_t x = nextRandom() % 900;
+            int32_t y = 60 + nextRandom() % 460;
+            int32_t gray_x = x;
+            int32_t mono_x = x;
+            cache.drawText(font, text, &gray_x, y, gray);
+            cache.drawTextMono(font, text, &mono_x, y, mono);
+            TEST_ASSERT_EQUAL_INT32(gray_x, mono_x);
+        }
+        TEST_ASSERT_EQUAL(0, thresholdDifferences());
+    }
+}
+
+void test_mono_rects_match_thresholded_gray()
+{
+    memset(gray, 0xFF, FRAME_BYTES);
+    memset(mono, 0x00, MONO_BYTES);
+    for (int i = 0; i < 2000; i++)
+    {
+        int32_t x = (int32_t)(nextRandom() % 1100) - 70;
+        int32_t y = (int32_t)(nextRandom() % 640) - 50;
+        int32_t width = nextRandom() % 400;
+        int32_t height = nextRandom() % 60;
+        bool black = nextRandom() & 1;
+        FrameKernels::fillRect(gray, x, y, width, height, black ? 0x00 : 0xFF);
+        FrameKernels::fillRectMono(mono, x, y, width, height, black);
+    }
+    TEST_ASSERT_EQUAL(0, thresholdDifferences());
+}
+
+template <typename Work>
+static uint32_t cyclesPerCall(int calls, Work work)
+{
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < calls; i++)
+    {
+        work();
+    }
+    return (ESP.getCycleCount() - start) / calls;
+}
+
+static void report(const char *label, uint32_t gray_cycles, uint32_t mono_cycles)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%-28s gray %8u, mono %8u cycles", label, (unsigned)gray_cycles, (unsigned)mono_cycles);
+    TEST_MESSAGE(message);
+}
+
+void test_memory_and_cycles_per_mode()
+{
+    char message[128];
+    snprintf(message, sizeof(message), "compose buffer: gray %u B in PSRAM, mono %u B in internal RAM",
+             (unsigned)DisplayManager::composeBytes(FrameFormat::GRAY4), (unsigned)DisplayManager::composeBytes(FrameFormat::MONO1));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(8 * DisplayManager::composeBytes(FrameFormat::MONO1), 2 * DisplayManager::composeBytes(FrameFormat::GRAY4));
+
+    report("clear",
+           cyclesPerCall(50, []
+                         { FrameKernels::fill(gray, 0xFF, FRAME_BYTES); }),
+           cyclesPerCall(50, []
+                         { memset(mono, 0x00, MONO_BYTES); }));
+    report("minutes update",
+           cyclesPerCall(200, []
+                         {
+        FrameKernels::fillRect(gray, 800, 200, 160, 52, 0xFF);
+        int32_t x = 800;
+        cache.drawText(&FiraSans, "12 min", &x, 240, gray); }),
+           cyclesPerCall(200, []
+                         {
+        FrameKernels::fillRectMono(mono, 800, 200, 160, 52, false);
+        int32_t x = 800;
+        cache.drawTextMono(&FiraSans, "12 min", &x, 240, mono); }));
+    report("destination row",
+           cyclesPerCall(200, []
+                         {
+        int32_t x = 180;
+        cache.drawText(&FiraSans, "Garching, Forschungszentrum", &x, 300, gray); }),
+           cyclesPerCall(200, []
+                         {
+        int32_t x = 180;
+        cache.drawTextMono(&FiraSans, "Garching, Forschungszentrum", &x, 300, mono); }));
+    // What the panel task does to a 960x32 band before pushing it: copy it, or expand it
+    static uint8_t band[ROW_BYTES * 32];
+    report("push band 960x32",
+           cyclesPerCall(200, []
+                         { memcpy(band, gray + 200 * ROW_BYTES, sizeof(band)); }),
+           cyclesPerCall(200, []
+                         { FrameKernels::expandMono(band, mono + 200 * FrameKernels::MONO_ROW_BYTES, sizeof(band) / 4); }));
+}
+
+int main()
+{
+    cache.init();
+    UNITY_BEGIN();
+    RUN_TEST(test_mono_text_matches_thresholded_gray);
+    RUN_TEST(test_mono_rects_match_thresholded_gray);
+    RUN_TEST(test_memory_and_cycles_per_mode);
+    return UNITY_END();
+}
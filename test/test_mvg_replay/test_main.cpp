@@ -0,0 +1,201 @@
+#include <Arduino.h>
+#include <NativeHAL.h>
+#include <unity.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+#include "MVGClient.h"
+#include "config.h"
+
+// Replays full-size /departures responses through MVGClient, so the filtered
+// deserializeJson() of makeRequest() is what gets measured: peak heap of a
+// fetch cycle and parse time per response, next to the same responses read with
+// getString() and parsed whole, as makeRequest() did before. Recordings in
+// MVG_REPLAY_DIR are used when it is set, generated responses with every field
+// the API sends otherwise.
+
+static const size_t CONFIG_COUNT = sizeof(configs) / sizeof(configs[0]);
+static const size_t DEPARTURES_PER_STATION = 5;
+static const time_t EPOCH = 1760000000;
+static const int ROUNDS = 20;
+// Heap a cycle may leave behind on average; the host allocator drifts by a few hundred bytes
+static const uint32_t LEAK_PER_CYCLE = 128;
+
+static const char *const TYPES[] = {"UBAHN", "SBAHN", "BUS", "TRAM"};
+static const char *const DESTINATIONS[] = {"F\\u00fcrstenried West", "Moosach", "Giesing Bahnhof",
+                                           "M\\u00fcnchen Flughafen Terminal", "Neuperlach S\\u00fcd"};
+
+static size_t largest_response = 0;
+// The URLs of one fetch cycle, for the getString() baseline
+static String requested_urls[32];
+static size_t requested_count = 0;
+static bool recording = false;
+
+static String queryValue(const String &url, const char *key)
+{
+    int start = url.indexOf(key);
+    if (start < 0)
+        return String();
+    start += strlen(key);
+    int end = url.indexOf('&', start);
+    return url.substring(start, end < 0 ? url.length() : end);
+}
+
+// One departure as the API sends it, most of which the filter skips
+static void appendDeparture(String &body, const char *type, size_t index)
+{
+    char departure[640];
+    long long planned = (long long)(EPOCH + 120 + index * 150) * 1000;
+    snprintf(departure, sizeof(departure),
+             "{\"plannedDepartureTime\":%lld,\"departureTime\":%lld,\"realtime\":true,\"delayInMinutes\":1,"
+             "\"realtimeDepartureTime\":%lld,\"transportType\":\"%s\",\"label\":\"%u\",\"divaId\":\"010%u\","
+             "\"network\":\"swm\",\"trainType\":\"\",\"destination\":\"%s\",\"cancelled\":false,\"sev\":false,"
+             "\"stopPositionNumber\":%u,\"messages\":[],\"bannerHash\":\"\",\"occupancy\":\"LOW\","
+             "\"stopPointGlobalId\":\"de:09162:2:52:52\",\"platform\":%u,\"platformChanged\":false}",
+             planned, planned, planned + 60000, type, (unsigned)(index % 7 + 1), (unsigned)(index % 7 + 1),
+             DESTINATIONS[index % 5], (unsigned)(index % 4 + 1), (unsigned)(index % 4 + 1));
+    body += departure;
+}
+
+// Serves limit departures of the requested types in turn
+static int generatedResponse(const String &url, String &body)
+{
+    String types = queryValue(url, "transportTypes=");
+    size_t limit = queryValue(url, "limit=").toInt();
+
+    String list = String(",") + types + ",";
+    const char *requested[4];
+    size_t requested_count = 0;
+    for (const char *type : TYPES)
+    {
+        char needle[16];
+        snprintf(needle, sizeof(needle), ",%s,", type);
+        if (types.isEmpty() || list.indexOf(needle) >= 0)
+            requested[requested_count++] = type;
+    }
+
+    body = "[";
+    for (size_t i = 0; i < limit; i++)
+    {
+        if (i)
+            body += ",";
+        appendDeparture(body, requested[i % requested_count], i);
+    }
+    body += "]";
+    largest_response = max(largest_response, (size_t)body.length());
+    return HTTP_CODE_OK;
+}
+
+static int recordedResponse(const String &url, String &body)
+{
+    if (recording && requested_count < sizeof(requested_urls) / sizeof(requested_urls[0]))
+        requested_urls[requested_count++] = url;
+    return getenv("MVG_REPLAY_DIR") ? NativeHAL::replayResponse(url, body) : generatedResponse(url, body);
+}
+
+void setUp()
+{
+    NativeHAL::setEpoch(EPOCH);
+    NativeHAL::setHttpDelay(0, 0);
+    NativeHAL::setHttpResponder(recordedResponse);
+}
+
+void tearDown()
+{
+}
+
+void test_replay_fills_every_station()
+{
+    TimeKeeper time_keeper(1000);
+    MVGClient client(time_keeper);
+    client.fetchDepartures();
+
+    const DepartureTable &table = client.getStationList();
+    TEST_ASSERT_EQUAL_UINT32((1UL << CONFIG_COUNT) - 1, client.getUpdatedMask());
+    for (size_t i = 0; i < CONFIG_COUNT; i++)
+    {
+        if (getenv("MVG_REPLAY_DIR"))
+            TEST_ASSERT_TRUE(table.departureCount(i) > 0);
+        else
+            TEST_ASSERT_EQUAL(DEPARTURES_PER_STATION, table.departureCount(i));
+    }
+}
+
+void test_replay_heap_and_parse_time()
+{
+    TimeKeeper time_keeper(1000);
+    MVGClient client(time_keeper);
+    // The first cycles plan the requests, start the workers and grow the shims' buffers
+    client.fetchDepartures();
+    recording = true;
+    client.fetchDepartures();
+    recording = false;
+
+    uint32_t heap_start = ESP.getFreeHeap();
+    uint32_t peak_heap = 0;
+    uint32_t requests_before = client.getFetchStats().requests;
+    uint32_t parse_before = client.getFetchStats().total_parse_us;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        uint32_t heap_before = ESP.getFreeHeap();
+        NativeHAL::resetMinFreeHeap();
+        client.fetchDepartures();
+        uint32_t min_heap = ESP.getMinFreeHeap();
+        peak_heap = max(peak_heap, heap_before > min_heap ? heap_before - min_heap : 0);
+    }
+
+    const FetchStats &stats = client.getFetchStats();
+    uint32_t requests = stats.requests - requests_before;
+    uint32_t parse_us = (stats.total_parse_us - parse_before) / max(requests, (uint32_t)1);
+    char message[160];
+    snprintf(message, sizeof(message), "%u requests, largest response %u bytes, peak heap %u bytes per cycle, %u us per parse",
+             (unsigned)requests, (unsigned)largest_response, (unsigned)peak_heap, (unsigned)parse_us);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL_UINT32(ROUNDS * client.getRequestCount(), requests);
+    // Documents are preallocated and cleared per response, so cycles must not accumulate heap
+    TEST_ASSERT_TRUE(ESP.getFreeHeap() + ROUNDS * LEAK_PER_CYCLE >= heap_start);
+
+    // The same cycle as makeRequest() did it before: the whole body into a String,
+    // parsed unfiltered into the 16 KB document MVGClient used to hold
+    static StaticJsonDocument<16384> whole_doc;
+    size_t urls = requested_count;
+    TEST_ASSERT_EQUAL(client.getRequestCount(), urls);
+    uint32_t whole_peak_heap = 0;
+    uint32_t whole_parse_us = 0;
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        uint32_t heap_before = ESP.getFreeHeap();
+        NativeHAL::resetMinFreeHeap();
+        for (size_t i = 0; i < urls; i++)
+        {
+            HTTPClient http;
+            http.begin(requested_urls[i]);
+            TEST_ASSERT_EQUAL(HTTP_CODE_OK, http.GET());
+
+            unsigned long parse_start = micros();
+            String payload = http.getString();
+            whole_doc.clear();
+            TEST_ASSERT_FALSE(deserializeJson(whole_doc, payload));
+            whole_parse_us += micros() - parse_start;
+            // Both alive here, which is the peak of the old path
+            ESP.getFreeHeap();
+            http.end();
+        }
+        uint32_t min_heap = ESP.getMinFreeHeap();
+        whole_peak_heap = max(whole_peak_heap, heap_before > min_heap ? heap_before - min_heap : 0);
+    }
+    whole_parse_us /= ROUNDS * urls;
+
+    snprintf(message, sizeof(message), "getString() and a whole parse: peak heap %u bytes per cycle, %u us per parse",
+             (unsigned)whole_peak_heap, (unsigned)whole_parse_us);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(peak_heap < whole_peak_heap);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_fills_every_station);
+    RUN_TEST(test_replay_heap_and_parse_time);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+#include <NativeHAL.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <unity.h>
+
+// Checks that the firmware's dependencies link and work through the host shims:
+// ArduinoJson parsing a filtered document off the HTTPClient stream, the emulated
+// clock, and tasks switching on a queue.
+
+void setUp()
+{
+    NativeHAL::setHttpResponder(nullptr);
+    NativeHAL::setHttpDelay(0, 0);
+}
+
+void tearDown()
+{
+}
+
+void test_json_filter_over_http_stream()
+{
+    NativeHAL::setHttpResponder([](const String &url, String &body)
+                                {
+        if (url.indexOf("globalId=de:09162:2") < 0)
+            return (int)HTTP_CODE_NOT_FOUND;
+        body = "[{\"label\":\"U3\",\"destination\":\"F\\u00fcrstenried West\",\"platform\":2,"
+               "\"departureTime\":1760000300000,\"messages\":[\"a\",\"b\"]},"
+               "{\"label\":\"S8\",\"destination\":\"Flughafen\",\"departureTime\":1760000900000}]";
+        return (int)HTTP_CODE_OK; });
+
+    WiFiClient client;
+    HTTPClient http;
+    TEST_ASSERT_TRUE(http.begin(client, "https://www.mvg.de/api/bgw-pt/v3/departures?globalId=de:09162:2"));
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, http.GET());
+
+    StaticJsonDocument<128> filter;
+    JsonObject fields = filter.createNestedObject();
+    fields["label"] = true;
+    fields["destination"] = true;
+    fields["departureTime"] = true;
+
+    StaticJsonDocument<512> doc;
+    DeserializationError error = deserializeJson(doc, http.getStream(), DeserializationOption::Filter(filter));
+    http.end();
+
+    TEST_ASSERT_FALSE(error);
+    JsonArray departures = doc.as<JsonArray>();
+    TEST_ASSERT_EQUAL(2, departures.size());
+    TEST_ASSERT_EQUAL_STRING("U3", departures[0]["label"] | "");
+    TEST_ASSERT_EQUAL_STRING("F\xC3\xBCrstenried West", departures[0]["destination"] | "");
+    TEST_ASSERT_TRUE(departures[0]["platform"].isNull());
+    TEST_ASSERT_EQUAL(1760000900, departures[1]["departureTime"].as<long long>() / 1000);
+}
+
+void test_unknown_station_is_not_found()
+{
+    NativeHAL::setHttpResponder([](const String &url, String &body)
+                                { return (int)HTTP_CODE_NOT_FOUND; });
+
+    HTTPClient http;
+    TEST_ASSERT_TRUE(http.begin("https://www.mvg.de/api/bgw-pt/v3/departures?globalId=none"));
+    TEST_ASSERT_EQUAL(HTTP_CODE_NOT_FOUND, http.GET());
+    http.end();
+}
+
+void test_delay_advances_the_emulated_clock()
+{
+    unsigned long start = millis();
+    delay(60000);
+    TEST_ASSERT_EQUAL(60000, millis() - start);
+}
+
+static void echoTask(void *parameter)
+{
+    QueueHandle_t queue = (QueueHandle_t)parameter;
+    uint32_t value;
+    xQueueReceive(queue, &value, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    value++;
+    xQueueSend(queue, &value, portMAX_DELAY);
+    vTaskDelete(nullptr);
+}
+
+void test_tasks_switch_on_a_queue()
+{
+    QueueHandle_t queue = xQueueCreate(1, sizeof(uint32_t));
+    xTaskCreate(echoTask, "echo", 2048, queue, 1, nullptr);
+
+    uint32_t value = 41;
+    unsigned long start = millis();
+    xQueueSend(queue, &value, portMAX_DELAY);
+    // The echo task may take the value back off first; wait until it has answered
+    vTaskDelay(pdMS_TO_TICKS(10));
+    TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(queue, &value, pdMS_TO_TICKS(1000)));
+    TEST_ASSERT_EQUAL(42, value);
+    TEST_ASSERT_GREATER_OR_EQUAL(500, millis() - start);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_json_filter_over_http_stream);
+    RUN_TEST(test_unknown_station_is_not_found);
+    RUN_TEST(test_delay_advances_the_emulated_clock);
+    RUN_TEST(test_tasks_switch_on_a_queue);
+    return UNITY_END();
+}
@@ -0,0 +1,199 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <firasans.h>
+#include <firasans_small.h>
+#include "GlyphIndex.h"
+#include "TextLayout.h"
+#include "Utf8.h"
+
+// Lays out station screens with TextLayout: every string has to fit its
+// column, cut ones keep a prefix of whole characters and end in the ellipsis,
+// characters the font lacks are spelled out, minutes end on the right margin,
+// and the fit cache must not change any of it. Reports the layout time per
+// screen with a cold and a warm cache.
+
+static const int ROWS = 10;
+static const int32_t LINE_X = 50;
+static const int32_t LINE_WIDTH = 110;
+static const int32_t DEST_X = 180;
+static const int32_t DEST_WIDTH = 560;
+static const int32_t TIME_X = 760;
+static const int32_t TIME_WIDTH = 150;
+
+static const char *const STATION = "M\xC3\xBCnchner Freiheit";
+static const char *const LINES[ROWS] = {"U6", "U3", "U6", "U2", "U1", "U3", "U3", "U4", "U1", "SEV12345"};
+static const char *const DESTINATIONS[ROWS] = {"Garching, Forschungszentrum", "Klinikum Gro\xC3\x9Fhadern", "F\xC3\xBCrstenried West",
+                                               "Messestadt Ost", "Olympia-Einkaufszentrum", "Moosach", "Feldmoching",
+                                               "Arabellapark", "Mangfallplatz",
+                                               "Garching, Forschungszentrum via Studentenstadt und Alte Heide"};
+
+static TextLayout layout;
+static RenderList list;
+
+static void layOut(TextLayout &text_layout, RenderList &render_list, int minute)
+{
+    render_list.clear();
+    text_layout.place(render_list, &FiraSans, STATION, LINE_X, 100, TIME_X + TIME_WIDTH - LINE_X, TextLayout::Align::LEFT);
+    for (int row = 0; row < ROWS; row++)
+    {
+        char minutes[16];
+        snprintf(minutes, sizeof(minutes), "%d min", (row * 7 + minute) % 60);
+        int32_t y = 200 + row * 52;
+        text_layout.place(render_list, &FiraSans, LINES[row], LINE_X, y, LINE_WIDTH, TextLayout::Align::LEFT);
+        text_layout.place(render_list, &FiraSans, DESTINATIONS[row], DEST_X, y, DEST_WIDTH, TextLayout::Align::LEFT);
+        text_layout.place(render_list, &FiraSans, minutes, TIME_X, y, TIME_WIDTH, TextLayout::Align::RIGHT);
+    }
+}
+
+// The placed text is the original as the font spells it, or a prefix of whole
+// characters of that followed by the ellipsis
+static void checkCut(const char *placed, const char *text, int32_t width)
+{
+    char original[64];
+    GlyphIndex::normalize(&FiraSans, text, original, sizeof(original));
+    TEST_ASSERT_TRUE(TextLayout::measure(&FiraSans, placed) <= width);
+    if (strcmp(placed, original) == 0)
+        return;
+
+    const char *ellipsis = strstr(placed, "\xE2\x80\xA6") ? "\xE2\x80\xA6" : "...";
+    size_t kept = strlen(placed) - strlen(ellipsis);
+    TEST_ASSERT_EQUAL_STRING(ellipsis, placed + kept);
+    TEST_ASSERT_EQUAL(0, strncmp(placed, original, kept));
+    uint32_t code_point;
+    TEST_ASSERT_TRUE(original[kept] == '\0' || Utf8::decode((const uint8_t *)original + kept, &code_point) > 0);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_columns_hold_their_text()
+{
+    layOut(layout, list, 0);
+    TEST_ASSERT_EQUAL(1 + ROWS * 3, list.size());
+
+    checkCut(list.text(list.item(0)), STATION, TIME_X + TIME_WIDTH - LINE_X);
+    size_t truncated = 0;
+    for (int row = 0; row < ROWS; row++)
+    {
+        const RenderList::Item &line = list.item(1 + row * 3);
+        const RenderList::Item &destination = list.item(2 + row * 3);
+        const RenderList::Item &minutes = list.item(3 + row * 3);
+
+        TEST_ASSERT_EQUAL_INT32(LINE_X, line.x);
+        checkCut(list.text(line), LINES[row], LINE_WIDTH);
+        TEST_ASSERT_EQUAL_INT32(DEST_X, destination.x);
+        checkCut(list.text(destination), DESTINATIONS[row], DEST_WIDTH);
+        truncated += strstr(list.text(line), "...") || strstr(list.text(line), "\xE2\x80\xA6");
+        truncated += strstr(list.text(destination), "...") || strstr(list.text(destination), "\xE2\x80\xA6");
+
+        // Right aligned: the cursor ends on the margin
+        TEST_ASSERT_EQUAL_INT32(TIME_X + TIME_WIDTH, minutes.x + TextLayout::measure(&FiraSans, list.text(minutes)));
+    }
+    // The long line label and the long destination
+    TEST_ASSERT_EQUAL(2, truncated);
+}
+
+void test_missing_characters_are_spelled()
+{
+    // The small font has only ASCII; a spelled string is cached like any other
+    static TextLayout uncached;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        list.clear();
+        layout.place(list, &FiraSansSmall, STATION, LINE_X, 100, 800, TextLayout::Align::LEFT);
+        layout.place(list, &FiraSansSmall, DESTINATIONS[1], LINE_X, 150, 800, TextLayout::Align::LEFT);
+        uncached.place(list, &FiraSansSmall, DESTINATIONS[1], LINE_X, 200, 800, TextLayout::Align::LEFT);
+        TEST_ASSERT_EQUAL_STRING("Muenchner Freiheit", list.text(list.item(0)));
+        TEST_ASSERT_EQUAL_STRING("Klinikum Grosshadern", list.text(list.item(1)));
+        TEST_ASSERT_EQUAL_STRING("Klinikum Grosshadern", list.text(list.item(2)));
+    }
+
+    // Cut after spelling, so the kept part is of the spelled string
+    list.clear();
+    layout.place(list, &FiraSansSmall, DESTINATIONS[1], LINE_X, 100, TextLayout::measure(&FiraSansSmall, "Klinikum Gross..."),
+                 TextLayout::Align::LEFT);
+    TEST_ASSERT_EQUAL_STRING("Klinikum Gross...", list.text(list.item(0)));
+}
+
+void test_cached_fits_match_measuring()
+{
+    // Without init() there is no cache, so every string is fitted again
+    static TextLayout uncached;
+    static RenderList expected;
+    for (int minute = 0; minute < 90; minute++)
+    {
+        layOut(layout, list, minute);
+        layOut(uncached, expected, minute);
+        TEST_ASSERT_EQUAL(expected.size(), list.size());
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            TEST_ASSERT_EQUAL_INT32(expected.item(i).x, list.item(i).x);
+            TEST_ASSERT_EQUAL_STRING(expected.text(expected.item(i)), list.text(list.item(i)));
+        }
+    }
+    TEST_ASSERT_TRUE(layout.getStats().fit_hits > layout.getStats().fit_misses);
+}
+
+// Average cycles of a screen; on the host ESP.getCycleCount() runs at 240 MHz off the wall clock
+template <typename Work>
+static uint32_t cyclesPerScreen(int screens, Work work)
+{
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < screens; i++)
+    {
+        work(i);
+    }
+    return (ESP.getCycleCount() - start) / screens;
+}
+
+static void report(const char *label, uint32_t cycles)
+{
+    char message[96];
+    snprintf(message, sizeof(message), "%-36s %7u cycles, %6.2f us", label, (unsigned)cycles, cycles / 240.0f);
+    TEST_MESSAGE(message);
+}
+
+void test_layout_time_per_screen()
+{
+    static TextLayout fresh;
+    fresh.init();
+    static volatile int32_t sink;
+
+    report("measure only, no fitting",
+           cyclesPerScreen(200, [](int)
+                           {
+        int32_t width = TextLayout::measure(&FiraSans, STATION);
+        for (int row = 0; row < ROWS; row++)
+            width += TextLayout::measure(&FiraSans, LINES[row]) + TextLayout::measure(&FiraSans, DESTINATIONS[row]) +
+                     TextLayout::measure(&FiraSans, "12 min");
+        sink = width; }));
+    report("layout, cold cache", cyclesPerScreen(1, [](int)
+                                                 { layOut(fresh, list, 0); }));
+    report("layout, warm cache", cyclesPerScreen(200, [](int)
+                                                 { layOut(fresh, list, 0); }));
+    report("layout, new minutes every screen", cyclesPerScreen(60, [](int minute)
+                                                               { layOut(fresh, list, minute); }));
+
+    const TextLayoutStats &stats = fresh.getStats();
+    char message[96];
+    snprintf(message, sizeof(message), "fit hits %u, misses %u, truncated %u",
+             (unsigned)stats.fit_hits, (unsigned)stats.fit_misses, (unsigned)stats.truncated);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(sink > 0);
+}
+
+int main()
+{
+    layout.init();
+    UNITY_BEGIN();
+    RUN_TEST(test_columns_hold_their_text);
+    RUN_TEST(test_missing_characters_are_spelled);
+    RUN_TEST(test_cached_fits_match_measuring);
+    RUN_TEST(test_layout_time_per_screen);
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <NativeHAL.h>
+#include <Preferences.h>
+#include <unity.h>
+#include "TLSSessionClient.h"
+
+// Session resumption of TLSSessionClient against the TLS stand-in of NativeHAL:
+// which session is offered after a reconnect, a deep sleep wake and a power
+// cycle, and that a rejected ticket falls back to a full handshake.
+
+extern "C" char __start_rtc_data[] __attribute__((weak));
+extern "C" char __stop_rtc_data[] __attribute__((weak));
+
+static const char *HOST = "www.mvg.de";
+// Larger than the RTC copy holds, like a session with the peer certificate kept
+static const size_t NVS_SESSION_SIZE = 3000;
+
+// A power cycle loses RTC slow memory, NVS stays
+static void powerCycle()
+{
+    memset(__start_rtc_data, 0, __stop_rtc_data - __start_rtc_data);
+}
+
+void setUp()
+{
+    powerCycle();
+    Preferences preferences;
+    preferences.begin("tls", false);
+    preferences.clear();
+    preferences.end();
+    NativeHAL::setTlsSessionSize(1200);
+    NativeHAL::setHttpResponder([](const String &url, String &body)
+                                {
+        body = "[]";
+        return (int)HTTP_CODE_OK; });
+}
+
+void tearDown()
+{
+}
+
+void test_first_connect_is_a_full_handshake()
+{
+    TLSSessionClient client;
+    TEST_ASSERT_EQUAL(1, client.connect(HOST, 443));
+    TEST_ASSERT_FALSE(client.sessionResumed());
+}
+
+void test_reconnect_resumes_from_rtc_memory()
+{
+    TLSSessionClient client;
+    client.connect(HOST, 443);
+    client.stop();
+    TEST_ASSERT_EQUAL(1, client.connect(HOST, 443));
+    TEST_ASSERT_TRUE(client.sessionResumed());
+
+    // A deep sleep wake keeps RTC memory, and a new client finds the session there
+    TLSSessionClient woken;
+    woken.connect(HOST, 443);
+    TEST_ASSERT_TRUE(woken.sessionResumed());
+}
+
+void test_other_host_does_not_resume()
+{
+    TLSSessionClient client;
+    client.connect(HOST, 443);
+    client.connect("example.org", 443);
+    TEST_ASSERT_FALSE(client.sessionResumed());
+}
+
+void test_power_cycle_loses_a_session_kept_in_rtc_memory()
+{
+    TLSSessionClient client;
+    client.connect(HOST, 443);
+    powerCycle();
+    client.connect(HOST, 443);
+    TEST_ASSERT_FALSE(client.sessionResumed());
+}
+
+void test_large_session_resumes_from_nvs_after_power_cycle()
+{
+    NativeHAL::setTlsSessionSize(NVS_SESSION_SIZE);
+    TLSSessionClient client;
+    client.connect(HOST, 443);
+    powerCycle();
+    client.connect(HOST, 443);
+    TEST_ASSERT_TRUE(client.sessionResumed());
+}
+
+void test_rotated_ticket_key_forces_a_full_handshake()
+{
+    TLSSessionClient client;
+    client.connect(HOST, 443);
+    NativeHAL::rotateTlsTicketKey();
+    client.connect(HOST, 443);
+    TEST_ASSERT_FALSE(client.sessionResumed());
+
+    // The new session is saved and resumes in turn
+    client.connect(HOST, 443);
+    TEST_ASSERT_TRUE(client.sessionResumed());
+}
+
+void test_http_client_connects_through_the_session_client()
+{
+    TLSSessionClient client;
+    HTTPClient http;
+    http.begin(client, "https://www.mvg.de/api/bgw-pt/v3/departures?globalId=de:09162:2");
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, http.GET());
+    TEST_ASSERT_FALSE(client.sessionResumed());
+    http.getString();
+
+    // The connection is kept alive, so the next request runs no handshake
+    TEST_ASSERT_TRUE(http.connected());
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, http.GET());
+    TEST_ASSERT_FALSE(client.sessionResumed());
+
+    // Once it is closed, the next request reconnects and resumes
+    client.stop();
+    TEST_ASSERT_EQUAL(HTTP_CODE_OK, http.GET());
+    TEST_ASSERT_TRUE(client.sessionResumed());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_connect_is_a_full_handshake);
+    RUN_TEST(test_reconnect_resumes_from_rtc_memory);
+    RUN_TEST(test_other_host_does_not_resume);
+    RUN_TEST(test_power_cycle_loses_a_session_kept_in_rtc_memory);
+    RUN_TEST(test_large_session_resumes_from_nvs_after_power_cycle);
+    RUN_TEST(test_rotated_ticket_key_forces_a_full_handshake);
+    RUN_TEST(test_http_client_connects_through_the_session_client);
+    return UNITY_END();
+}